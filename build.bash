@@ -23,7 +23,7 @@ COMMENTOUT
 
 #compile
 cpp_files=$(find ./src -name "*.cpp")
-g++ -std=c++11 -c -w ${cpp_files} \
+g++ -std=c++11 -mavx -c -w ${cpp_files} \
 -F ../library \
 -I ../library/stb \
 -I ../library/FBXSDK/include \
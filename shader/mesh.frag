@@ -0,0 +1,25 @@
+#version 330
+
+//variants,one of
+//COLOR_TEXTURE = diffuse texture
+//COLOR_UV      = uv
+//COLOR_NORMAL  = normal
+
+in vec2 _uv;
+in vec3 _normal;
+
+#ifdef COLOR_TEXTURE
+uniform sampler2D diffuse_texture;
+#endif
+
+out vec4 color;
+
+void main(){
+#if defined(COLOR_TEXTURE)
+    color = texture(diffuse_texture,vec2(_uv.x,1-_uv.y));
+#elif defined(COLOR_UV)
+    color = vec4(vec2(_uv.x,1-_uv.y),1,1);
+#elif defined(COLOR_NORMAL)
+    color = vec4(_normal,1);
+#endif
+}
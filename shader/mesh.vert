@@ -0,0 +1,99 @@
+#version 330
+
+//variants
+//SKELETAL  = skinning with the bone textures
+//QUANTIZED = quantized vertex format
+//xyz = unorm16 relative to the mesh aabb,normal = octahedral snorm16 as raw integers
+//uv = half float,bone_index = u8 or u16,bone_weight = unorm8 summing to 255
+
+#ifdef QUANTIZED
+layout(location = 0) in vec4 xyz_q;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec2 normal_q;
+#else
+layout(location = 0) in vec3 xyz;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec3 normal;
+#endif
+
+#ifdef SKELETAL
+#ifdef QUANTIZED
+layout(location = 3) in uvec4 bone_index;
+#else
+layout(location = 3) in ivec4 bone_index;
+#endif
+layout(location = 4) in vec4 bone_weight;
+
+//bbp = bone bind pose
+//i = inverse
+//t = transpose
+uniform sampler1D bbp_i;
+uniform sampler1D bbp_iti;
+uniform sampler1D bp;
+uniform sampler1D bp_it;
+
+//bone lod,a disabled bone reads the pose of its nearest enabled ancestor
+uniform isampler1D lod_source;
+#endif
+
+#ifdef QUANTIZED
+//aabb of the mesh
+uniform vec3 xyz_min;
+uniform vec3 xyz_extent;
+#endif
+
+uniform mat4 world;
+uniform mat4 view;
+uniform mat4 perspective;
+
+out vec2 _uv;
+out vec3 _normal;
+
+#ifdef QUANTIZED
+vec3 decode_octahedral(vec2 e){
+    e = max(e/32767.0,-1.0);
+    vec3 n = vec3(e,1.0-abs(e.x)-abs(e.y));
+    if (n.z < 0.0){
+        n.xy = (1.0-abs(n.yx))*vec2(n.x >= 0.0 ? 1.0 : -1.0,n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+#endif
+
+void main(){
+#ifdef QUANTIZED
+    vec3 xyz = xyz_min+xyz_q.xyz*xyz_extent;
+    vec3 normal = decode_octahedral(normal_q);
+#endif
+    
+#ifdef SKELETAL
+    mat4 m_bbp_i[4],m_bbp_iti[4],m_bp[4],m_bp_it[4];
+    for (int i = 0;i < 4;i++){
+        int bone = texelFetch(lod_source,int(bone_index[i]),0).r;
+        for (int j = 0;j < 4;j++){
+            m_bbp_i[i][j] = texelFetch(bbp_i,4*bone+j,0);
+            m_bbp_iti[i][j] = texelFetch(bbp_iti,4*bone+j,0);
+            m_bp[i][j] = texelFetch(bp,4*bone+j,0);
+            m_bp_it[i][j] = texelFetch(bp_it,4*bone+j,0);
+        }
+    }
+    
+    mat4 bone_matrix_xyz = bone_weight[0]*m_bp[0]*m_bbp_i[0]
+                          +bone_weight[1]*m_bp[1]*m_bbp_i[1]
+                          +bone_weight[2]*m_bp[2]*m_bbp_i[2]
+                          +bone_weight[3]*m_bp[3]*m_bbp_i[3];
+    
+    mat4 bone_matrix_normal = bone_weight[0]*m_bp_it[0]*m_bbp_iti[0]
+                             +bone_weight[1]*m_bp_it[1]*m_bbp_iti[1]
+                             +bone_weight[2]*m_bp_it[2]*m_bbp_iti[2]
+                             +bone_weight[3]*m_bp_it[3]*m_bbp_iti[3];
+    
+    _uv = uv;
+    _normal = normalize((bone_matrix_normal*vec4(normal,0)).xyz);
+    gl_Position = perspective*view*world*bone_matrix_xyz*vec4(xyz,1);
+#else
+    _uv = uv;
+    _normal = normal;
+    gl_Position = perspective*view*world*vec4(xyz,1.0);
+#endif
+}
@@ -0,0 +1,48 @@
+#version 330
+
+layout(location = 1) in vec2 uv;
+
+//vertex animation texture
+//texel of vertex v at frame f is i%vat_width,i/vat_width where i = f*vat_vertex_count+v
+uniform sampler2D vat_xyz;
+uniform sampler2D vat_normal;
+uniform int vat_width;
+uniform int vat_vertex_count;
+uniform int vat_frame_count;
+uniform float vat_duration;
+
+//first vertex of the sub mesh in the texture
+uniform int base_vertex;
+
+//xyz = translation,w = time offset
+uniform vec4 instances[64];
+uniform float time;
+
+uniform mat4 world;
+uniform mat4 view;
+uniform mat4 perspective;
+
+out vec2 _uv;
+out vec3 _normal;
+
+ivec2 texel(int frame){
+    int i = frame*vat_vertex_count+base_vertex+gl_VertexID;
+    return ivec2(i%vat_width,i/vat_width);
+}
+
+void main(){
+    vec4 instance = instances[gl_InstanceID];
+
+    //frames are evenly spaced over [0,vat_duration]
+    float t = mod(time+instance.w,vat_duration);
+    float f = t/vat_duration*float(vat_frame_count-1);
+    int f0 = min(int(f),vat_frame_count-2);
+    float w = clamp(f-float(f0),0.0,1.0);
+
+    vec3 xyz = mix(texelFetch(vat_xyz,texel(f0),0).xyz,texelFetch(vat_xyz,texel(f0+1),0).xyz,w);
+    vec3 normal = mix(texelFetch(vat_normal,texel(f0),0).xyz,texelFetch(vat_normal,texel(f0+1),0).xyz,w);
+
+    _uv = uv;
+    _normal = normalize(normal);
+    gl_Position = perspective*view*(world*vec4(xyz,1)+vec4(instance.xyz,0));
+}
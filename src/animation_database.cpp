@@ -0,0 +1,344 @@
+#include "animation_database.hpp"
+#include "resource.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <set>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+//clip data alignment,a multiple of the page size of every target
+static const uint64_t ADB_ALIGNMENT = 16384;
+
+//file layout
+static const char ADB_MAGIC[4] = {'A','D','B','2'};
+struct ADBHeader{
+    char magic[4];
+    uint32_t clip_count;
+    uint64_t toc_offset; //table of contents after the clip data,rewritten on every append
+    uint64_t string_size;//string table follows the table of contents
+};
+struct ADBEntry{
+    uint64_t name_offset;      //in the string table
+    uint64_t name_size;
+    uint64_t bone_names_offset;//in the string table,names are terminated by '\0'
+    uint64_t bone_names_size;
+    uint64_t bone_count;
+    uint64_t frame_count;
+    double duration;
+    int64_t source_time;       //modification time of the source fbx file
+    uint64_t source_size;
+    uint64_t data_offset;      //from the beginning of the file
+};
+
+//mincore takes char* on macos and unsigned char* on linux
+#if defined(__APPLE__)
+typedef char mincore_vec_t;
+#else
+typedef unsigned char mincore_vec_t;
+#endif
+
+//clip to be listed in a new table of contents
+struct ADBSource{
+    ADBEntry entry;
+    std::string name;
+    std::string bone_names;//each terminated by '\0'
+    const mat4* bp;        //nullptr if the data is already in the file
+    const mat4* bp_it;
+};
+
+//stamp of the fbx file of a resource key
+static bool stat_source(const std::string& name,int64_t& time,uint64_t& size){
+    return GetFileStamp(name.substr(0,name.rfind('#')),time,size);
+}
+
+static uint64_t get_data_size(const ADBEntry& entry){
+    return 2*entry.frame_count*entry.bone_count*sizeof(mat4);
+}
+
+//header and table of contents of a mapped database,false if the file is broken
+static bool read_toc(const MappedFile& file,const ADBHeader*& header,const ADBEntry*& entries,const char*& strings){
+    const char* data = file.GetData();
+    size_t size = file.GetSize();
+    if (size < sizeof(ADBHeader)){
+        return false;
+    }
+    header = (const ADBHeader*)data;
+    uint64_t toc_size = (uint64_t)header->clip_count*sizeof(ADBEntry);
+    if (std::memcmp(header->magic,ADB_MAGIC,4) != 0
+        || header->toc_offset%sizeof(uint64_t) != 0
+        || header->toc_offset > size
+        || toc_size+header->string_size > size-header->toc_offset)
+    {
+        return false;
+    }
+    entries = (const ADBEntry*)(data+header->toc_offset);
+    strings = data+header->toc_offset+toc_size;
+    for (size_t i = 0;i < header->clip_count;i++){
+        const ADBEntry& entry = entries[i];
+        if (entry.name_offset+entry.name_size > header->string_size
+            || entry.bone_names_offset+entry.bone_names_size > header->string_size
+            || entry.data_offset%ADB_ALIGNMENT != 0
+            || entry.data_offset+get_data_size(entry) > header->toc_offset
+            || entry.frame_count < 2)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//table of contents and string table of sources
+static void pack_toc(const std::vector<ADBSource>& sources,std::vector<ADBEntry>& entries,std::string& strings){
+    for (size_t i = 0;i < sources.size();i++){
+        ADBEntry entry = sources[i].entry;
+        entry.name_offset = strings.size();
+        entry.name_size = sources[i].name.size();
+        strings += sources[i].name;
+        entry.bone_names_offset = strings.size();
+        entry.bone_names_size = sources[i].bone_names.size();
+        strings += sources[i].bone_names;
+        entries.push_back(entry);
+    }
+}
+
+//clip data of sources not in the file yet,at the offsets of their entries
+static bool write_clip_data(std::FILE* fp,const std::vector<ADBSource>& sources){
+    bool is_written = true;
+    for (size_t i = 0;i < sources.size() && is_written;i++){
+        if (sources[i].bp == nullptr){
+            continue;
+        }
+        //padding up to the page boundary
+        is_written = std::fseek(fp,(long)sources[i].entry.data_offset,SEEK_SET) == 0;
+        size_t count = sources[i].entry.frame_count*sources[i].entry.bone_count;
+        is_written = is_written && std::fwrite(sources[i].bp,sizeof(mat4),count,fp) == count;
+        is_written = is_written && std::fwrite(sources[i].bp_it,sizeof(mat4),count,fp) == count;
+    }
+    return is_written;
+}
+
+//table of contents and string table at header.toc_offset
+static bool write_toc(std::FILE* fp,const ADBHeader& header,const std::vector<ADBEntry>& entries,const std::string& strings){
+    bool is_written = std::fseek(fp,(long)header.toc_offset,SEEK_SET) == 0;
+    if (!entries.empty()){
+        is_written = is_written && std::fwrite(entries.data(),sizeof(ADBEntry),entries.size(),fp) == entries.size();
+    }
+    is_written = is_written && std::fwrite(strings.data(),1,strings.size(),fp) == strings.size();
+    return is_written;
+}
+
+
+AnimationDatabase::AnimationDatabase(const std::string& path):m_prefetch_count(0){
+    if (!m_file.Open(path)){
+        return;
+    }
+
+    //header and table of contents
+    const ADBHeader* header;
+    const ADBEntry* entries;
+    const char* strings;
+    if (!read_toc(m_file,header,entries,strings)){
+        std::cout << "animation database is broken:" << path << "\n";
+        m_file.Close();
+        return;
+    }
+    const char* data = m_file.GetData();
+    std::vector<Clip> clips(header->clip_count);
+    for (size_t i = 0;i < clips.size();i++){
+        const ADBEntry& entry = entries[i];
+        Clip& clip = clips[i];
+        clip.name.assign(strings+entry.name_offset,entry.name_size);
+        clip.duration = entry.duration;
+        clip.frame_count = entry.frame_count;
+        clip.bone_count = entry.bone_count;
+        const char* name = strings+entry.bone_names_offset;
+        const char* names_end = name+entry.bone_names_size;
+        while (name < names_end && clip.bone_names.size() < clip.bone_count){
+            clip.bone_names.push_back(std::string(name));
+            name += clip.bone_names.back().size()+1;
+        }
+        clip.bone_names.resize(clip.bone_count);
+        clip.bp = (const mat4*)(data+entry.data_offset);
+        clip.bp_it = clip.bp+clip.frame_count*clip.bone_count;
+
+        //stale if the source file has changed
+        int64_t source_time;
+        uint64_t source_size;
+        clip.is_stale = !stat_source(clip.name,source_time,source_size)
+                     || source_time != entry.source_time
+                     || source_size != entry.source_size;
+    }
+    m_clips.swap(clips);
+    for (size_t i = 0;i < m_clips.size();i++){
+        m_clip_indices[m_clips[i].name] = i;
+    }
+}
+
+AnimationDatabase::~AnimationDatabase(){
+}
+
+size_t AnimationDatabase::GetClipCount() const{
+    return m_clips.size();
+}
+
+const AnimationDatabase::Clip* AnimationDatabase::FindClip(const std::string& name) const{
+    auto i = m_clip_indices.find(name);
+    if (i == m_clip_indices.end() || m_clips[i->second].is_stale){
+        return nullptr;
+    }
+    return &m_clips[i->second];
+}
+
+void AnimationDatabase::Prefetch(const AnimationDatabase::Clip& clip){
+    //madvise needs a page aligned address,clip data is aligned in the file and the mapping starts at a page
+    size_t size = 2*clip.frame_count*clip.bone_count*sizeof(mat4);
+    madvise((void*)clip.bp,size,MADV_WILLNEED);
+    m_prefetch_count++;
+}
+
+AnimationDatabase::Residency AnimationDatabase::GetResidency() const{
+    Residency residency;
+    residency.mapped_size = 0;
+    residency.resident_size = 0;
+    residency.resident_clip_count = 0;
+    residency.prefetch_count = m_prefetch_count;
+
+    //residency of every page of each clip
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    std::vector<mincore_vec_t> pages;
+    for (size_t i = 0;i < m_clips.size();i++){
+        const Clip& clip = m_clips[i];
+        size_t size = 2*clip.frame_count*clip.bone_count*sizeof(mat4);
+        size_t page_count = (size+page_size-1)/page_size;
+        pages.assign(page_count,0);
+        if (page_count == 0 || mincore((void*)clip.bp,size,pages.data()) != 0){
+            continue;
+        }
+        size_t resident_page_count = 0;
+        for (size_t j = 0;j < page_count;j++){
+            resident_page_count += (pages[j]&1);
+        }
+        residency.mapped_size += size;
+        residency.resident_size += std::min(size,resident_page_count*page_size);
+        residency.resident_clip_count += (resident_page_count == page_count) ? 1 : 0;
+    }
+    return residency;
+}
+
+bool AnimationDatabase::Write(const std::string& path,const std::map<std::string,Animation*>& animations){
+    //clips of the current file whose source has not changed
+    //mapped here rather than taken from an open database,an earlier Write may have appended to the file
+    MappedFile file;
+    const ADBHeader* old_header = nullptr;
+    const ADBEntry* old_entries = nullptr;
+    const char* old_strings = nullptr;
+    bool is_appendable = file.Open(path) && read_toc(file,old_header,old_entries,old_strings);
+    std::vector<ADBSource> sources;
+    std::set<std::string> names;
+    for (size_t i = 0;is_appendable && i < old_header->clip_count;i++){
+        const ADBEntry& entry = old_entries[i];
+        ADBSource source;
+        source.entry = entry;
+        source.name.assign(old_strings+entry.name_offset,entry.name_size);
+        int64_t source_time;
+        uint64_t source_size;
+        if (!stat_source(source.name,source_time,source_size)
+            || source_time != entry.source_time
+            || source_size != entry.source_size)
+        {
+            continue;
+        }
+        source.bone_names.assign(old_strings+entry.bone_names_offset,entry.bone_names_size);
+        source.bp = nullptr;
+        source.bp_it = nullptr;
+        sources.push_back(source);
+        names.insert(source.name);
+    }
+    size_t dropped_clip_count = is_appendable ? old_header->clip_count-sources.size() : 0;
+
+    //imported clips not in the file yet
+    size_t new_clip_count = 0;
+    for (auto i = animations.begin();i != animations.end();++i){
+        const Animation* animation = i->second;
+        ADBSource source;
+        if (animation->IsMapped() || names.count(i->first) != 0 || !stat_source(i->first,source.entry.source_time,source.entry.source_size)){
+            continue;
+        }
+        source.name = i->first;
+        const std::vector<std::string>& bone_names = animation->GetBoneNames();
+        for (size_t j = 0;j < bone_names.size();j++){
+            source.bone_names += bone_names[j];
+            source.bone_names.push_back('\0');
+        }
+        source.entry.bone_count = animation->GetBoneCount();
+        source.entry.frame_count = animation->GetFrameCount();
+        source.entry.duration = animation->GetDuration();
+        source.bp = animation->GetBP();
+        source.bp_it = animation->GetBPIT();
+        sources.push_back(source);
+        new_clip_count++;
+    }
+    if (is_appendable && new_clip_count == 0 && dropped_clip_count == 0){
+        return true;
+    }
+
+    //appended clip data starts after the current table of contents,which stays valid until the header is switched
+    uint64_t live_size = ADB_ALIGNMENT;
+    uint64_t end = is_appendable ? file.GetSize() : sizeof(ADBHeader);
+    for (size_t i = 0;i < sources.size();i++){
+        live_size += AlignUp(get_data_size(sources[i].entry),ADB_ALIGNMENT);
+        if (sources[i].bp != nullptr){
+            sources[i].entry.data_offset = AlignUp(end,ADB_ALIGNMENT);
+            end = sources[i].entry.data_offset+get_data_size(sources[i].entry);
+        }
+    }
+
+    //too much dead clip data,rewrite with the kept clips copied from the mapping
+    if (is_appendable && end > 2*live_size){
+        is_appendable = false;
+        end = sizeof(ADBHeader);
+        for (size_t i = 0;i < sources.size();i++){
+            if (sources[i].bp == nullptr){
+                size_t count = sources[i].entry.frame_count*sources[i].entry.bone_count;
+                sources[i].bp = (const mat4*)(file.GetData()+sources[i].entry.data_offset);
+                sources[i].bp_it = sources[i].bp+count;
+            }
+            sources[i].entry.data_offset = AlignUp(end,ADB_ALIGNMENT);
+            end = sources[i].entry.data_offset+get_data_size(sources[i].entry);
+        }
+    }
+
+    std::vector<ADBEntry> entries;
+    std::string strings;
+    pack_toc(sources,entries,strings);
+    ADBHeader header;
+    std::memcpy(header.magic,ADB_MAGIC,4);
+    header.clip_count = (uint32_t)entries.size();
+    header.toc_offset = AlignUp(end,sizeof(uint64_t));
+    header.string_size = strings.size();
+
+    bool is_written = false;
+    if (is_appendable){
+        //the header is written after everything it points to has reached the disk,
+        //so a failed append leaves the previous table of contents in effect
+        std::FILE* fp = std::fopen(path.c_str(),"r+b");
+        if (fp != NULL){
+            is_written = write_clip_data(fp,sources) && write_toc(fp,header,entries,strings);
+            is_written = is_written && std::fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+            is_written = is_written && std::fseek(fp,0,SEEK_SET) == 0 && std::fwrite(&header,sizeof(header),1,fp) == 1;
+            is_written = (std::fclose(fp) == 0) && is_written;
+        }
+    }else{
+        is_written = WriteFileAtomically(path,[&](std::FILE* fp){
+            return std::fwrite(&header,sizeof(header),1,fp) == 1
+                && write_clip_data(fp,sources)
+                && write_toc(fp,header,entries,strings);
+        });
+    }
+    if (!is_written){
+        std::cout << "failed to write animation database:" << path << "\n";
+    }
+    return is_written;
+}
@@ -0,0 +1,65 @@
+#ifndef ANIMATION_DATABASE_HPP
+#define ANIMATION_DATABASE_HPP
+
+#include "library.hpp"
+#include "define.hpp"
+#include "matrix.hpp"
+#include "mapped_file.hpp"
+
+#include <atomic>
+
+class Animation;
+
+
+//packed clip database
+//header,the baked poses of every clip,then the table of contents and a string table at the end of the file
+//the file is mapped read only,so clip data is paged in by the os when Sample touches it
+//and can be dropped again under memory pressure without writing anything back
+//clip data starts at a page boundary,bp of every frame followed by bp_it of every frame
+//a clip is stale when the size or the modification time of its source fbx file has changed
+
+class AnimationDatabase{
+public:
+    struct Clip{
+        std::string name;//resource key,"file" or "file#take"
+        double duration;
+        size_t frame_count;
+        size_t bone_count;
+        std::vector<std::string> bone_names;
+        const mat4* bp;   //size = frame_count*bone_count,mapped
+        const mat4* bp_it;//size = frame_count*bone_count,mapped
+        bool is_stale;
+    };
+    struct Residency{
+        size_t mapped_size;       //bytes of clip data
+        size_t resident_size;     //bytes of clip data in memory
+        size_t resident_clip_count;//clips whose every page is in memory
+        size_t prefetch_count;    //Prefetch calls
+    };
+private:
+    MappedFile m_file;
+    std::vector<Clip> m_clips;
+    std::map<std::string,size_t> m_clip_indices;
+    std::atomic<size_t> m_prefetch_count;
+public:
+    //an absent or broken file gives an empty database
+    AnimationDatabase(const std::string& path);
+    ~AnimationDatabase();
+
+    size_t GetClipCount() const;
+    //nullptr if name is not in the database or the clip is stale
+    const AnimationDatabase::Clip* FindClip(const std::string& name) const;
+
+    //asks the os to read the clip ahead of its first sample
+    void Prefetch(const AnimationDatabase::Clip& clip);
+    AnimationDatabase::Residency GetResidency() const;
+
+    //adds the imported animations to the database at path under their resource keys
+    //clips of the file that are neither replaced nor stale are kept,including those no scene has loaded
+    //new clips and a new table of contents are appended and the header is switched to them last,
+    //clip data already in the file is never moved,so a mapped database stays valid
+    //the file is rewritten from scratch when it is absent,broken or mostly dead clips
+    static bool Write(const std::string& path,const std::map<std::string,Animation*>& animations);
+};
+
+#endif // ANIMATION_DATABASE_HPP
@@ -40,12 +40,17 @@ const vec3& Camera::GetPosition() const{
     return m_position;
 }
 
-mat4 Camera::GetViewMatrix() const{
-    //camera position in world coordinate
+vec3 Camera::GetWorldPosition() const{
     vec3 p;
     p[0] = m_position[0]*std::sin(m_position[1]);
     p[1] = m_position[2];
     p[2] = m_position[0]*std::cos(m_position[1]);
+    return p;
+}
+
+mat4 Camera::GetViewMatrix() const{
+    //camera position in world coordinate
+    vec3 p = GetWorldPosition();
 
     //orthonormal basis of camera
     vec3 ax,ay,az;
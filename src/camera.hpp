@@ -26,6 +26,7 @@ public:
     void MoveHeight(FLOAT delta);
     void MoveTargetY(FLOAT delta);
     const vec3& GetPosition() const;
+    vec3 GetWorldPosition() const;//orthogonal coordinate
     mat4 GetViewMatrix() const;
     mat4 GetPerspectiveMatrix() const;
 };
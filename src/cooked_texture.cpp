@@ -0,0 +1,235 @@
+#include "cooked_texture.hpp"
+
+#include <cstring>
+#include <sys/mman.h>
+
+
+//level data alignment
+static const uint64_t CTX_ALIGNMENT = 16;
+
+//file layout
+static const char CTX_MAGIC[4] = {'C','T','X','1'};
+struct CTXHeader{
+    char magic[4];
+    uint32_t level_count;//level table follows the header
+    int64_t source_time; //modification time of the source image
+    uint64_t source_size;
+    double cook_time;    //sec
+};
+struct CTXLevel{
+    uint32_t width;
+    uint32_t height;
+    uint64_t data_offset;//from the beginning of the file
+    uint64_t data_size;
+};
+
+//mip filter,halves an axis
+static const float MIP_KERNEL[4] = {1.0f/8.0f,3.0f/8.0f,3.0f/8.0f,1.0f/8.0f};
+
+static float srgb_to_linear(float c){
+    return (c <= 0.04045f) ? c/12.92f : std::pow((c+0.055f)/1.055f,2.4f);
+}
+
+static unsigned char linear_to_srgb(float c){
+    c = std::min(std::max(c,0.0f),1.0f);
+    float s = (c <= 0.0031308f) ? c*12.92f : 1.055f*std::pow(c,1.0f/2.4f)-0.055f;
+    return (unsigned char)(s*255.0f+0.5f);
+}
+
+//rgba float images,width x height to max(1,width/2) x height
+static void reduce_x(const std::vector<float>& src,int width,int height,std::vector<float>& dst){
+    int dst_width = std::max(1,width/2);
+    dst.assign(4*(size_t)dst_width*height,0.0f);
+    for (int y = 0;y < height;y++){
+        for (int x = 0;x < dst_width;x++){
+            float* d = &dst[4*((size_t)y*dst_width+x)];
+            for (int k = 0;k < 4;k++){
+                int sx = std::min(std::max(2*x-1+k,0),width-1);
+                const float* s = &src[4*((size_t)y*width+sx)];
+                for (int c = 0;c < 4;c++){
+                    d[c] += MIP_KERNEL[k]*s[c];
+                }
+            }
+        }
+    }
+}
+
+//rgba float images,width x height to width x max(1,height/2)
+static void reduce_y(const std::vector<float>& src,int width,int height,std::vector<float>& dst){
+    int dst_height = std::max(1,height/2);
+    dst.assign(4*(size_t)width*dst_height,0.0f);
+    for (int y = 0;y < dst_height;y++){
+        for (int k = 0;k < 4;k++){
+            int sy = std::min(std::max(2*y-1+k,0),height-1);
+            const float* s = &src[4*(size_t)sy*width];
+            float* d = &dst[4*(size_t)y*width];
+            for (int i = 0;i < 4*width;i++){
+                d[i] += MIP_KERNEL[k]*s[i];
+            }
+        }
+    }
+}
+
+
+CookedTexture::CookedTexture():m_cook_time(0){
+}
+
+CookedTexture::~CookedTexture(){
+}
+
+std::string CookedTexture::GetCookedPath(const std::string& source_path){
+    return source_path+".ctx";
+}
+
+bool CookedTexture::Load(const std::string& cooked_path,const std::string& source_path){
+    int64_t source_time;
+    uint64_t source_size;
+    if (!GetFileStamp(source_path,source_time,source_size)){
+        return false;
+    }
+    if (!m_file.Open(cooked_path)){
+        return false;
+    }
+
+    //header and level table
+    const char* data = m_file.GetData();
+    size_t size = m_file.GetSize();
+    const CTXHeader* header = (const CTXHeader*)data;
+    const CTXLevel* levels = (const CTXLevel*)(data+sizeof(CTXHeader));
+    bool is_valid = size >= sizeof(CTXHeader)
+                 && std::memcmp(header->magic,CTX_MAGIC,4) == 0
+                 && header->level_count != 0
+                 && sizeof(CTXHeader)+(uint64_t)header->level_count*sizeof(CTXLevel) <= size;
+    for (uint32_t i = 0;is_valid && i < header->level_count;i++){
+        is_valid = levels[i].data_size == 4*(uint64_t)levels[i].width*levels[i].height
+                && levels[i].data_offset+levels[i].data_size <= size;
+    }
+    if (!is_valid){
+        std::cout << "cooked texture is broken:" << cooked_path << "\n";
+        m_file.Close();
+        return false;
+    }
+
+    //stale if the source image has changed
+    if (header->source_time != source_time || header->source_size != source_size){
+        m_file.Close();
+        return false;
+    }
+
+    //every level is read by the upload soon
+    madvise((void*)data,size,MADV_WILLNEED);
+
+    m_levels.resize(header->level_count);
+    for (size_t i = 0;i < m_levels.size();i++){
+        m_levels[i].width = (int)levels[i].width;
+        m_levels[i].height = (int)levels[i].height;
+        m_levels[i].rgba = (const unsigned char*)(data+levels[i].data_offset);
+    }
+    m_cook_time = header->cook_time;
+    return true;
+}
+
+void CookedTexture::Cook(int width,int height,const unsigned char* rgba){
+    //level sizes down to 1x1
+    std::vector<int> widths(1,width);
+    std::vector<int> heights(1,height);
+    size_t size = 4*(size_t)width*height;
+    while (widths.back() > 1 || heights.back() > 1){
+        widths.push_back(std::max(1,widths.back()/2));
+        heights.push_back(std::max(1,heights.back()/2));
+        size += 4*(size_t)widths.back()*heights.back();
+    }
+    m_data.resize(size);
+    m_levels.resize(widths.size());
+
+    //level 0 as is,and in linear light premultiplied by alpha
+    //so that transparent texels do not darken their neighbours
+    float to_linear[256];
+    for (int i = 0;i < 256;i++){
+        to_linear[i] = srgb_to_linear(i/255.0f);
+    }
+    size_t texel_count = (size_t)width*height;
+    std::copy(rgba,rgba+4*texel_count,m_data.begin());
+    std::vector<float> linear(4*texel_count);
+    std::vector<float> reduced;
+    for (size_t i = 0;i < texel_count;i++){
+        float a = rgba[4*i+3]/255.0f;
+        for (int c = 0;c < 3;c++){
+            linear[4*i+c] = to_linear[rgba[4*i+c]]*a;
+        }
+        linear[4*i+3] = a;
+    }
+
+    //each level from the float image of the previous one,so rounding does not add up
+    size_t offset = 0;
+    for (size_t i = 0;i < m_levels.size();i++){
+        if (i != 0){
+            reduce_x(linear,widths[i-1],heights[i-1],reduced);
+            reduce_y(reduced,widths[i],heights[i-1],linear);
+            unsigned char* level = m_data.data()+offset;
+            texel_count = (size_t)widths[i]*heights[i];
+            for (size_t j = 0;j < texel_count;j++){
+                float a = linear[4*j+3];
+                for (int c = 0;c < 3;c++){
+                    level[4*j+c] = (a > 0) ? linear_to_srgb(linear[4*j+c]/a) : 0;
+                }
+                level[4*j+3] = (unsigned char)(std::min(std::max(a,0.0f),1.0f)*255.0f+0.5f);
+            }
+        }
+        m_levels[i].width = widths[i];
+        m_levels[i].height = heights[i];
+        m_levels[i].rgba = m_data.data()+offset;
+        offset += 4*(size_t)widths[i]*heights[i];
+    }
+}
+
+bool CookedTexture::Save(const std::string& cooked_path,const std::string& source_path,double cook_time) const{
+    CTXHeader header;
+    std::memcpy(header.magic,CTX_MAGIC,4);
+    header.level_count = (uint32_t)m_levels.size();
+    header.cook_time = cook_time;
+    if (!GetFileStamp(source_path,header.source_time,header.source_size)){
+        return false;
+    }
+
+    //level table
+    std::vector<CTXLevel> levels(m_levels.size());
+    uint64_t offset = sizeof(CTXHeader)+levels.size()*sizeof(CTXLevel);
+    for (size_t i = 0;i < levels.size();i++){
+        levels[i].width = (uint32_t)m_levels[i].width;
+        levels[i].height = (uint32_t)m_levels[i].height;
+        levels[i].data_offset = AlignUp(offset,CTX_ALIGNMENT);
+        levels[i].data_size = 4*(uint64_t)m_levels[i].width*m_levels[i].height;
+        offset = levels[i].data_offset+levels[i].data_size;
+    }
+
+    bool is_written = WriteFileAtomically(cooked_path,[&](std::FILE* fp){
+        bool is_written = std::fwrite(&header,sizeof(header),1,fp) == 1;
+        is_written = is_written && std::fwrite(levels.data(),sizeof(CTXLevel),levels.size(),fp) == levels.size();
+        for (size_t i = 0;i < levels.size() && is_written;i++){
+            is_written = std::fseek(fp,(long)levels[i].data_offset,SEEK_SET) == 0;
+            is_written = is_written && std::fwrite(m_levels[i].rgba,1,levels[i].data_size,fp) == levels[i].data_size;
+        }
+        return is_written;
+    });
+    if (!is_written){
+        std::cout << "failed to write cooked texture:" << cooked_path << "\n";
+    }
+    return is_written;
+}
+
+const std::vector<CookedTexture::Level>& CookedTexture::GetLevels() const{
+    return m_levels;
+}
+
+double CookedTexture::GetCookTime() const{
+    return m_cook_time;
+}
+
+size_t CookedTexture::GetByteSize() const{
+    size_t size = 0;
+    for (size_t i = 0;i < m_levels.size();i++){
+        size += 4*(size_t)m_levels[i].width*m_levels[i].height;
+    }
+    return size;
+}
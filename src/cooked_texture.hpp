@@ -0,0 +1,53 @@
+#ifndef COOKED_TEXTURE_HPP
+#define COOKED_TEXTURE_HPP
+
+#include "library.hpp"
+#include "mapped_file.hpp"
+
+
+//rgba8 image with its full mip chain,ready to upload level by level
+//the cooked file next to the source image is a small ktx like container,
+//header,level table and the levels from the largest to 1x1,each level starts at a 16 byte boundary
+//a cooked file is used only while the size and the modification time of the source image match
+//levels are reduced in linear light with a separable 1 3 3 1 kernel,so thin bright details fade
+//instead of aliasing and the average brightness is kept through the chain
+
+class CookedTexture{
+public:
+    struct Level{
+        int width;
+        int height;
+        const unsigned char* rgba;//size = 4*width*height
+    };
+private:
+    std::vector<Level> m_levels;
+    double m_cook_time;//sec,decode and mip generation when the texture was cooked
+
+    //cooked in memory
+    std::vector<unsigned char> m_data;
+
+    //loaded from a cooked file
+    MappedFile m_file;
+public:
+    CookedTexture();
+    ~CookedTexture();
+
+    //"image.png" to "image.png.ctx"
+    static std::string GetCookedPath(const std::string& source_path);
+
+    //maps the cooked file if it is valid for source_path
+    bool Load(const std::string& cooked_path,const std::string& source_path);
+    //builds the mip chain from level 0
+    void Cook(int width,int height,const unsigned char* rgba);
+    bool Save(const std::string& cooked_path,const std::string& source_path,double cook_time) const;
+
+    const std::vector<CookedTexture::Level>& GetLevels() const;
+    double GetCookTime() const;
+    //bytes of every level
+    size_t GetByteSize() const;
+private:
+    CookedTexture(const CookedTexture&);
+    CookedTexture& operator=(const CookedTexture&);
+};
+
+#endif // COOKED_TEXTURE_HPP
@@ -0,0 +1,168 @@
+#include "crowd.hpp"
+#include "resource.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+
+const size_t Crowd::UPDATE_TIER_COUNT;
+const size_t Crowd::UPDATE_INTERVALS[Crowd::UPDATE_TIER_COUNT] = {1,2,4};
+
+//update tier of each mesh lod,lods beyond the table use the last tier
+static const size_t LOD_UPDATE_TIERS[] = {0,0,1,2};
+static const size_t LOD_UPDATE_TIER_COUNT = sizeof(LOD_UPDATE_TIERS)/sizeof(LOD_UPDATE_TIERS[0]);
+
+
+Crowd::Crowd(const Mesh* mesh,
+             const AnimationStateGraph* graph,
+             size_t count,
+             FLOAT spacing,
+             size_t phase_count,
+             PoseCache* pose_cache,
+             double sample_rate)
+    :m_update_time(0)
+{
+    //grid behind the origin,the scene mesh stands at the origin
+    size_t column_count = (size_t)std::ceil(std::sqrt((double)count));
+    if (phase_count == 0){
+        phase_count = 1;
+    }
+    double entry_duration = graph->GetState(graph->GetEntryState()).duration;
+    
+    m_instances.resize(count);
+    for (size_t i = 0;i < count;i++){
+        Instance& instance = m_instances[i];
+        
+        //skeleton and controller
+        instance.skeleton = Skeleton::CreateInstance(*mesh->GetSkeleton());
+        instance.controller = new AnimationController(instance.skeleton,graph);
+        if (pose_cache != nullptr){
+            instance.controller->SetPoseCache(pose_cache,sample_rate);
+        }
+        instance.time_offset = entry_duration*(i%phase_count)/phase_count;
+        instance.controller->SetTime(instance.time_offset);
+        instance.is_far = false;
+        instance.update_tier = 0;
+        instance.update_phase = i;
+        instance.pending_dt = 0;
+        
+        //placement
+        size_t row = i/column_count;
+        size_t column = i%column_count;
+        FLOAT x = ((FLOAT)column-0.5*(column_count-1))*spacing;
+        FLOAT z = -(FLOAT)(row+1)*spacing;
+        instance.placement.SetRow(0,vec4({1,0,0,x}));
+        instance.placement.SetRow(1,vec4({0,1,0,0}));
+        instance.placement.SetRow(2,vec4({0,0,1,z}));
+        instance.placement.SetRow(3,vec4({0,0,0,1}));
+    }
+    
+    m_frame = 0;
+    m_statistics.frame_count = 0;
+    for (size_t i = 0;i < UPDATE_TIER_COUNT;i++){
+        m_statistics.tier_instance_counts[i] = 0;
+    }
+    m_statistics.update_count = 0;
+    m_statistics.skip_count = 0;
+    m_statistics.update_time = 0;
+    m_statistics.saved_time = 0;
+}
+
+Crowd::~Crowd(){
+    for (size_t i = 0;i < m_instances.size();i++){
+        delete m_instances[i].controller;
+        delete m_instances[i].skeleton;
+    }
+}
+
+size_t Crowd::GetInstanceCount() const{
+    return m_instances.size();
+}
+
+const Crowd::Instance& Crowd::GetInstance(size_t index) const{
+    return m_instances[index];
+}
+
+void Crowd::DoUserTransition(int keycode){
+    for (size_t i = 0;i < m_instances.size();i++){
+        m_instances[i].controller->DoUserTransition(keycode);
+    }
+}
+
+void Crowd::UpdateLOD(const vec3& eye,FLOAT far_distance){
+    for (size_t i = 0;i < m_instances.size();i++){
+        Instance& instance = m_instances[i];
+        vec4 t = instance.placement.GetColumn(3);
+        vec3 p({t[0],t[1],t[2]});
+        instance.is_far = (length(p-eye) > far_distance);
+    }
+}
+
+void Crowd::SetLOD(size_t index,size_t lod){
+    Instance& instance = m_instances[index];
+    instance.skeleton->SetLOD(lod);
+    instance.update_tier = LOD_UPDATE_TIERS[std::min(lod,LOD_UPDATE_TIER_COUNT-1)];
+}
+
+void Crowd::Update(double dt){
+    TRACE_ZONE("Crowd::Update");
+    
+    //instances due this frame,the phase spreads each tier evenly over its interval
+    std::vector<size_t> due_instances;
+    size_t skip_count = 0;
+    for (size_t i = 0;i < m_instances.size();i++){
+        Instance& instance = m_instances[i];
+        if (instance.is_far){
+            continue;
+        }
+        instance.pending_dt += dt;
+        m_statistics.tier_instance_counts[instance.update_tier]++;
+        if ((m_frame+instance.update_phase)%UPDATE_INTERVALS[instance.update_tier] == 0){
+            due_instances.push_back(i);
+        }else{
+            skip_count++;
+        }
+    }
+    m_frame++;
+    
+    //sample and blend with the time since the last update
+    std::vector<Instance>& instances = m_instances;
+    std::atomic<long long>& update_time = m_update_time;
+    auto update = [&instances,&due_instances,&update_time](size_t beg,size_t end){
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = beg;i < end;i++){
+            Instance& instance = instances[due_instances[i]];
+            instance.controller->Advance(instance.pending_dt);
+            instance.controller->Evaluate();
+            instance.pending_dt = 0;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        update_time += std::chrono::duration_cast<std::chrono::nanoseconds>(t1-t0).count();
+    };
+    ThreadPool* pool = ThreadPool::GetInstance();
+    if (pool != nullptr){
+        pool->ParallelFor(due_instances.size(),16,update);
+    }else{
+        update(0,due_instances.size());
+    }
+    
+    //upload,held instances keep the pose uploaded by their last update
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0;i < due_instances.size();i++){
+        m_instances[due_instances[i]].controller->ApplyPose();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    m_update_time += std::chrono::duration_cast<std::chrono::nanoseconds>(t1-t0).count();
+    
+    m_statistics.frame_count++;
+    m_statistics.update_count += due_instances.size();
+    m_statistics.skip_count += skip_count;
+}
+
+Crowd::Statistics Crowd::GetStatistics() const{
+    Statistics statistics = m_statistics;
+    statistics.update_time = m_update_time*1e-9;
+    if (statistics.update_count != 0){
+        statistics.saved_time = statistics.update_time/statistics.update_count*statistics.skip_count;
+    }
+    return statistics;
+}
@@ -0,0 +1,78 @@
+#ifndef CROWD_HPP
+#define CROWD_HPP
+
+#include "library.hpp"
+#include "define.hpp"
+#include "matrix.hpp"
+
+#include <atomic>
+
+class Mesh;
+class Skeleton;
+class AnimationStateGraph;
+class AnimationController;
+class PoseCache;
+
+
+//copies of the scene mesh placed on a grid,each with its own bone pose
+//all instances share the mesh,the bind pose and the compiled state graph
+class Crowd{
+public:
+    //update rate tiers,an instance of tier i updates every UPDATE_INTERVALS[i] frames and holds its pose between
+    static const size_t UPDATE_TIER_COUNT = 3;
+    static const size_t UPDATE_INTERVALS[UPDATE_TIER_COUNT];
+    struct Instance{
+        Skeleton* skeleton;
+        AnimationController* controller;
+        mat4 placement;//translation on the grid
+        double time_offset;//start time of the entry animation
+        bool is_far;//rendered from the vertex animation texture,the controller is not updated
+        size_t update_tier;
+        size_t update_phase;//staggers instances of a tier over the frames of its interval
+        double pending_dt;  //time accumulated over skipped frames
+    };
+    struct Statistics{
+        size_t frame_count;
+        size_t tier_instance_counts[UPDATE_TIER_COUNT];//summed over frames,far instances excluded
+        size_t update_count; //controller updates
+        size_t skip_count;   //held poses
+        double update_time;  //cpu seconds of updates summed over threads
+        double saved_time;   //estimated cpu seconds saved by held poses
+    };
+private:
+    std::vector<Instance> m_instances;
+    size_t m_frame;
+    
+    Statistics m_statistics;
+    std::atomic<long long> m_update_time;//nanoseconds
+public:
+    //phase_count instances groups start at evenly spaced times of the entry animation
+    //pose_cache may be nullptr
+    Crowd(const Mesh* mesh,
+          const AnimationStateGraph* graph,
+          size_t count,
+          FLOAT spacing,
+          size_t phase_count,
+          PoseCache* pose_cache,
+          double sample_rate);
+    ~Crowd();
+    
+    size_t GetInstanceCount() const;
+    const Crowd::Instance& GetInstance(size_t index) const;
+    
+    void DoUserTransition(int keycode);
+    
+    //instances farther than far_distance from eye become far
+    void UpdateLOD(const vec3& eye,FLOAT far_distance);
+    
+    //mesh lod selected from the projected size,sets the bone lod and the update tier
+    void SetLOD(size_t index,size_t lod);
+    
+    //controllers are advanced on worker threads,skeletons are uploaded on the calling thread
+    //only instances whose tier is due this frame are updated
+    void Update(double dt);
+    
+    Crowd::Statistics GetStatistics() const;
+};
+
+#endif // CROWD_HPP
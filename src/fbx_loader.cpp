@@ -1,4 +1,7 @@
 #include "fbx_loader.hpp"
+#include "thread_pool.hpp"
+#include "fbx_session.hpp"
+#include "trace.hpp"
 
 
 static FbxMatrix create_axis_transform(FbxScene* fscene){
@@ -46,46 +49,160 @@ static FbxMatrix create_axis_transform(FbxScene* fscene){
     return axis_transform;
 }
 
-
-
-FBXMeshLoader::FBXMeshLoader(const std::string& path){
-    //initialize fbxsdk
-    FbxManager* fmanager = FbxManager::Create();
-    FbxScene* fscene = FbxScene::Create(fmanager,"");
-    FbxImporter* fimporter = FbxImporter::Create(fmanager,"");
-    if (!fimporter->Initialize(path.c_str())){
-        std::cout << "failed to read fbx file:" << path << "\n";
-        std::terminate();
+//triangulates one polygon into polygon vertex indices,appended to corners
+//first and size are the first polygon vertex and the vertex count of the polygon
+//convex polygons are fanned,concave ones are ear clipped in the plane of the newell normal
+//polygons with less than 3 vertices are dropped
+static void triangulate_polygon(const std::vector<FbxVector4>& xyz_array,const std::vector<int>& polygon_vertices,int first,int size,std::vector<int>& corners){
+    if (size < 3 || first < 0 || first+size > (int)polygon_vertices.size()){
+        return;
+    }
+    if (size == 3){
+        corners.push_back(first+0);
+        corners.push_back(first+1);
+        corners.push_back(first+2);
+        return;
     }
-    fimporter->Import(fscene);
     
-    //triangulate scene
-    FbxGeometryConverter geometryConverter(fmanager);
-    geometryConverter.Triangulate(fscene,true);
-    geometryConverter.RemoveBadPolygonsFromMeshes(fscene);
-    geometryConverter.SplitMeshesPerMaterial(fscene,true);
+    //positions
+    int xyz_count = (int)xyz_array.size();
+    std::vector<FbxVector4> p(size);
+    for (int i = 0;i < size;i++){
+        int idx = polygon_vertices[first+i];
+        p[i] = (idx >= 0 && idx < xyz_count) ? xyz_array[idx] : FbxVector4(0,0,0,0);
+    }
     
-    //traverse node tree
-    TraverseNodeTree(fscene->GetRootNode());
+    //newell normal
+    double n[3] = {0,0,0};
+    for (int i = 0;i < size;i++){
+        const FbxVector4& a = p[i];
+        const FbxVector4& b = p[(i+1)%size];
+        n[0] += (a[1]-b[1])*(a[2]+b[2]);
+        n[1] += (a[2]-b[2])*(a[0]+b[0]);
+        n[2] += (a[0]-b[0])*(a[1]+b[1]);
+    }
     
-    //create axis transform
-    m_axis_transform = create_axis_transform(fscene);
+    //2d coordinates in the polygon plane,counter clockwise around n
+    double u[3],v[3];
+    {
+        double a[3] = {0,0,0};
+        a[(std::abs(n[0]) < std::abs(n[1])) ? 0 : 1] = 1;
+        u[0] = a[1]*n[2]-a[2]*n[1];
+        u[1] = a[2]*n[0]-a[0]*n[2];
+        u[2] = a[0]*n[1]-a[1]*n[0];
+        v[0] = n[1]*u[2]-n[2]*u[1];
+        v[1] = n[2]*u[0]-n[0]*u[2];
+        v[2] = n[0]*u[1]-n[1]*u[0];
+    }
+    std::vector<double> x(size),y(size);
+    for (int i = 0;i < size;i++){
+        x[i] = p[i][0]*u[0]+p[i][1]*u[1]+p[i][2]*u[2];
+        y[i] = p[i][0]*v[0]+p[i][1]*v[1]+p[i][2]*v[2];
+    }
+    auto area = [&x,&y](int a,int b,int c){
+        return (x[b]-x[a])*(y[c]-y[a])-(y[b]-y[a])*(x[c]-x[a]);
+    };
     
-    //check fmesh count
-    if (m_fmeshes.size() == 0){
-        std::cout << "failed to load fbx file:" << path << "\n";
-        std::cout << "mesh data is not included" << "\n";
-        std::terminate();
+    //convex,fan from the first vertex
+    bool is_convex = true;
+    for (int i = 0;i < size && is_convex;i++){
+        is_convex = (area(i,(i+1)%size,(i+2)%size) >= 0);
+    }
+    if (is_convex){
+        for (int i = 1;i+1 < size;i++){
+            corners.push_back(first);
+            corners.push_back(first+i);
+            corners.push_back(first+i+1);
+        }
+        return;
     }
     
-    //load meshes
-    LoadMeshes();
+    //ear clipping
+    std::vector<int> remaining(size);
+    for (int i = 0;i < size;i++){
+        remaining[i] = i;
+    }
+    while (remaining.size() > 3){
+        int count = (int)remaining.size();
+        int ear = 0;
+        for (int i = 0;i < count;i++){
+            int a = remaining[(i+count-1)%count];
+            int b = remaining[i];
+            int c = remaining[(i+1)%count];
+            if (area(a,b,c) <= 0){
+                continue;//reflex
+            }
+            bool is_ear = true;
+            for (int j = 0;j < count && is_ear;j++){
+                int d = remaining[j];
+                if (d == a || d == b || d == c){
+                    continue;
+                }
+                is_ear = !(area(a,b,d) >= 0 && area(b,c,d) >= 0 && area(c,a,d) >= 0);
+            }
+            if (is_ear){
+                ear = i;
+                break;
+            }
+        }
+        //no ear is found for degenerate polygons,the first vertex is clipped
+        corners.push_back(first+remaining[(ear+count-1)%count]);
+        corners.push_back(first+remaining[ear]);
+        corners.push_back(first+remaining[(ear+1)%count]);
+        remaining.erase(remaining.begin()+ear);
+    }
+    corners.push_back(first+remaining[0]);
+    corners.push_back(first+remaining[1]);
+    corners.push_back(first+remaining[2]);
+}
+
+
+
+FBXMeshLoader::FBXMeshLoader(const std::string& path,bool is_split_per_material){
+    //import with the shared session
+    FBXImportSession* session = FBXImportSession::GetInstance();
+    FbxScene* fscene = session->Import(path,MESH_IMPORT);
+    
+    //everything read from the sdk is copied under the session mutex,the manager is shared with the other import workers
+    std::vector<MeshSource> sources;
+    {
+        std::lock_guard<std::mutex> lock(session->GetMutex());
+        
+        //split meshes per material,creates meshes in the shared manager
+        //polygons are triangulated while meshes are loaded,bad polygons are dropped there
+        if (is_split_per_material){
+            FbxGeometryConverter geometryConverter(session->GetManager());
+            geometryConverter.SplitMeshesPerMaterial(fscene,true);
+        }
+        
+        //traverse node tree
+        TraverseNodeTree(fscene->GetRootNode());
+        
+        //create axis transform
+        m_axis_transform = create_axis_transform(fscene);
+        
+        //check fmesh count
+        if (m_fmeshes.size() == 0){
+            std::cout << "failed to load fbx file:" << path << "\n";
+            std::cout << "mesh data is not included" << "\n";
+            std::terminate();
+        }
+        
+        //copy mesh data
+        sources.resize(m_fmeshes.size());
+        for (size_t k = 0;k < m_fmeshes.size();k++){
+            LoadMeshSource((int)k,sources[k]);
+        }
+        
+        //load skeleton
+        LoadSkeleton();
+    }
     
-    //load skeleton
-    LoadSkeleton();
+    //load meshes from the copies without the lock
+    LoadMeshes(sources);
     
-    //terminate fbxsdk
-    fmanager->Destroy();
+    //release scene
+    session->Destroy(fscene);
     
     //PrintData();
 }
@@ -188,8 +305,11 @@ void FBXMeshLoader::PrintData() const{
             }
         }
         
-        //texture
-        std::cout << "texture:" << m_meshes[i].texture << "\n";
+        //draw range
+        for (size_t j = 0;j < m_meshes[i].draw_ranges.size();j++){
+            const DrawRange& range = m_meshes[i].draw_ranges[j];
+            std::cout << "draw range " << j << ":[" << range.first_polygon << "," << range.polygon_count << "] texture:" << range.texture << "\n";
+        }
         
         std::cout << "\n";
     }
@@ -273,233 +393,297 @@ void FBXMeshLoader::TraverseNodeTree(FbxNode* fnode){
 }
 
 
-void FBXMeshLoader::LoadMeshes(){
-    for (int k = 0;k < m_fmeshes.size();k++){
-        //fmesh node
-        FbxNode* fmesh_node = m_fmesh_nodes[k];
-        
-        //fmesh
-        FbxMesh* fmesh = m_fmeshes[k];
-        
-        //fmesh node transform
-        const FbxAMatrix& fmesh_node_transform = fmesh_node->EvaluateGlobalTransform();
-        
-        //mesh
-        m_meshes.push_back(Mesh());
-        Mesh& mesh = m_meshes.back();
-        
-        //transform for xyz,normal
-        mat4 transform_xyz;
-        {
-            const FbxMatrix& tmp = FbxMatrix(fmesh_node_transform.Transpose())*m_axis_transform;
-            const FbxVector4& r0 = tmp.GetRow(0);
-            const FbxVector4& r1 = tmp.GetRow(1);
-            const FbxVector4& r2 = tmp.GetRow(2);
-            const FbxVector4& r3 = tmp.GetRow(3);
-            transform_xyz.SetRow(0,vec4({(FLOAT)r0[0],(FLOAT)r0[1],(FLOAT)r0[2],(FLOAT)r0[3]}));
-            transform_xyz.SetRow(1,vec4({(FLOAT)r1[0],(FLOAT)r1[1],(FLOAT)r1[2],(FLOAT)r1[3]}));
-            transform_xyz.SetRow(2,vec4({(FLOAT)r2[0],(FLOAT)r2[1],(FLOAT)r2[2],(FLOAT)r2[3]}));
-            transform_xyz.SetRow(3,vec4({(FLOAT)r3[0],(FLOAT)r3[1],(FLOAT)r3[2],(FLOAT)r3[3]}));
-        }
-        mat4 transform_normal;
-        {
-            const FbxMatrix& tmp = (FbxMatrix(fmesh_node_transform.Transpose())*m_axis_transform).Inverse().Transpose();
-            const FbxVector4& r0 = tmp.GetRow(0);
-            const FbxVector4& r1 = tmp.GetRow(1);
-            const FbxVector4& r2 = tmp.GetRow(2);
-            const FbxVector4& r3 = tmp.GetRow(3);
-            transform_normal.SetRow(0,vec4({(FLOAT)r0[0],(FLOAT)r0[1],(FLOAT)r0[2],(FLOAT)r0[3]}));
-            transform_normal.SetRow(1,vec4({(FLOAT)r1[0],(FLOAT)r1[1],(FLOAT)r1[2],(FLOAT)r1[3]}));
-            transform_normal.SetRow(2,vec4({(FLOAT)r2[0],(FLOAT)r2[1],(FLOAT)r2[2],(FLOAT)r2[3]}));
-            transform_normal.SetRow(3,vec4({(FLOAT)r3[0],(FLOAT)r3[1],(FLOAT)r3[2],(FLOAT)r3[3]}));
-        }
-        
-        //polygon vertex
-        int polygon_vertex_count = fmesh->GetPolygonVertexCount();
-        int* polygon_vertices = fmesh->GetPolygonVertices();
-        
-        //initialize xyz,uv,normal
-        mesh.xyz.resize(polygon_vertex_count);
-        mesh.uv.resize(polygon_vertex_count);
-        mesh.normal.resize(polygon_vertex_count);
+void FBXMeshLoader::LoadMeshSource(int k,MeshSource& source) const{
+    //fmesh
+    FbxMesh* fmesh = m_fmeshes[k];
+    FbxNode* fmesh_node = m_fmesh_nodes[k];
+    source.transform = fmesh_node->EvaluateGlobalTransform();
+    
+    //control points
+    int xyz_count = fmesh->GetControlPointsCount();
+    FbxVector4* xyz_array = fmesh->GetControlPoints();
+    source.xyz.assign(xyz_array,xyz_array+xyz_count);
+    
+    //polygons
+    int polygon_vertex_count = fmesh->GetPolygonVertexCount();
+    int* polygon_vertices = fmesh->GetPolygonVertices();
+    source.polygon_vertices.assign(polygon_vertices,polygon_vertices+polygon_vertex_count);
+    int polygon_count = fmesh->GetPolygonCount();
+    source.polygon_firsts.resize(polygon_count);
+    source.polygon_sizes.resize(polygon_count);
+    for (int i = 0;i < polygon_count;i++){
+        source.polygon_firsts[i] = fmesh->GetPolygonVertexIndex(i);
+        source.polygon_sizes[i] = fmesh->GetPolygonSize(i);
+    }
+    
+    //layer elements per polygon vertex,zero where the fbx has none
+    source.uv.assign(polygon_vertex_count,vec2());
+    source.normal.assign(polygon_vertex_count,vec4());
+    source.polygon_materials.assign(polygon_count,0);
+    FbxLayer* flayer = fmesh->GetLayer(0);
+    if (flayer == NULL){
+        return;
+    }
+    
+    //uv
+    FbxLayerElementUV* flayer_uv = flayer->GetUVs();
+    if (flayer_uv != NULL && flayer_uv->GetMappingMode() == FbxLayerElement::eByPolygonVertex){
+        FbxLayerElement::EReferenceMode uv_reference_mode = flayer_uv->GetReferenceMode();
+        const FbxLayerElementArrayTemplate<FbxVector2>& uv_direct_array = flayer_uv->GetDirectArray();
+        const FbxLayerElementArrayTemplate<int>& uv_index_array = flayer_uv->GetIndexArray();
         for (int i = 0;i < polygon_vertex_count;i++){
-            mesh.xyz[i] = vec3();
-            mesh.uv[i] = vec2();
-            mesh.normal[i] = vec3();
-        }
-        
-        //initialize bone_index,bone_weight
-        mesh.bone_index.resize(4*polygon_vertex_count);
-        mesh.bone_weight.resize(4*polygon_vertex_count);
-        for (int i = 0;i < 4*polygon_vertex_count;i++){
-            mesh.bone_index[i] = -1;
-            mesh.bone_weight[i] = 0;
+            if (uv_reference_mode == FbxLayerElement::eDirect && i < uv_direct_array.GetCount()){
+                source.uv[i][0] = uv_direct_array[i][0];
+                source.uv[i][1] = uv_direct_array[i][1];
+            }else if (uv_reference_mode == FbxLayerElement::eIndexToDirect && i < uv_index_array.GetCount()){
+                source.uv[i][0] = uv_direct_array[uv_index_array[i]][0];
+                source.uv[i][1] = uv_direct_array[uv_index_array[i]][1];
+            }
         }
-        
-        
-        //xyz
-        int xyz_count = fmesh->GetControlPointsCount();
-        FbxVector4* xyz_array = fmesh->GetControlPoints();
+    }
+    
+    //normal
+    FbxLayerElementNormal* flayer_normal = flayer->GetNormals();
+    if (flayer_normal != NULL && flayer_normal->GetMappingMode() == FbxLayerElement::eByPolygonVertex){
+        FbxLayerElement::EReferenceMode normal_reference_mode = flayer_normal->GetReferenceMode();
+        const FbxLayerElementArrayTemplate<FbxVector4>& normal_direct_array = flayer_normal->GetDirectArray();
+        const FbxLayerElementArrayTemplate<int>& normal_index_array = flayer_normal->GetIndexArray();
         for (int i = 0;i < polygon_vertex_count;i++){
-            int idx = polygon_vertices[i];
-            if (idx < xyz_count){
-                vec4 xyz;
-                xyz[0] = xyz_array[idx][0];
-                xyz[1] = xyz_array[idx][1];
-                xyz[2] = xyz_array[idx][2];
-                xyz[3] = 1;
-                mesh.xyz[i] = transform_xyz*xyz;
+            if (normal_reference_mode == FbxLayerElement::eDirect && i < normal_direct_array.GetCount()){
+                source.normal[i][0] = normal_direct_array[i][0];
+                source.normal[i][1] = normal_direct_array[i][1];
+                source.normal[i][2] = normal_direct_array[i][2];
+            }else if (normal_reference_mode == FbxLayerElement::eIndexToDirect && i < normal_index_array.GetCount()){
+                source.normal[i][0] = normal_direct_array[normal_index_array[i]][0];
+                source.normal[i][1] = normal_direct_array[normal_index_array[i]][1];
+                source.normal[i][2] = normal_direct_array[normal_index_array[i]][2];
             }
         }
-        
-        //flayer
-        FbxLayer* flayer = fmesh->GetLayer(0);
-        if (flayer != NULL){
-            //uv
-            FbxLayerElementUV* flayer_uv = flayer->GetUVs();
-            if (flayer_uv != NULL){
-                FbxLayerElement::EMappingMode uv_mapping_mode = flayer_uv->GetMappingMode();
-                FbxLayerElement::EReferenceMode uv_reference_mode = flayer_uv->GetReferenceMode();
-                const FbxLayerElementArrayTemplate<FbxVector2>& uv_direct_array = flayer_uv->GetDirectArray();
-                const FbxLayerElementArrayTemplate<int>& uv_index_array = flayer_uv->GetIndexArray();
-                
-                if (uv_mapping_mode == FbxLayerElement::eByPolygonVertex){
-                    if (uv_reference_mode == FbxLayerElement::eDirect){
-                        for (int i = 0;i < uv_direct_array.GetCount();i++){
-                            mesh.uv[i][0] = uv_direct_array[i][0];
-                            mesh.uv[i][1] = uv_direct_array[i][1];
-                        }
-                    }else if (uv_reference_mode == FbxLayerElement::eIndexToDirect){
-                        for (int i = 0;i < uv_index_array.GetCount();i++){
-                            mesh.uv[i][0] = uv_direct_array[uv_index_array[i]][0];
-                            mesh.uv[i][1] = uv_direct_array[uv_index_array[i]][1];
-                        }
-                    }else{
-                        //nothing
-                    }
-                }else{
-                    //nothing
-                    //uv_mapping_mode == FbxLayerElement::eByControlPoint
-                    //uv_mapping_mode == FbxLayerElement::eByPolygon
-                    //uv_mapping_mode == FbxLayerElement::eByEdge
-                    //uv_mapping_mode == FbxLayerElement::eAllSame
-                }
-            }
+    }
+    
+    //fskin,bone_index,bone_weight per vertex
+    FbxSkin* fskin = (FbxSkin*)fmesh->GetDeformer(0);
+    if (fskin != NULL){
+        source.bone_index.assign(4*xyz_count,-1);
+        source.bone_weight.assign(4*xyz_count,0);
+        int fcluster_count = fskin->GetClusterCount();
+        for (int i = 0;i < fcluster_count;i++){
+            //fcluster
+            FbxCluster* fcluster = fskin->GetCluster(i);
             
-            //normal
-            FbxLayerElementNormal* flayer_normal = flayer->GetNormals();
-            if (flayer_normal != NULL){
-                FbxLayerElement::EMappingMode normal_mapping_mode = flayer_normal->GetMappingMode();
-                FbxLayerElement::EReferenceMode normal_reference_mode = flayer_normal->GetReferenceMode();
-                const FbxLayerElementArrayTemplate<FbxVector4>& normal_direct_array = flayer_normal->GetDirectArray();
-                const FbxLayerElementArrayTemplate<int>& normal_index_array = flayer_normal->GetIndexArray();
-                
-                if (normal_mapping_mode == FbxLayerElement::eByPolygonVertex){
-                    if (normal_reference_mode == FbxLayerElement::eDirect){
-                        for (int i = 0;i < normal_direct_array.GetCount();i++){
-                            vec4 normal;
-                            normal[0] = normal_direct_array[i][0];
-                            normal[1] = normal_direct_array[i][1];
-                            normal[2] = normal_direct_array[i][2];
-                            normal[3] = 0;
-                            mesh.normal[i] = transform_normal*normal;
-                        }
-                    }else if (normal_reference_mode == FbxLayerElement::eIndexToDirect){
-                        for (int i = 0;i < normal_index_array.GetCount();i++){
-                            vec4 normal;
-                            normal[0] = normal_direct_array[normal_index_array[i]][0];
-                            normal[1] = normal_direct_array[normal_index_array[i]][1];
-                            normal[2] = normal_direct_array[normal_index_array[i]][2];
-                            normal[3] = 0;
-                            mesh.normal[i] = transform_normal*normal;
-                        }
-                    }else{
-                        //nothing
+            //bone index of the fskeleton node
+            int bone_index = GetBoneIndex(fcluster->GetLink());
+            
+            //vertex indices and vertex weights,up to 4 bones per vertex
+            int vertex_count = fcluster->GetControlPointIndicesCount();
+            int* vertex_indices = fcluster->GetControlPointIndices();
+            double* vertex_weights = fcluster->GetControlPointWeights();
+            for (int j = 0;j < vertex_count;j++){
+                int offset = 4*vertex_indices[j];
+                for (int l = 0;l < 4;l++){
+                    if (source.bone_index[offset+l] == -1){
+                        source.bone_index[offset+l] = bone_index;
+                        source.bone_weight[offset+l] = vertex_weights[j];
+                        break;
                     }
-                }else{
-                    //nothing
-                    //normal_mapping_mode == FbxLayerElement::eByControlPoint
-                    //normal_mapping_mode == FbxLayerElement::eByPolygon
-                    //normal_mapping_mode == FbxLayerElement::eByEdge
-                    //normal_mapping_mode == FbxLayerElement::eAllSame
                 }
             }
-            
-            //material
-            FbxLayerElementMaterial* flayer_material = flayer->GetMaterials();
-            if (flayer_material != NULL){
-                const FbxLayerElementArrayTemplate<int>& material_index_array = flayer_material->GetIndexArray();
-                FbxSurfaceMaterial* fmaterial = m_fmesh_nodes[k]->GetMaterial(material_index_array[0]);
-                FbxProperty property = fmaterial->FindProperty(FbxSurfaceMaterial::sDiffuse);
-                if (property.GetSrcObjectCount<FbxFileTexture>() != 0){
-                    FbxFileTexture* texture = property.GetSrcObject<FbxFileTexture>(0);
-                    std::string filename = std::string(FbxPathUtils::GetFileName(texture->GetFileName()).Buffer());
-                    mesh.texture = filename;
+        }
+    }
+    
+    //material index per polygon
+    FbxLayerElementMaterial* flayer_material = flayer->GetMaterials();
+    if (flayer_material != NULL){
+        const FbxLayerElementArrayTemplate<int>& material_index_array = flayer_material->GetIndexArray();
+        if (flayer_material->GetMappingMode() == FbxLayerElement::eByPolygon){
+            for (int i = 0;i < polygon_count;i++){
+                if (i < material_index_array.GetCount()){
+                    source.polygon_materials[i] = std::max(material_index_array[i],0);
                 }
             }
-            
-            //fskin
-            FbxSkin* fskin = (FbxSkin*)fmesh->GetDeformer(0);
-            if (fskin != NULL){
-                //bone_index,bone_weight per vertex
-                std::vector<int> bi_per_vert(4*xyz_count);
-                std::vector<FLOAT> bw_per_vert(4*xyz_count);
-                for (size_t i = 0;i < 4*xyz_count;i++){
-                    bi_per_vert[i] = -1;
-                    bw_per_vert[i] = 0;
-                }
-                
-                int fcluster_count = fskin->GetClusterCount();
-                for (int i = 0;i < fcluster_count;i++){
-                    //fcluster
-                    FbxCluster* fcluster = fskin->GetCluster(i);
-                    
-                    //fskeleton node
-                    FbxNode* fskeleton_node = fcluster->GetLink();
-                    
-                    //bone index
-                    int bone_index = GetBoneIndex(fskeleton_node);
-                    
-                    //vertex indices and vertex weights
-                    int vertex_count = fcluster->GetControlPointIndicesCount();
-                    int* vertex_indices = fcluster->GetControlPointIndices();
-                    double* vertex_weights = fcluster->GetControlPointWeights();
-                    for (int j = 0;j < vertex_count;j++){
-                        int offset = 4*vertex_indices[j];
-                        if (bi_per_vert[offset+0] == -1){
-                            bi_per_vert[offset+0] = bone_index;
-                            bw_per_vert[offset+0] = vertex_weights[j];
-                        }else if (bi_per_vert[offset+1] == -1){
-                            bi_per_vert[offset+1] = bone_index;
-                            bw_per_vert[offset+1] = vertex_weights[j];
-                        }else if (bi_per_vert[offset+2] == -1){
-                            bi_per_vert[offset+2] = bone_index;
-                            bw_per_vert[offset+2] = vertex_weights[j];
-                        }else if (bi_per_vert[offset+3] == -1){
-                            bi_per_vert[offset+3] = bone_index;
-                            bw_per_vert[offset+3] = vertex_weights[j];
-                        }else{
-                            //nothing
-                        }
-                    }
-                }
-                
-                //bone_index,bone_weight per polygon vertex
-                for (int i = 0;i < polygon_vertex_count;i++){
-                    mesh.bone_index[4*i+0] = bi_per_vert[4*polygon_vertices[i]+0];
-                    mesh.bone_index[4*i+1] = bi_per_vert[4*polygon_vertices[i]+1];
-                    mesh.bone_index[4*i+2] = bi_per_vert[4*polygon_vertices[i]+2];
-                    mesh.bone_index[4*i+3] = bi_per_vert[4*polygon_vertices[i]+3];
-                    mesh.bone_weight[4*i+0] = bw_per_vert[4*polygon_vertices[i]+0];
-                    mesh.bone_weight[4*i+1] = bw_per_vert[4*polygon_vertices[i]+1];
-                    mesh.bone_weight[4*i+2] = bw_per_vert[4*polygon_vertices[i]+2];
-                    mesh.bone_weight[4*i+3] = bw_per_vert[4*polygon_vertices[i]+3];
-                }
-                
+        }else if (material_index_array.GetCount() != 0){
+            //eAllSame
+            source.polygon_materials.assign(polygon_count,std::max(material_index_array[0],0));
+        }
+        
+        //diffuse texture of each material
+        source.material_textures.resize(fmesh_node->GetMaterialCount());
+        for (size_t i = 0;i < source.material_textures.size();i++){
+            FbxSurfaceMaterial* fmaterial = fmesh_node->GetMaterial((int)i);
+            if (fmaterial == NULL){
+                continue;
+            }
+            FbxProperty property = fmaterial->FindProperty(FbxSurfaceMaterial::sDiffuse);
+            if (property.GetSrcObjectCount<FbxFileTexture>() != 0){
+                FbxFileTexture* texture = property.GetSrcObject<FbxFileTexture>(0);
+                source.material_textures[i] = std::string(FbxPathUtils::GetFileName(texture->GetFileName()).Buffer());
+            }
+        }
+    }
+}
+
+
+void FBXMeshLoader::LoadMeshes(const std::vector<MeshSource>& sources){
+    TRACE_ZONE("LoadMeshes");
+    
+    //meshes are loaded in parallel,each task reads only its own copy and never the sdk
+    m_meshes.resize(sources.size());
+    auto load = [this,&sources](size_t beg,size_t end){
+        for (size_t k = beg;k < end;k++){
+            LoadMesh(sources[k],m_meshes[k]);
+        }
+    };
+    ThreadPool* pool = ThreadPool::GetInstance();
+    if (pool != nullptr){
+        pool->ParallelFor(sources.size(),1,load);
+    }else{
+        load(0,sources.size());
+    }
+}
+
+
+void FBXMeshLoader::LoadMesh(const MeshSource& source,Mesh& mesh) const{
+    //transform for xyz,normal
+    mat4 transform_xyz;
+    {
+        const FbxMatrix& tmp = FbxMatrix(source.transform.Transpose())*m_axis_transform;
+        const FbxVector4& r0 = tmp.GetRow(0);
+        const FbxVector4& r1 = tmp.GetRow(1);
+        const FbxVector4& r2 = tmp.GetRow(2);
+        const FbxVector4& r3 = tmp.GetRow(3);
+        transform_xyz.SetRow(0,vec4({(FLOAT)r0[0],(FLOAT)r0[1],(FLOAT)r0[2],(FLOAT)r0[3]}));
+        transform_xyz.SetRow(1,vec4({(FLOAT)r1[0],(FLOAT)r1[1],(FLOAT)r1[2],(FLOAT)r1[3]}));
+        transform_xyz.SetRow(2,vec4({(FLOAT)r2[0],(FLOAT)r2[1],(FLOAT)r2[2],(FLOAT)r2[3]}));
+        transform_xyz.SetRow(3,vec4({(FLOAT)r3[0],(FLOAT)r3[1],(FLOAT)r3[2],(FLOAT)r3[3]}));
+    }
+    mat4 transform_normal;
+    {
+        const FbxMatrix& tmp = (FbxMatrix(source.transform.Transpose())*m_axis_transform).Inverse().Transpose();
+        const FbxVector4& r0 = tmp.GetRow(0);
+        const FbxVector4& r1 = tmp.GetRow(1);
+        const FbxVector4& r2 = tmp.GetRow(2);
+        const FbxVector4& r3 = tmp.GetRow(3);
+        transform_normal.SetRow(0,vec4({(FLOAT)r0[0],(FLOAT)r0[1],(FLOAT)r0[2],(FLOAT)r0[3]}));
+        transform_normal.SetRow(1,vec4({(FLOAT)r1[0],(FLOAT)r1[1],(FLOAT)r1[2],(FLOAT)r1[3]}));
+        transform_normal.SetRow(2,vec4({(FLOAT)r2[0],(FLOAT)r2[1],(FLOAT)r2[2],(FLOAT)r2[3]}));
+        transform_normal.SetRow(3,vec4({(FLOAT)r3[0],(FLOAT)r3[1],(FLOAT)r3[2],(FLOAT)r3[3]}));
+    }
+    
+    //triangulate,corners are polygon vertex indices
+    int polygon_count = (int)source.polygon_sizes.size();
+    std::vector<int> corners;
+    std::vector<int> triangle_polygons;//source polygon of each triangle
+    corners.reserve(3*polygon_count);
+    {
+        TRACE_ZONE("Triangulate");
+        for (int i = 0;i < polygon_count;i++){
+            size_t corner_count = corners.size();
+            triangulate_polygon(source.xyz,source.polygon_vertices,source.polygon_firsts[i],source.polygon_sizes[i],corners);
+            triangle_polygons.insert(triangle_polygons.end(),(corners.size()-corner_count)/3,i);
+        }
+    }
+    
+    //polygon vertex
+    int polygon_vertex_count = (int)corners.size();
+    int xyz_count = (int)source.xyz.size();
+    
+    //xyz,uv,normal
+    mesh.xyz.assign(polygon_vertex_count,vec3());
+    mesh.uv.resize(polygon_vertex_count);
+    mesh.normal.resize(polygon_vertex_count);
+    for (int i = 0;i < polygon_vertex_count;i++){
+        int idx = source.polygon_vertices[corners[i]];
+        if (idx >= 0 && idx < xyz_count){
+            vec4 xyz;
+            xyz[0] = source.xyz[idx][0];
+            xyz[1] = source.xyz[idx][1];
+            xyz[2] = source.xyz[idx][2];
+            xyz[3] = 1;
+            mesh.xyz[i] = transform_xyz*xyz;
+        }
+        mesh.uv[i] = source.uv[corners[i]];
+        mesh.normal[i] = transform_normal*source.normal[corners[i]];
+    }
+    
+    //bone_index,bone_weight per polygon vertex
+    mesh.bone_index.assign(4*polygon_vertex_count,-1);
+    mesh.bone_weight.assign(4*polygon_vertex_count,0);
+    if (!source.bone_index.empty()){
+        for (int i = 0;i < polygon_vertex_count;i++){
+            int idx = source.polygon_vertices[corners[i]];
+            if (idx < 0 || idx >= xyz_count){
+                continue;
+            }
+            for (int l = 0;l < 4;l++){
+                mesh.bone_index[4*i+l] = source.bone_index[4*idx+l];
+                mesh.bone_weight[4*i+l] = source.bone_weight[4*idx+l];
             }
-            
         }
+    }
+    
+    //material,polygons are sorted by material
+    LoadDrawRanges(source,triangle_polygons,mesh);
+}
+
+
+void FBXMeshLoader::LoadDrawRanges(const MeshSource& source,const std::vector<int>& triangle_polygons,Mesh& mesh) const{
+    size_t polygon_count = mesh.xyz.size()/3;
+    
+    //material index per triangle
+    std::vector<int> material_indices(polygon_count);
+    for (size_t i = 0;i < polygon_count;i++){
+        material_indices[i] = source.polygon_materials[triangle_polygons[i]];
+    }
+    
+    //sort polygons by material,stable so that polygon order inside a material is kept
+    std::vector<size_t> order(polygon_count);
+    for (size_t i = 0;i < polygon_count;i++){
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(),order.end(),[&material_indices](size_t a,size_t b){
+        return material_indices[a] < material_indices[b];
+    });
+    Mesh sorted;
+    sorted.xyz.resize(mesh.xyz.size());
+    sorted.uv.resize(mesh.uv.size());
+    sorted.normal.resize(mesh.normal.size());
+    sorted.bone_index.resize(mesh.bone_index.size());
+    sorted.bone_weight.resize(mesh.bone_weight.size());
+    for (size_t i = 0;i < polygon_count;i++){
+        for (size_t j = 0;j < 3;j++){
+            size_t dst = 3*i+j;
+            size_t src = 3*order[i]+j;
+            sorted.xyz[dst] = mesh.xyz[src];
+            sorted.uv[dst] = mesh.uv[src];
+            sorted.normal[dst] = mesh.normal[src];
+            for (size_t l = 0;l < 4;l++){
+                sorted.bone_index[4*dst+l] = mesh.bone_index[4*src+l];
+                sorted.bone_weight[4*dst+l] = mesh.bone_weight[4*src+l];
+            }
+        }
+    }
+    mesh.xyz.swap(sorted.xyz);
+    mesh.uv.swap(sorted.uv);
+    mesh.normal.swap(sorted.normal);
+    mesh.bone_index.swap(sorted.bone_index);
+    mesh.bone_weight.swap(sorted.bone_weight);
+    
+    //draw ranges
+    for (size_t i = 0;i < polygon_count;i++){
+        int material_index = material_indices[order[i]];
+        if (i != 0 && material_index == material_indices[order[i-1]]){
+            mesh.draw_ranges.back().polygon_count++;
+            continue;
+        }
+        DrawRange range;
+        range.first_polygon = i;
+        range.polygon_count = 1;
         
+        //texture
+        if ((size_t)material_index < source.material_textures.size()){
+            range.texture = source.material_textures[material_index];
+        }
+        mesh.draw_ranges.push_back(range);
     }
 }
 
@@ -509,8 +693,23 @@ void FBXMeshLoader::LoadMeshes(){
 //2 FbxNode::EvaluateGlobalTransform() of skeleton type node
 
 void FBXMeshLoader::LoadSkeleton(){
+    TRACE_ZONE("LoadSkeleton");
+    
     m_skeleton.bbp_i.resize(m_fskeleton_nodes.size());
     m_skeleton.bbp_iti.resize(m_fskeleton_nodes.size());
+    
+    //bone names and hierarchy,used to remap animations of other files onto this skeleton
+    m_skeleton.bone_names.resize(m_fskeleton_nodes.size());
+    m_skeleton.parent_indices.resize(m_fskeleton_nodes.size());
+    for (size_t i = 0;i < m_fskeleton_nodes.size();i++){
+        m_skeleton.bone_names[i] = m_fskeleton_nodes[i]->GetName();
+        int parent_index = -1;
+        for (FbxNode* fnode = m_fskeleton_nodes[i]->GetParent();fnode != NULL && parent_index == -1;fnode = fnode->GetParent()){
+            parent_index = GetBoneIndex(fnode);
+        }
+        m_skeleton.parent_indices[i] = parent_index;
+    }
+    
     for (size_t i = 0;i < m_fmeshes.size();i++){
         //fmesh
         FbxMesh* fmesh = m_fmeshes[i];
@@ -569,22 +768,17 @@ void FBXMeshLoader::LoadSkeleton(){
 
 
 
-FBXAnimationLoader::FBXAnimationLoader(const std::string& path){
-    //initialize fbxsdk
-    FbxManager* fmanager = FbxManager::Create();
-    FbxScene* fscene = FbxScene::Create(fmanager,"");
-    FbxImporter* fimporter = FbxImporter::Create(fmanager,"");
-    if (!fimporter->Initialize(path.c_str())){
-        std::cout << "failed to read fbx file:" << path << "\n";
-        std::terminate();
-    }
-    fimporter->Import(fscene);
-    
-    //traverse node tree
-    TraverseNodeTree(fscene->GetRootNode());
+FBXAnimationLoader::FBXAnimationLoader(const std::string& path,bool is_all_takes){
+    //import with the shared session
+    FBXImportSession* session = FBXImportSession::GetInstance();
+    FbxScene* fscene = session->Import(path,ANIMATION_IMPORT);
     
-    //create axis transform
-    m_axis_transform = create_axis_transform(fscene);
+    //traverse node tree and create axis transform,sdk calls are made under the session mutex
+    {
+        std::lock_guard<std::mutex> lock(session->GetMutex());
+        TraverseNodeTree(fscene->GetRootNode());
+        m_axis_transform = create_axis_transform(fscene);
+    }
     
     //check fskeleton count
     if (m_fskeleton_nodes.size() == 0){
@@ -594,29 +788,39 @@ FBXAnimationLoader::FBXAnimationLoader(const std::string& path){
     }
     
     //load animation
-    LoadAnimation(fscene);
+    LoadAnimations(fscene,is_all_takes);
+    if (m_animations.empty()){
+        std::cout << "failed to load fbx animation file:" << path << "\n";
+        std::cout << "animation stack is not included" << "\n";
+        std::terminate();
+    }
     
-    //terminate fbxsdk
-    fmanager->Destroy();
+    //release scene
+    session->Destroy(fscene);
     
     //PrintData();
 }
 
 const FBXAnimationLoader::Animation& FBXAnimationLoader::GetAnimation() const{
-    return m_animation;
+    return m_animations[0];
+}
+
+const std::vector<FBXAnimationLoader::Animation>& FBXAnimationLoader::GetAnimations() const{
+    return m_animations;
 }
 
 void FBXAnimationLoader::PrintData() const{
     //each frame,each bone
+    const Animation& animation = m_animations[0];
     int bone_count = m_fskeleton_nodes.size();
-    for (int i = 0;i < m_animation.bp.size();i++){
+    for (int i = 0;i < animation.bp.size();i++){
         if (i%bone_count == 0){
             std::cout << "frame:" << i/bone_count << "\n";
         }
         
         //bp
         {
-            const mat4& m = m_animation.bp[i];
+            const mat4& m = animation.bp[i];
             const vec4& r0 = m.GetRow(0);
             const vec4& r1 = m.GetRow(1);
             const vec4& r2 = m.GetRow(2);
@@ -631,7 +835,7 @@ void FBXAnimationLoader::PrintData() const{
         
         //bp_it
         {
-            const mat4& m = m_animation.bp_it[i];
+            const mat4& m = animation.bp_it[i];
             const vec4& r0 = m.GetRow(0);
             const vec4& r1 = m.GetRow(1);
             const vec4& r2 = m.GetRow(2);
@@ -675,65 +879,114 @@ void FBXAnimationLoader::TraverseNodeTree(FbxNode* fnode){
 }
 
 
-void FBXAnimationLoader::LoadAnimation(FbxScene* fscene){
-    //animation info
-    FbxAnimStack* fanim_stack = fscene->GetCurrentAnimationStack();
-    if (fanim_stack == NULL){
-        return;
+void FBXAnimationLoader::LoadAnimations(FbxScene* fscene,bool is_all_takes){
+    TRACE_ZONE("LoadAnimations");
+    
+    //sample with the sdk,serial because the scene evaluator follows the current animation stack
+    //the whole pass holds the session mutex,evaluation runs in the manager other workers import into
+    std::vector<std::vector<FbxAMatrix>> transforms;
+    std::vector<size_t> frame_counts;
+    {
+        std::lock_guard<std::mutex> lock(FBXImportSession::GetInstance()->GetMutex());
+        
+        //animation stacks
+        std::vector<FbxAnimStack*> fanim_stacks;
+        if (is_all_takes){
+            int fanim_stack_count = fscene->GetSrcObjectCount<FbxAnimStack>();
+            for (int i = 0;i < fanim_stack_count;i++){
+                fanim_stacks.push_back(fscene->GetSrcObject<FbxAnimStack>(i));
+            }
+        }else if (fscene->GetCurrentAnimationStack() != NULL){
+            fanim_stacks.push_back(fscene->GetCurrentAnimationStack());
+        }
+        
+        transforms.resize(fanim_stacks.size());
+        frame_counts.resize(fanim_stacks.size());
+        m_animations.resize(fanim_stacks.size());
+        for (size_t i = 0;i < fanim_stacks.size();i++){
+            TRACE_ZONE_ARG("SampleAnimation",fanim_stacks[i]->GetName());
+            SampleAnimation(fscene,fanim_stacks[i],transforms[i],frame_counts[i]);
+            m_animations[i].name = fanim_stacks[i]->GetName();
+            m_animations[i].bone_names.resize(m_fskeleton_nodes.size());
+            for (size_t j = 0;j < m_fskeleton_nodes.size();j++){
+                m_animations[i].bone_names[j] = m_fskeleton_nodes[j]->GetName();
+            }
+        }
     }
+    
+    //bake in parallel across takes,only plain matrices are touched
+    auto bake = [this,&transforms,&frame_counts](size_t beg,size_t end){
+        for (size_t i = beg;i < end;i++){
+            TRACE_ZONE_ARG("BakeAnimation",m_animations[i].name);
+            BakeAnimation(transforms[i],frame_counts[i],m_animations[i]);
+        }
+    };
+    ThreadPool* pool = ThreadPool::GetInstance();
+    if (pool != nullptr){
+        pool->ParallelFor(m_animations.size(),1,bake);
+    }else{
+        bake(0,m_animations.size());
+    }
+}
+
+
+void FBXAnimationLoader::SampleAnimation(FbxScene* fscene,FbxAnimStack* fanim_stack,std::vector<FbxAMatrix>& transforms,size_t& frame_count) const{
+    //animation info
+    fscene->SetCurrentAnimationStack(fanim_stack);
     FbxTime frame_time = FbxTime::GetOneFrameValue(FbxTime::eFrames30);
     FbxTime start_time = fanim_stack->LocalStart.Get();
     FbxTime stop_time = fanim_stack->LocalStop.Get();
     
-    //load bone poses of each frame
-    size_t frame_count = 0;
-    FbxTime current_time = start_time;
-    while(1){
-        if (current_time <= stop_time){
-            //bp
-            for (int i = 0;i < m_fskeleton_nodes.size();i++){
-                const FbxMatrix& m = FbxMatrix(m_fskeleton_nodes[i]->EvaluateGlobalTransform(current_time).Transpose())*m_axis_transform;
-                const FbxVector4& r0 = m.GetRow(0);
-                const FbxVector4& r1 = m.GetRow(1);
-                const FbxVector4& r2 = m.GetRow(2);
-                const FbxVector4& r3 = m.GetRow(3);
-                
-                mat4 bp;
-                bp.SetRow(0,vec4({(FLOAT)r0[0],(FLOAT)r0[1],(FLOAT)r0[2],(FLOAT)r0[3]}));
-                bp.SetRow(1,vec4({(FLOAT)r1[0],(FLOAT)r1[1],(FLOAT)r1[2],(FLOAT)r1[3]}));
-                bp.SetRow(2,vec4({(FLOAT)r2[0],(FLOAT)r2[1],(FLOAT)r2[2],(FLOAT)r2[3]}));
-                bp.SetRow(3,vec4({(FLOAT)r3[0],(FLOAT)r3[1],(FLOAT)r3[2],(FLOAT)r3[3]}));
-                m_animation.bp.push_back(bp);
-            }
-            
-            //bp_it
-            for (int i = 0;i < m_fskeleton_nodes.size();i++){
-                const FbxMatrix& m = (FbxMatrix(m_fskeleton_nodes[i]->EvaluateGlobalTransform(current_time).Transpose())*m_axis_transform).Inverse().Transpose();
-                const FbxVector4& r0 = m.GetRow(0);
-                const FbxVector4& r1 = m.GetRow(1);
-                const FbxVector4& r2 = m.GetRow(2);
-                const FbxVector4& r3 = m.GetRow(3);
-                
-                mat4 bp_it;
-                bp_it.SetRow(0,vec4({(FLOAT)r0[0],(FLOAT)r0[1],(FLOAT)r0[2],(FLOAT)r0[3]}));
-                bp_it.SetRow(1,vec4({(FLOAT)r1[0],(FLOAT)r1[1],(FLOAT)r1[2],(FLOAT)r1[3]}));
-                bp_it.SetRow(2,vec4({(FLOAT)r2[0],(FLOAT)r2[1],(FLOAT)r2[2],(FLOAT)r2[3]}));
-                bp_it.SetRow(3,vec4({(FLOAT)r3[0],(FLOAT)r3[1],(FLOAT)r3[2],(FLOAT)r3[3]}));
-                m_animation.bp_it.push_back(bp_it);
-            }
+    //global transform of each bone of each frame
+    frame_count = 0;
+    for (FbxTime current_time = start_time;current_time <= stop_time;current_time += frame_time){
+        for (size_t i = 0;i < m_fskeleton_nodes.size();i++){
+            transforms.push_back(m_fskeleton_nodes[i]->EvaluateGlobalTransform(current_time));
+        }
+        frame_count++;
+    }
+}
+
+
+void FBXAnimationLoader::BakeAnimation(const std::vector<FbxAMatrix>& transforms,size_t frame_count,Animation& animation) const{
+    FbxTime frame_time = FbxTime::GetOneFrameValue(FbxTime::eFrames30);
+    
+    //bone poses of each frame
+    animation.bp.resize(transforms.size());
+    animation.bp_it.resize(transforms.size());
+    for (size_t i = 0;i < transforms.size();i++){
+        //bp
+        const FbxMatrix& m = FbxMatrix(transforms[i].Transpose())*m_axis_transform;
+        {
+            const FbxVector4& r0 = m.GetRow(0);
+            const FbxVector4& r1 = m.GetRow(1);
+            const FbxVector4& r2 = m.GetRow(2);
+            const FbxVector4& r3 = m.GetRow(3);
             
-            //update frame count
-            frame_count++;
+            mat4& bp = animation.bp[i];
+            bp.SetRow(0,vec4({(FLOAT)r0[0],(FLOAT)r0[1],(FLOAT)r0[2],(FLOAT)r0[3]}));
+            bp.SetRow(1,vec4({(FLOAT)r1[0],(FLOAT)r1[1],(FLOAT)r1[2],(FLOAT)r1[3]}));
+            bp.SetRow(2,vec4({(FLOAT)r2[0],(FLOAT)r2[1],(FLOAT)r2[2],(FLOAT)r2[3]}));
+            bp.SetRow(3,vec4({(FLOAT)r3[0],(FLOAT)r3[1],(FLOAT)r3[2],(FLOAT)r3[3]}));
+        }
+        
+        //bp_it
+        {
+            const FbxMatrix& m_it = m.Inverse().Transpose();
+            const FbxVector4& r0 = m_it.GetRow(0);
+            const FbxVector4& r1 = m_it.GetRow(1);
+            const FbxVector4& r2 = m_it.GetRow(2);
+            const FbxVector4& r3 = m_it.GetRow(3);
             
-            //update current time
-            current_time += frame_time;
-        }else{
-            break;
+            mat4& bp_it = animation.bp_it[i];
+            bp_it.SetRow(0,vec4({(FLOAT)r0[0],(FLOAT)r0[1],(FLOAT)r0[2],(FLOAT)r0[3]}));
+            bp_it.SetRow(1,vec4({(FLOAT)r1[0],(FLOAT)r1[1],(FLOAT)r1[2],(FLOAT)r1[3]}));
+            bp_it.SetRow(2,vec4({(FLOAT)r2[0],(FLOAT)r2[1],(FLOAT)r2[2],(FLOAT)r2[3]}));
+            bp_it.SetRow(3,vec4({(FLOAT)r3[0],(FLOAT)r3[1],(FLOAT)r3[2],(FLOAT)r3[3]}));
         }
     }
     
     //duration,frame count
-    m_animation.duration = frame_time.GetSecondDouble()*(frame_count-1);
-    m_animation.frame_count = frame_count;
-    
+    animation.duration = frame_time.GetSecondDouble()*(frame_count-1);
+    animation.frame_count = frame_count;
 }
@@ -9,20 +9,43 @@
 
 class FBXMeshLoader{
 public:
+    //polygons of one material,polygons are sorted by material
+    struct DrawRange{
+        size_t first_polygon;
+        size_t polygon_count;
+        std::string texture;
+    };
     struct Mesh{
         std::vector<vec3> xyz;          //size = 3*polygon_count
         std::vector<vec2> uv;           //size = 3*polygon_count
         std::vector<vec3> normal;       //size = 3*polygon_count
         std::vector<int> bone_index;    //size = 4*3*polygon_count
         std::vector<FLOAT> bone_weight; //size = 4*3*polygon_count
-        std::string texture;
+        std::vector<DrawRange> draw_ranges;//one range if split per material
     };
     struct Skeleton{
         //bbp = bone bind pose,i = inverse,t = transpose
         std::vector<mat4> bbp_i;  //for xyz,size = bone_count
         std::vector<mat4> bbp_iti;//for normal,size = bone_count
+        std::vector<std::string> bone_names;//fskeleton node names,size = bone_count
+        std::vector<int> parent_indices;    //nearest ancestor bone,-1 for roots,size = bone_count
     };
 private:
+    //sdk data of one fmesh,copied under the session mutex so that meshes are built in parallel without the sdk
+    struct MeshSource{
+        FbxAMatrix transform;              //global transform of the fmesh node
+        std::vector<FbxVector4> xyz;       //control points
+        std::vector<int> polygon_vertices; //control point of each polygon vertex
+        std::vector<int> polygon_firsts;   //first polygon vertex of each polygon
+        std::vector<int> polygon_sizes;    //polygon vertex count of each polygon
+        std::vector<vec2> uv;              //size = polygon vertex count,zero where the fbx has none
+        std::vector<vec4> normal;          //size = polygon vertex count,w = 0,zero where the fbx has none
+        std::vector<int> bone_index;       //size = 4*control point count,empty without skin
+        std::vector<FLOAT> bone_weight;    //size = 4*control point count,empty without skin
+        std::vector<int> polygon_materials;//material index of each polygon
+        std::vector<std::string> material_textures;//diffuse texture file name of each material of the node
+    };
+    
     std::vector<FbxNode*> m_fskeleton_nodes;
     std::vector<FbxNode*> m_fmesh_nodes;
     std::vector<FbxMesh*> m_fmeshes;
@@ -32,7 +55,9 @@ private:
     std::vector<Mesh> m_meshes;
     Skeleton m_skeleton;
 public:
-    FBXMeshLoader(const std::string& path);
+    //is_split_per_material splits every fbx mesh into one mesh per material,
+    //otherwise a mesh keeps all polygons and materials are expressed as draw ranges
+    FBXMeshLoader(const std::string& path,bool is_split_per_material);
     const std::vector<FBXMeshLoader::Mesh>& GetMeshes() const;
     const FBXMeshLoader::Skeleton& GetSkeleton() const;
     mat4 GetNormalizingTransform() const;
@@ -40,7 +65,12 @@ public:
 private:
     int GetBoneIndex(FbxNode* fskeleton_node) const;
     void TraverseNodeTree(FbxNode* fnode);
-    void LoadMeshes();
+    //called under the session mutex
+    void LoadMeshSource(int fmesh_index,MeshSource& source) const;
+    //triangulation and stream building,touch no sdk object
+    void LoadMeshes(const std::vector<MeshSource>& sources);
+    void LoadMesh(const MeshSource& source,Mesh& mesh) const;
+    void LoadDrawRanges(const MeshSource& source,const std::vector<int>& triangle_polygons,Mesh& mesh) const;
     void LoadSkeleton();
 };
 
@@ -48,22 +78,31 @@ private:
 class FBXAnimationLoader{
 public:
     struct Animation{
+        std::string name;//animation stack name
         double duration;
         size_t frame_count;
         std::vector<mat4> bp;//for xyz,size = frame_count*bone_count
         std::vector<mat4> bp_it;//for normal,size = frame_count*bone_count
+        std::vector<std::string> bone_names;//fskeleton node names,size = bone_count
     };
 private:
     std::vector<FbxNode*> m_fskeleton_nodes;
     FbxMatrix m_axis_transform;
-    Animation m_animation;
+    std::vector<Animation> m_animations;
 public:
-    FBXAnimationLoader(const std::string& path);
+    //is_all_takes loads every animation stack of the file,otherwise only the current one
+    FBXAnimationLoader(const std::string& path,bool is_all_takes);
+    //first animation
     const FBXAnimationLoader::Animation& GetAnimation() const;
+    const std::vector<FBXAnimationLoader::Animation>& GetAnimations() const;
     void PrintData() const;
 private:
     void TraverseNodeTree(FbxNode* fnode);
-    void LoadAnimation(FbxScene* fscene);
+    void LoadAnimations(FbxScene* fscene,bool is_all_takes);
+    //evaluates global bone transforms of each frame with the sdk,size = frame_count*bone_count
+    void SampleAnimation(FbxScene* fscene,FbxAnimStack* fanim_stack,std::vector<FbxAMatrix>& transforms,size_t& frame_count) const;
+    //converts sampled transforms into bone poses,touches no sdk object
+    void BakeAnimation(const std::vector<FbxAMatrix>& transforms,size_t frame_count,Animation& animation) const;
 };
 
 #endif // FBX_LOADER_HPP
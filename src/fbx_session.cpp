@@ -0,0 +1,115 @@
+#include "fbx_session.hpp"
+#include "trace.hpp"
+
+
+FBXImportSession* FBXImportSession::m_instance = nullptr;
+
+FBXImportSession::FBXImportSession(size_t worker_count):m_pool(worker_count),m_import_count(0),m_import_time(0){
+    m_fmanager = FbxManager::Create();
+    
+    //mesh,lights,cameras,embedded media and deformer shapes are skipped
+    //textures are loaded from the texture directory by file name,so embedded media is not extracted
+    m_fio_settings[MESH_IMPORT] = FbxIOSettings::Create(m_fmanager,IOSROOT);
+    FbxIOSettings* mesh_settings = m_fio_settings[MESH_IMPORT];
+    mesh_settings->SetBoolProp(IMP_FBX_MODEL,true);
+    mesh_settings->SetBoolProp(IMP_FBX_MATERIAL,true);
+    mesh_settings->SetBoolProp(IMP_FBX_TEXTURE,true);
+    mesh_settings->SetBoolProp(IMP_FBX_LINK,true);
+    mesh_settings->SetBoolProp(IMP_FBX_GLOBAL_SETTINGS,true);
+    mesh_settings->SetBoolProp(IMP_FBX_ANIMATION,false);
+    mesh_settings->SetBoolProp(IMP_FBX_SHAPE,false);
+    mesh_settings->SetBoolProp(IMP_FBX_GOBO,false);
+    mesh_settings->SetBoolProp(IMP_FBX_CHARACTER,false);
+    mesh_settings->SetBoolProp(IMP_FBX_CONSTRAINT,false);
+    mesh_settings->SetBoolProp(IMP_FBX_LIGHT,false);
+    mesh_settings->SetBoolProp(IMP_FBX_CAMERA,false);
+    mesh_settings->SetBoolProp(IMP_FBX_AUDIO,false);
+    mesh_settings->SetBoolProp(IMP_FBX_EXTRACT_EMBEDDED_DATA,false);
+    
+    //animation,only the node tree and its curves are needed
+    m_fio_settings[ANIMATION_IMPORT] = FbxIOSettings::Create(m_fmanager,IOSROOT);
+    FbxIOSettings* animation_settings = m_fio_settings[ANIMATION_IMPORT];
+    animation_settings->SetBoolProp(IMP_FBX_MODEL,true);
+    animation_settings->SetBoolProp(IMP_FBX_ANIMATION,true);
+    animation_settings->SetBoolProp(IMP_FBX_GLOBAL_SETTINGS,true);
+    animation_settings->SetBoolProp(IMP_FBX_MATERIAL,false);
+    animation_settings->SetBoolProp(IMP_FBX_TEXTURE,false);
+    animation_settings->SetBoolProp(IMP_FBX_LINK,false);
+    animation_settings->SetBoolProp(IMP_FBX_SHAPE,false);
+    animation_settings->SetBoolProp(IMP_FBX_GOBO,false);
+    animation_settings->SetBoolProp(IMP_FBX_CHARACTER,false);
+    animation_settings->SetBoolProp(IMP_FBX_CONSTRAINT,false);
+    animation_settings->SetBoolProp(IMP_FBX_LIGHT,false);
+    animation_settings->SetBoolProp(IMP_FBX_CAMERA,false);
+    animation_settings->SetBoolProp(IMP_FBX_AUDIO,false);
+    animation_settings->SetBoolProp(IMP_FBX_EXTRACT_EMBEDDED_DATA,false);
+}
+
+FBXImportSession::~FBXImportSession(){
+    m_pool.Wait();
+    m_fmanager->Destroy();
+}
+
+void FBXImportSession::CreateInstance(size_t worker_count){
+    if (m_instance == nullptr){
+        m_instance = new FBXImportSession(worker_count);
+    }
+}
+
+void FBXImportSession::DeleteInstance(){
+    delete m_instance;
+    m_instance = nullptr;
+}
+
+FBXImportSession* FBXImportSession::GetInstance(){
+    return m_instance;
+}
+
+FbxScene* FBXImportSession::Import(const std::string& path,FBXImportPreset preset){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    TRACE_ZONE_ARG("FbxImporter::Import",path);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    
+    //scene and importer
+    FbxScene* fscene = FbxScene::Create(m_fmanager,"");
+    FbxImporter* fimporter = FbxImporter::Create(m_fmanager,"");
+    if (!fimporter->Initialize(path.c_str(),-1,m_fio_settings[preset])){
+        std::cout << "failed to read fbx file:" << path << "\n";
+        std::terminate();
+    }
+    fimporter->Import(fscene);
+    fimporter->Destroy();
+    
+    m_import_count++;
+    m_import_time += std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+    return fscene;
+}
+
+void FBXImportSession::Destroy(FbxScene* fscene){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    fscene->Destroy();
+}
+
+FbxManager* FBXImportSession::GetManager() const{
+    return m_fmanager;
+}
+
+std::mutex& FBXImportSession::GetMutex(){
+    return m_mutex;
+}
+
+void FBXImportSession::Enqueue(const std::function<void()>& task){
+    m_pool.Enqueue(task);
+}
+
+void FBXImportSession::Wait(){
+    m_pool.Wait();
+}
+
+size_t FBXImportSession::GetImportCount() const{
+    return m_import_count;
+}
+
+double FBXImportSession::GetImportTime() const{
+    return m_import_time;
+}
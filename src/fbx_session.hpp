@@ -0,0 +1,59 @@
+#ifndef FBX_SESSION_HPP
+#define FBX_SESSION_HPP
+
+#include "library.hpp"
+#include "thread_pool.hpp"
+
+#include "fbxsdk.h"
+
+
+//what an import reads from a fbx file
+enum FBXImportPreset{
+    MESH_IMPORT,     //geometry,materials,skin links,no animation
+    ANIMATION_IMPORT,//nodes and animation curves,no geometry attributes or materials
+};
+
+
+//one FbxManager and io settings shared by every fbx import
+//the manager is not thread safe,so sdk objects are created,imported and destroyed under the session mutex
+//reads of an imported scene take the mutex too,evaluation and property access can touch state of the manager
+//loaders copy what they need into plain arrays under the lock and do the heavy work on those copies
+class FBXImportSession{
+private:
+    static FBXImportSession* m_instance;
+    
+    FbxManager* m_fmanager;
+    FbxIOSettings* m_fio_settings[2];//per preset
+    std::mutex m_mutex;
+    
+    //bounded worker pool for queued imports
+    ThreadPool m_pool;
+    
+    size_t m_import_count;
+    double m_import_time;//sec,inside the lock
+private:
+    FBXImportSession(size_t worker_count);
+    ~FBXImportSession();
+public:
+    //singleton
+    static void CreateInstance(size_t worker_count);
+    static void DeleteInstance();
+    static FBXImportSession* GetInstance();
+    
+    //imports a file into a new scene of the shared manager,terminates if the file can not be read
+    FbxScene* Import(const std::string& path,FBXImportPreset preset);
+    void Destroy(FbxScene* fscene);
+    
+    FbxManager* GetManager() const;
+    //held while the caller calls the sdk on objects of the shared manager,e.g. FbxGeometryConverter or scene reads
+    std::mutex& GetMutex();
+    
+    //queued imports,at most worker_count run at once
+    void Enqueue(const std::function<void()>& task);
+    void Wait();
+    
+    size_t GetImportCount() const;
+    double GetImportTime() const;
+};
+
+#endif // FBX_SESSION_HPP
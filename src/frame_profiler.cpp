@@ -0,0 +1,234 @@
+#include "frame_profiler.hpp"
+
+
+//frames in flight on the gpu before a timestamp is reused
+static const size_t FRAME_PROFILER_QUERY_FRAME_COUNT = 4;
+
+static const char* FRAME_PROFILER_ZONE_NAMES[] = {"event","update","render","swap","cpu_frame","gpu_frame"};
+static const char* FRAME_PROFILER_COUNTER_NAMES[] = {"draws","instances","triangles","program_binds","texture_binds","vertex_array_binds","buffer_binds","uniforms","uploads","upload_bytes"};
+static const int FRAME_PROFILER_COUNTER_COUNT = sizeof(FRAME_PROFILER_COUNTER_NAMES)/sizeof(FRAME_PROFILER_COUNTER_NAMES[0]);
+
+static double elapsed_ms(std::chrono::steady_clock::time_point t0,std::chrono::steady_clock::time_point t1){
+    return std::chrono::duration<double,std::milli>(t1-t0).count();
+}
+
+//in the order of FRAME_PROFILER_COUNTER_NAMES
+static size_t get_counter(const GLCounter::Counters& counters,int i){
+    const size_t values[] = {
+        counters.draw_count,
+        counters.instance_count,
+        counters.triangle_count,
+        counters.program_bind_count,
+        counters.texture_bind_count,
+        counters.vertex_array_bind_count,
+        counters.buffer_bind_count,
+        counters.uniform_count,
+        counters.upload_count,
+        counters.upload_size
+    };
+    return values[i];
+}
+
+
+FrameProfiler* FrameProfiler::m_instance = nullptr;
+
+FrameProfiler::FrameProfiler(size_t window_size,const std::string& dump_path)
+    :m_frame(0),m_dropped_count(0),m_zone(-1),m_window_size(std::max(window_size,(size_t)1)),m_dump(nullptr),m_is_json(false),m_dump_count(0)
+{
+    m_queries.resize(2*FRAME_PROFILER_QUERY_FRAME_COUNT);
+    glGenQueries((GLsizei)m_queries.size(),m_queries.data());
+    m_query_frames.assign(FRAME_PROFILER_QUERY_FRAME_COUNT,SIZE_MAX);
+    m_pending_times.resize(FRAME_PROFILER_QUERY_FRAME_COUNT);
+    m_pending_counters.resize(FRAME_PROFILER_QUERY_FRAME_COUNT);
+    m_times.assign(ZONE_COUNT,0);
+    m_samples.assign(ZONE_COUNT,std::vector<double>(m_window_size,0));
+    m_sample_counts.assign(ZONE_COUNT,0);
+
+    if (dump_path.empty()){
+        return;
+    }
+    m_dump = std::fopen(dump_path.c_str(),"w");
+    if (m_dump == NULL){
+        std::cout << "failed to open frame dump:" << dump_path << "\n";
+        m_dump = nullptr;
+        return;
+    }
+    m_is_json = dump_path.size() >= 5 && dump_path.compare(dump_path.size()-5,5,".json") == 0;
+    if (m_is_json){
+        std::fprintf(m_dump,"[\n");
+    }else{
+        std::fprintf(m_dump,"frame");
+        for (int i = 0;i < ZONE_COUNT;i++){
+            std::fprintf(m_dump,",%s",FRAME_PROFILER_ZONE_NAMES[i]);
+        }
+        for (int i = 0;i < FRAME_PROFILER_COUNTER_COUNT && GLCounter::IsEnabled();i++){
+            std::fprintf(m_dump,",%s",FRAME_PROFILER_COUNTER_NAMES[i]);
+        }
+        std::fprintf(m_dump,"\n");
+    }
+}
+
+FrameProfiler::~FrameProfiler(){
+    //frames still in flight are not dumped
+    if (m_dump != nullptr){
+        if (m_is_json){
+            std::fprintf(m_dump,"\n]\n");
+        }
+        std::fclose(m_dump);
+    }
+    glDeleteQueries((GLsizei)m_queries.size(),m_queries.data());
+}
+
+void FrameProfiler::CreateInstance(size_t window_size,const std::string& dump_path){
+    if (m_instance == nullptr){
+        m_instance = new FrameProfiler(window_size,dump_path);
+    }
+}
+
+void FrameProfiler::DeleteInstance(){
+    delete m_instance;
+    m_instance = nullptr;
+}
+
+FrameProfiler* FrameProfiler::GetInstance(){
+    return m_instance;
+}
+
+void FrameProfiler::BeginFrame(){
+    ReadQueries();
+
+    //the gpu is a whole ring behind,the oldest frame is given up instead of waiting
+    size_t slot = m_frame%FRAME_PROFILER_QUERY_FRAME_COUNT;
+    if (m_query_frames[slot] != SIZE_MAX){
+        Dump(m_query_frames[slot],m_pending_times[slot],false,m_pending_counters[slot]);
+        m_query_frames[slot] = SIZE_MAX;
+        m_dropped_count++;
+    }
+
+    glQueryCounter(m_queries[2*slot],GL_TIMESTAMP);
+    m_frame_start = std::chrono::steady_clock::now();
+    m_times.assign(ZONE_COUNT,0);
+}
+
+void FrameProfiler::BeginZone(Zone zone){
+    EndZone();
+    m_zone = zone;
+    m_zone_start = std::chrono::steady_clock::now();
+}
+
+void FrameProfiler::EndZone(){
+    if (m_zone != -1){
+        m_times[m_zone] += elapsed_ms(m_zone_start,std::chrono::steady_clock::now());
+        m_zone = -1;
+    }
+}
+
+void FrameProfiler::EndFrame(){
+    EndZone();
+    size_t slot = m_frame%FRAME_PROFILER_QUERY_FRAME_COUNT;
+    glQueryCounter(m_queries[2*slot+1],GL_TIMESTAMP);
+    m_times[FRAME_ZONE] = elapsed_ms(m_frame_start,std::chrono::steady_clock::now());
+    GLCounter::EndFrame();
+
+    //cpu zones at once,the gpu time when its queries have finished
+    for (int i = 0;i < GPU_ZONE;i++){
+        AddSample((Zone)i,m_times[i]);
+    }
+    m_pending_times[slot] = m_times;
+    m_pending_counters[slot] = GLCounter::GetFrameCounters();
+    m_query_frames[slot] = m_frame;
+    m_frame++;
+}
+
+FrameProfiler::Statistics FrameProfiler::GetStatistics(Zone zone) const{
+    Statistics statistics;
+    statistics.sample_count = std::min(m_sample_counts[zone],m_window_size);
+    statistics.min = 0;
+    statistics.average = 0;
+    statistics.p99 = 0;
+    if (statistics.sample_count == 0){
+        return statistics;
+    }
+
+    std::vector<double> samples(m_samples[zone].begin(),m_samples[zone].begin()+statistics.sample_count);
+    statistics.min = *std::min_element(samples.begin(),samples.end());
+    for (size_t i = 0;i < samples.size();i++){
+        statistics.average += samples[i];
+    }
+    statistics.average /= samples.size();
+    size_t p99_index = (size_t)std::ceil(0.99*samples.size())-1;
+    std::nth_element(samples.begin(),samples.begin()+p99_index,samples.end());
+    statistics.p99 = samples[p99_index];
+    return statistics;
+}
+
+size_t FrameProfiler::GetDroppedCount() const{
+    return m_dropped_count;
+}
+
+const char* FrameProfiler::GetZoneName(Zone zone){
+    return FRAME_PROFILER_ZONE_NAMES[zone];
+}
+
+void FrameProfiler::ReadQueries(){
+    size_t first_frame = (m_frame > FRAME_PROFILER_QUERY_FRAME_COUNT) ? m_frame-FRAME_PROFILER_QUERY_FRAME_COUNT : 0;
+    for (size_t frame = first_frame;frame < m_frame;frame++){
+        size_t slot = frame%FRAME_PROFILER_QUERY_FRAME_COUNT;
+        if (m_query_frames[slot] != frame){
+            continue;
+        }
+
+        //timestamps finish in order,so later frames are not ready either
+        GLint is_available = GL_FALSE;
+        glGetQueryObjectiv(m_queries[2*slot+1],GL_QUERY_RESULT_AVAILABLE,&is_available);
+        if (is_available == GL_FALSE){
+            break;
+        }
+        GLuint64 t0,t1;
+        glGetQueryObjectui64v(m_queries[2*slot],GL_QUERY_RESULT,&t0);
+        glGetQueryObjectui64v(m_queries[2*slot+1],GL_QUERY_RESULT,&t1);
+        m_pending_times[slot][GPU_ZONE] = (t1-t0)*1e-6;
+        AddSample(GPU_ZONE,m_pending_times[slot][GPU_ZONE]);
+        Dump(frame,m_pending_times[slot],true,m_pending_counters[slot]);
+        m_query_frames[slot] = SIZE_MAX;
+    }
+}
+
+void FrameProfiler::AddSample(Zone zone,double time){
+    m_samples[zone][m_sample_counts[zone]%m_window_size] = time;
+    m_sample_counts[zone]++;
+}
+
+void FrameProfiler::Dump(size_t frame,const std::vector<double>& times,bool has_gpu_time,const GLCounter::Counters& counters){
+    if (m_dump == nullptr){
+        return;
+    }
+    if (m_is_json){
+        std::fprintf(m_dump,"%s{\"frame\":%zu",(m_dump_count != 0) ? ",\n" : "",frame);
+        for (int i = 0;i < ZONE_COUNT;i++){
+            if (i == GPU_ZONE && !has_gpu_time){
+                std::fprintf(m_dump,",\"%s\":null",FRAME_PROFILER_ZONE_NAMES[i]);
+            }else{
+                std::fprintf(m_dump,",\"%s\":%.4f",FRAME_PROFILER_ZONE_NAMES[i],times[i]);
+            }
+        }
+        for (int i = 0;i < FRAME_PROFILER_COUNTER_COUNT && GLCounter::IsEnabled();i++){
+            std::fprintf(m_dump,",\"%s\":%zu",FRAME_PROFILER_COUNTER_NAMES[i],get_counter(counters,i));
+        }
+        std::fprintf(m_dump,"}");
+    }else{
+        std::fprintf(m_dump,"%zu",frame);
+        for (int i = 0;i < ZONE_COUNT;i++){
+            if (i == GPU_ZONE && !has_gpu_time){
+                std::fprintf(m_dump,",");
+            }else{
+                std::fprintf(m_dump,",%.4f",times[i]);
+            }
+        }
+        for (int i = 0;i < FRAME_PROFILER_COUNTER_COUNT && GLCounter::IsEnabled();i++){
+            std::fprintf(m_dump,",%zu",get_counter(counters,i));
+        }
+        std::fprintf(m_dump,"\n");
+    }
+    m_dump_count++;
+}
@@ -0,0 +1,82 @@
+#ifndef FRAME_PROFILER_HPP
+#define FRAME_PROFILER_HPP
+
+#include "library.hpp"
+#include "gl_counter.hpp"
+
+#include <OpenGL/gl3.h>
+
+
+//cpu time of the main loop zones and gpu time of every frame
+//gpu time is read from a ring of timestamp queries some frames later,so reading never waits for the gpu
+//min,average and p99 are kept over a rolling window of frames
+//the optional dump has one row per frame,written once the gpu time of the frame is known,followed by the gl counters of the frame
+class FrameProfiler{
+public:
+    enum Zone{
+        EVENT_ZONE,
+        UPDATE_ZONE,
+        RENDER_ZONE,
+        SWAP_ZONE,
+        FRAME_ZONE,//cpu,BeginFrame to EndFrame
+        GPU_ZONE,  //gpu,first to last command of the frame
+        ZONE_COUNT
+    };
+    struct Statistics{
+        size_t sample_count;//frames in the window
+        double min;         //ms
+        double average;     //ms
+        double p99;         //ms
+    };
+private:
+    static FrameProfiler* m_instance;
+
+    //timestamps at the beginning and the end of each frame in flight
+    std::vector<GLuint> m_queries;//size = 2*ring size
+    std::vector<size_t> m_query_frames;//frame of each ring slot,SIZE_MAX if free
+    std::vector<std::vector<double>> m_pending_times;//cpu times of each ring slot,waiting for the gpu time
+    std::vector<GLCounter::Counters> m_pending_counters;
+    size_t m_frame;
+    size_t m_dropped_count;//gpu times lost because the gpu was a whole ring behind
+
+    std::chrono::steady_clock::time_point m_frame_start;
+    std::chrono::steady_clock::time_point m_zone_start;
+    int m_zone;//running zone,-1 if none
+    std::vector<double> m_times;//ms,frame being measured
+
+    //rolling window of every zone,the oldest sample is overwritten
+    size_t m_window_size;
+    std::vector<std::vector<double>> m_samples;
+    std::vector<size_t> m_sample_counts;
+
+    //"*.json" gives a json array,anything else csv
+    std::FILE* m_dump;
+    bool m_is_json;
+    size_t m_dump_count;
+private:
+    FrameProfiler(size_t window_size,const std::string& dump_path);
+    ~FrameProfiler();
+public:
+    //singleton,needs a current gl context,empty dump_path disables the dump
+    static void CreateInstance(size_t window_size,const std::string& dump_path);
+    static void DeleteInstance();
+    static FrameProfiler* GetInstance();//nullptr if not created
+
+    void BeginFrame();
+    //ends the running zone
+    void BeginZone(Zone zone);
+    void EndZone();
+    //also ends the frame of the gl counters
+    void EndFrame();
+
+    FrameProfiler::Statistics GetStatistics(Zone zone) const;
+    size_t GetDroppedCount() const;
+    static const char* GetZoneName(Zone zone);
+private:
+    //reads every finished frame of the ring,oldest first
+    void ReadQueries();
+    void AddSample(Zone zone,double time);
+    void Dump(size_t frame,const std::vector<double>& times,bool has_gpu_time,const GLCounter::Counters& counters);
+};
+
+#endif // FRAME_PROFILER_HPP
@@ -0,0 +1,53 @@
+#include "gl_counter.hpp"
+
+
+GLCounter::Counters GLCounter::m_counters = {};
+GLCounter::Counters GLCounter::m_frame_counters = {};
+GLCounter::Counters GLCounter::m_total_counters = {};
+size_t GLCounter::m_frame_count = 0;
+
+void GLCounter::EndFrame(){
+    m_frame_counters = m_counters;
+    m_total_counters.draw_count += m_counters.draw_count;
+    m_total_counters.instance_count += m_counters.instance_count;
+    m_total_counters.triangle_count += m_counters.triangle_count;
+    m_total_counters.program_bind_count += m_counters.program_bind_count;
+    m_total_counters.texture_bind_count += m_counters.texture_bind_count;
+    m_total_counters.vertex_array_bind_count += m_counters.vertex_array_bind_count;
+    m_total_counters.buffer_bind_count += m_counters.buffer_bind_count;
+    m_total_counters.uniform_count += m_counters.uniform_count;
+    m_total_counters.upload_count += m_counters.upload_count;
+    m_total_counters.upload_size += m_counters.upload_size;
+    m_counters = Counters();
+    m_frame_count++;
+}
+
+const GLCounter::Counters& GLCounter::GetFrameCounters(){
+    return m_frame_counters;
+}
+
+const GLCounter::Counters& GLCounter::GetTotalCounters(){
+    return m_total_counters;
+}
+
+size_t GLCounter::GetFrameCount(){
+    return m_frame_count;
+}
+
+size_t GLCounter::GetPixelSize(GLenum format,GLenum type){
+    size_t component_count = 4;
+    if (format == GL_RED || format == GL_RED_INTEGER){
+        component_count = 1;
+    }else if (format == GL_RG || format == GL_RG_INTEGER){
+        component_count = 2;
+    }else if (format == GL_RGB || format == GL_RGB_INTEGER){
+        component_count = 3;
+    }
+    size_t component_size = 1;
+    if (type == GL_FLOAT || type == GL_INT || type == GL_UNSIGNED_INT){
+        component_size = 4;
+    }else if (type == GL_HALF_FLOAT || type == GL_SHORT || type == GL_UNSIGNED_SHORT){
+        component_size = 2;
+    }
+    return component_count*component_size;
+}
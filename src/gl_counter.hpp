@@ -0,0 +1,198 @@
+#ifndef GL_COUNTER_HPP
+#define GL_COUNTER_HPP
+
+#include "library.hpp"
+
+#include <OpenGL/gl3.h>
+
+
+//per frame counts of the gl calls the renderer issues,readable from code and written into the frame profiler dump
+//calls issued every frame go through the wrappers below instead of the gl functions
+//building with -DDISABLE_GL_COUNTERS reduces every wrapper to the raw call
+//gl thread only
+
+class GLCounter{
+public:
+    struct Counters{
+        size_t draw_count;
+        size_t instance_count;         //1 per draw without instancing
+        size_t triangle_count;         //summed over instances
+        size_t program_bind_count;
+        size_t texture_bind_count;     //glBindTexture
+        size_t vertex_array_bind_count;
+        size_t buffer_bind_count;
+        size_t uniform_count;          //glUniform* calls
+        size_t upload_count;           //glBufferData with data,glBufferSubData,glTexSubImage*
+        size_t upload_size;            //bytes
+    };
+private:
+    static Counters m_counters;      //frame being issued
+    static Counters m_frame_counters;//last finished frame
+    static Counters m_total_counters;
+    static size_t m_frame_count;
+public:
+    static bool IsEnabled();
+
+    //the frame profiler ends frames
+    static void EndFrame();
+    static const GLCounter::Counters& GetFrameCounters();
+    static const GLCounter::Counters& GetTotalCounters();
+    static size_t GetFrameCount();
+
+    //wrappers
+    static void DrawElements(GLenum mode,GLsizei count,GLenum type,const void* indices);
+    static void DrawElementsInstanced(GLenum mode,GLsizei count,GLenum type,const void* indices,GLsizei instance_count);
+    static void UseProgram(GLuint program);
+    static void BindTexture(GLenum target,GLuint texture);
+    static void BindVertexArray(GLuint vao);
+    static void BindBuffer(GLenum target,GLuint buffer);
+    static void BufferData(GLenum target,GLsizeiptr size,const void* data,GLenum usage);
+    static void BufferSubData(GLenum target,GLintptr offset,GLsizeiptr size,const void* data);
+    static void TexSubImage1D(GLenum target,GLint level,GLint x,GLsizei width,GLenum format,GLenum type,const void* pixels);
+    static void TexSubImage2D(GLenum target,GLint level,GLint x,GLint y,GLsizei width,GLsizei height,GLenum format,GLenum type,const void* pixels);
+    static void Uniform1i(GLint location,GLint v);
+    static void Uniform1f(GLint location,GLfloat v);
+    static void Uniform3fv(GLint location,GLsizei count,const GLfloat* v);
+    static void Uniform4fv(GLint location,GLsizei count,const GLfloat* v);
+    static void UniformMatrix4fv(GLint location,GLsizei count,GLboolean transpose,const GLfloat* v);
+private:
+    static size_t GetTriangleCount(GLenum mode,GLsizei count);
+    static size_t GetPixelSize(GLenum format,GLenum type);
+};
+
+
+inline bool GLCounter::IsEnabled(){
+#if defined(DISABLE_GL_COUNTERS)
+    return false;
+#else
+    return true;
+#endif
+}
+
+inline void GLCounter::DrawElements(GLenum mode,GLsizei count,GLenum type,const void* indices){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.draw_count++;
+    m_counters.instance_count++;
+    m_counters.triangle_count += GetTriangleCount(mode,count);
+#endif
+    glDrawElements(mode,count,type,indices);
+}
+
+inline void GLCounter::DrawElementsInstanced(GLenum mode,GLsizei count,GLenum type,const void* indices,GLsizei instance_count){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.draw_count++;
+    m_counters.instance_count += instance_count;
+    m_counters.triangle_count += GetTriangleCount(mode,count)*instance_count;
+#endif
+    glDrawElementsInstanced(mode,count,type,indices,instance_count);
+}
+
+inline void GLCounter::UseProgram(GLuint program){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.program_bind_count++;
+#endif
+    glUseProgram(program);
+}
+
+inline void GLCounter::BindTexture(GLenum target,GLuint texture){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.texture_bind_count++;
+#endif
+    glBindTexture(target,texture);
+}
+
+inline void GLCounter::BindVertexArray(GLuint vao){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.vertex_array_bind_count++;
+#endif
+    glBindVertexArray(vao);
+}
+
+inline void GLCounter::BindBuffer(GLenum target,GLuint buffer){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.buffer_bind_count++;
+#endif
+    glBindBuffer(target,buffer);
+}
+
+inline void GLCounter::BufferData(GLenum target,GLsizeiptr size,const void* data,GLenum usage){
+#if !defined(DISABLE_GL_COUNTERS)
+    //orphaning without data uploads nothing
+    if (data != NULL){
+        m_counters.upload_count++;
+        m_counters.upload_size += (size_t)size;
+    }
+#endif
+    glBufferData(target,size,data,usage);
+}
+
+inline void GLCounter::BufferSubData(GLenum target,GLintptr offset,GLsizeiptr size,const void* data){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.upload_count++;
+    m_counters.upload_size += (size_t)size;
+#endif
+    glBufferSubData(target,offset,size,data);
+}
+
+inline void GLCounter::TexSubImage1D(GLenum target,GLint level,GLint x,GLsizei width,GLenum format,GLenum type,const void* pixels){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.upload_count++;
+    m_counters.upload_size += (size_t)width*GetPixelSize(format,type);
+#endif
+    glTexSubImage1D(target,level,x,width,format,type,pixels);
+}
+
+inline void GLCounter::TexSubImage2D(GLenum target,GLint level,GLint x,GLint y,GLsizei width,GLsizei height,GLenum format,GLenum type,const void* pixels){
+#if !defined(DISABLE_GL_COUNTERS)
+    //pixels may be an offset into a pixel unpack buffer,the bytes are transferred either way
+    m_counters.upload_count++;
+    m_counters.upload_size += (size_t)width*height*GetPixelSize(format,type);
+#endif
+    glTexSubImage2D(target,level,x,y,width,height,format,type,pixels);
+}
+
+inline void GLCounter::Uniform1i(GLint location,GLint v){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.uniform_count++;
+#endif
+    glUniform1i(location,v);
+}
+
+inline void GLCounter::Uniform1f(GLint location,GLfloat v){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.uniform_count++;
+#endif
+    glUniform1f(location,v);
+}
+
+inline void GLCounter::Uniform3fv(GLint location,GLsizei count,const GLfloat* v){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.uniform_count++;
+#endif
+    glUniform3fv(location,count,v);
+}
+
+inline void GLCounter::Uniform4fv(GLint location,GLsizei count,const GLfloat* v){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.uniform_count++;
+#endif
+    glUniform4fv(location,count,v);
+}
+
+inline void GLCounter::UniformMatrix4fv(GLint location,GLsizei count,GLboolean transpose,const GLfloat* v){
+#if !defined(DISABLE_GL_COUNTERS)
+    m_counters.uniform_count++;
+#endif
+    glUniformMatrix4fv(location,count,transpose,v);
+}
+
+inline size_t GLCounter::GetTriangleCount(GLenum mode,GLsizei count){
+    if (mode == GL_TRIANGLES){
+        return (size_t)count/3;
+    }else if ((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && count >= 3){
+        return (size_t)count-2;
+    }
+    return 0;
+}
+
+#endif // GL_COUNTER_HPP
@@ -0,0 +1,173 @@
+#include "input_log.hpp"
+
+#include <cstring>
+
+
+//file header,followed by event_count events
+static const char INPUT_LOG_MAGIC[4] = {'I','N','P','1'};
+struct InputLogHeader{
+    char magic[4];
+    uint32_t event_count;
+    uint64_t frame_count;
+    double dt;
+};
+
+
+InputLog* InputLog::m_instance = nullptr;
+
+InputLog::InputLog(Mode mode,const std::string& path,bool is_headless)
+    :m_mode(mode),m_is_headless(is_headless && mode == REPLAY_MODE),m_path(path),m_dt(0),m_frame(0),m_frame_count(0),m_next_event(0)
+{
+    if (m_mode == RECORD_MODE){
+        return;
+    }
+
+    //replay
+    std::FILE* fp = std::fopen(path.c_str(),"rb");
+    if (fp == NULL){
+        std::cout << "failed to open input log:" << path << "\n";
+        std::terminate();
+    }
+    InputLogHeader header;
+    bool is_valid = std::fread(&header,sizeof(header),1,fp) == 1 && std::memcmp(header.magic,INPUT_LOG_MAGIC,4) == 0;
+    if (is_valid){
+        m_events.resize(header.event_count);
+        is_valid = header.event_count == 0 || std::fread(m_events.data(),sizeof(Event),m_events.size(),fp) == m_events.size();
+    }
+    std::fclose(fp);
+    if (!is_valid){
+        std::cout << "broken input log:" << path << "\n";
+        std::terminate();
+    }
+    m_dt = header.dt;
+    m_frame_count = (size_t)header.frame_count;
+}
+
+InputLog::~InputLog(){
+}
+
+void InputLog::CreateInstance(Mode mode,const std::string& path,bool is_headless){
+    if (m_instance == nullptr){
+        m_instance = new InputLog(mode,path,is_headless);
+    }
+}
+
+void InputLog::DeleteInstance(){
+    if (m_instance != nullptr && m_instance->m_mode == RECORD_MODE){
+        m_instance->Write();
+    }
+    delete m_instance;
+    m_instance = nullptr;
+}
+
+InputLog* InputLog::GetInstance(){
+    return m_instance;
+}
+
+InputLog::Mode InputLog::GetMode() const{
+    return m_mode;
+}
+
+bool InputLog::IsHeadless() const{
+    return m_is_headless;
+}
+
+double InputLog::GetDT(double live_dt) const{
+    return (m_mode == REPLAY_MODE) ? m_dt : live_dt;
+}
+
+void InputLog::Record(const SDL_Event& event){
+    if (m_mode != RECORD_MODE){
+        return;
+    }
+    Event e;
+    e.frame = (uint32_t)m_frame;
+    e.timestamp = event.common.timestamp;
+    e.type = event.type;
+    e.values[0] = 0;
+    e.values[1] = 0;
+    if (event.type == SDL_MOUSEMOTION){
+        e.values[0] = event.motion.xrel;
+        e.values[1] = event.motion.yrel;
+    }else if (event.type == SDL_MOUSEWHEEL){
+        e.values[0] = event.wheel.x;
+        e.values[1] = event.wheel.y;
+    }else if (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP){
+        e.values[0] = event.button.button;
+    }else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP){
+        e.values[0] = event.key.keysym.sym;
+    }else{
+        //not read by the scene
+        return;
+    }
+    m_events.push_back(e);
+}
+
+bool InputLog::Replay(SDL_Event* event){
+    if (m_mode != REPLAY_MODE || m_next_event == m_events.size() || m_events[m_next_event].frame != m_frame){
+        return false;
+    }
+    const Event& e = m_events[m_next_event++];
+    std::memset(event,0,sizeof(SDL_Event));
+    event->type = e.type;
+    event->common.timestamp = e.timestamp;
+    if (e.type == SDL_MOUSEMOTION){
+        event->motion.xrel = e.values[0];
+        event->motion.yrel = e.values[1];
+    }else if (e.type == SDL_MOUSEWHEEL){
+        event->wheel.x = e.values[0];
+        event->wheel.y = e.values[1];
+    }else if (e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_MOUSEBUTTONUP){
+        event->button.button = (Uint8)e.values[0];
+    }else{
+        event->key.keysym.sym = (SDL_Keycode)e.values[0];
+    }
+    return true;
+}
+
+void InputLog::EndFrame(double dt){
+    if (m_mode == RECORD_MODE){
+        m_dt = dt;
+        m_frame_count = m_frame+1;
+    }else{
+        //events the frame did not take are dropped,so later frames stay in step
+        while (m_next_event < m_events.size() && m_events[m_next_event].frame <= m_frame){
+            m_next_event++;
+        }
+    }
+    m_frame++;
+}
+
+bool InputLog::IsFinished() const{
+    return m_mode == REPLAY_MODE && m_frame >= m_frame_count;
+}
+
+size_t InputLog::GetFrameCount() const{
+    return m_frame_count;
+}
+
+size_t InputLog::GetEventCount() const{
+    return m_events.size();
+}
+
+bool InputLog::Write() const{
+    std::FILE* fp = std::fopen(m_path.c_str(),"wb");
+    if (fp == NULL){
+        std::cout << "failed to write input log:" << m_path << "\n";
+        return false;
+    }
+    InputLogHeader header;
+    std::memcpy(header.magic,INPUT_LOG_MAGIC,4);
+    header.event_count = (uint32_t)m_events.size();
+    header.frame_count = m_frame_count;
+    header.dt = m_dt;
+    bool is_written = std::fwrite(&header,sizeof(header),1,fp) == 1;
+    if (is_written && !m_events.empty()){
+        is_written = std::fwrite(m_events.data(),sizeof(Event),m_events.size(),fp) == m_events.size();
+    }
+    is_written = (std::fclose(fp) == 0) && is_written;
+    if (!is_written){
+        std::cout << "failed to write input log:" << m_path << "\n";
+    }
+    return is_written;
+}
@@ -0,0 +1,68 @@
+#ifndef INPUT_LOG_HPP
+#define INPUT_LOG_HPP
+
+#include "library.hpp"
+
+#include <SDL2/SDL.h>
+
+
+//binary log of the input events handled by the scene and the fixed time step,for reproducible runs
+//record mode appends every handled event with the index of its frame
+//replay mode hands the recorded events back at the same frame indices and the recorded time step,
+//so the animation state of every frame is the same as in the recorded run and live input is ignored
+//headless replay hides the window and runs without frame rate limit,for benchmarks
+
+class InputLog{
+public:
+    enum Mode{
+        RECORD_MODE,
+        REPLAY_MODE
+    };
+    //fields of SDL_Event the scene reads,20 bytes
+    struct Event{
+        uint32_t frame;
+        uint32_t timestamp;//SDL_GetTicks ms of the recording,for reference
+        uint32_t type;
+        int32_t values[2];//xrel,yrel / wheel x,y / button / key sym
+    };
+private:
+    static InputLog* m_instance;
+
+    Mode m_mode;
+    bool m_is_headless;
+    std::string m_path;
+    double m_dt;
+    size_t m_frame;      //frame being handled
+    size_t m_frame_count;//recorded frames,replay ends there
+    std::vector<Event> m_events;
+    size_t m_next_event;//replay
+private:
+    InputLog(Mode mode,const std::string& path,bool is_headless);
+    ~InputLog();
+public:
+    //singleton,replay reads the whole log and terminates if it is missing or broken
+    static void CreateInstance(Mode mode,const std::string& path,bool is_headless);
+    static void DeleteInstance();//record mode writes the log
+    static InputLog* GetInstance();//nullptr if not created
+
+    InputLog::Mode GetMode() const;
+    bool IsHeadless() const;
+    //recorded time step in replay mode,live_dt otherwise
+    double GetDT(double live_dt) const;
+
+    //record mode,event is handed to the scene in the current frame
+    void Record(const SDL_Event& event);
+    //replay mode,next recorded event of the current frame,false when there is none left
+    bool Replay(SDL_Event* event);
+    //dt is the time step the frame was updated with
+    void EndFrame(double dt);
+    //replay mode,every recorded frame has been played
+    bool IsFinished() const;
+
+    size_t GetFrameCount() const;
+    size_t GetEventCount() const;
+private:
+    bool Write() const;
+};
+
+#endif // INPUT_LOG_HPP
@@ -578,6 +578,10 @@ const JSON::Node& JSON::operator[](size_t index) const{
     return (*m_root)[index];
 }
 
+bool JSON::HasMember(const std::string& key) const{
+    return m_root->HasMember(key);
+}
+
 
 JSON::Node::Node(){
     type = EMPTY_NODE;
@@ -604,6 +608,9 @@ const JSON::Node& JSON::Node::operator[](const std::string& key) const{
 size_t JSON::Node::GetMemberCount() const{
     return members.size();
 }
+bool JSON::Node::HasMember(const std::string& key) const{
+    return members.count(key) != 0;
+}
 
 const JSON::Node& JSON::Node::operator[](size_t index) const{
     if (index >= elements.size()){
@@ -52,6 +52,7 @@ public:
         //for object
         const Node& operator[](const std::string& key) const;
         size_t GetMemberCount() const;
+        bool HasMember(const std::string& key) const;
         
         //for array
         const Node& operator[](size_t index) const;
@@ -72,6 +73,7 @@ public:
     JSON(const std::string& path);
     const JSON::Node& operator[](const std::string& key) const;
     const JSON::Node& operator[](size_t index) const;
+    bool HasMember(const std::string& key) const;
 };
 
 
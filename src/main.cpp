@@ -1,7 +1,19 @@
 #include "library.hpp"
 #include "resource.hpp"
+#include "skinning.hpp"
 #include "camera.hpp"
 #include "json.hpp"
+#include "thread_pool.hpp"
+#include "pose_cache.hpp"
+#include "crowd.hpp"
+#include "vertex_animation.hpp"
+#include "fbx_session.hpp"
+#include "texture_loader.hpp"
+#include "program_cache.hpp"
+#include "frame_profiler.hpp"
+#include "trace.hpp"
+#include "gl_counter.hpp"
+#include "input_log.hpp"
 
 #include <OpenGL/gl3.h>
 #include <SDL2/SDL.h>
@@ -98,13 +110,13 @@ void Square::Draw(const Camera& camera,const Shader& shader) const{
     //bind camera
     const mat4& view = camera.GetViewMatrix();
     const mat4& perspective = camera.GetPerspectiveMatrix();
-    glUniformMatrix4fv(shader.GetUniformLocation("view"),1,GL_FALSE,(const GLfloat*)&view);
-    glUniformMatrix4fv(shader.GetUniformLocation("perspective"),1,GL_FALSE,(const GLfloat*)&perspective);
+    GLCounter::UniformMatrix4fv(shader.GetUniformLocation("view"),1,GL_FALSE,(const GLfloat*)&view);
+    GLCounter::UniformMatrix4fv(shader.GetUniformLocation("perspective"),1,GL_FALSE,(const GLfloat*)&perspective);
     
     //draw
-    glBindVertexArray(m_vao);
-    glDrawElements(GL_TRIANGLES,6,GL_UNSIGNED_INT,0);
-    glBindVertexArray(0);
+    GLCounter::BindVertexArray(m_vao);
+    GLCounter::DrawElements(GL_TRIANGLES,6,GL_UNSIGNED_INT,0);
+    GLCounter::BindVertexArray(0);
     
     //deactivate shader pass
     shader.UnBind();
@@ -152,65 +164,302 @@ uint64_t StopWatch::GetElapsedTime(){
 
 
 
+//instances per draw of the vertex animation path,size of instances[] in vat.vert
+static const size_t VAT_INSTANCE_BATCH = 64;
+
+//fbx files imported at once,every import holds parsed scene data in memory
+static const size_t FBX_IMPORT_WORKER_COUNT = 4;
+
+//projected bounding sphere radius in ndc below which lod i+1 is used
+static const FLOAT LOD_SCREEN_SIZES[] = {0.4,0.2,0.1,0.05,0.025};
+static const size_t LOD_SCREEN_SIZE_COUNT = sizeof(LOD_SCREEN_SIZES)/sizeof(FLOAT);
+
+//relative margin around lod thresholds,so that a mesh near a threshold does not switch every frame
+static const FLOAT LOD_HYSTERESIS = 0.1;
+
+//png decodes running at once
+static const size_t TEXTURE_DECODE_WORKER_COUNT = 4;
+
+//bytes of texture levels streamed per frame
+static const size_t TEXTURE_UPLOAD_BYTE_BUDGET = 4*1024*1024;
+
+//packed clip database in the animation directory
+static const char* ANIMATION_DATABASE_FILE_NAME = "animation.adb";
+
+//linked programs of previous runs
+static const char* PROGRAM_CACHE_PATH = "./shader/program.cache";
+
+//frames in the rolling statistics of the frame profiler
+static const size_t FRAME_PROFILER_WINDOW_SIZE = 600;
+
+//updates timed per bone lod by the startup benchmark
+static const size_t BONE_LOD_BENCHMARK_UPDATE_COUNT = 1000;
+
+//frames of crowd render time queries in flight on the gpu
+static const size_t RENDER_QUERY_FRAME_COUNT = 4;
+
 class Scene{
+public:
+    //gpu time of one crowd render path,measured with GL_TIME_ELAPSED
+    struct RenderPathStatistics{
+        size_t frame_count;
+        size_t instance_count;
+        uint64_t time;//ns
+    };
 private:
     bool m_is_skeletal;
+    SkinningMode m_skinning_mode;
+    VertexFormat m_vertex_format;
+    VertexLayout m_vertex_layout;
     const Shader* m_mesh_shader;
     const Shader* m_square_shader;
-    const Mesh* m_mesh;
+    Mesh* m_mesh;
     const Square* m_square;
+    AnimationStateGraph* m_animation_state_graph;
     AnimationController* m_animation_controller;
+    PoseCache* m_pose_cache;
+    Crowd* m_crowd;
     Camera* m_camera;
+    double m_time;
+    
+    //far crowd instances
+    VertexAnimationTexture* m_vertex_animation;
+    const Shader* m_vat_shader;
+    FLOAT m_vat_distance;
+    
+    //render throughput of skeletal and vertex animation path
+    //a ring of query pairs,a frame is read once its queries are available,so reading never waits for the gpu
+    std::vector<GLuint> m_time_queries;          //size = 2*ring size
+    std::vector<size_t> m_query_instance_counts; //size = 2*ring size
+    std::vector<bool> m_is_query_issued;         //size = ring size
+    size_t m_query_frame;                        //frames rendered with queries
+    size_t m_dropped_query_count;                //frames lost because the gpu was a whole ring behind
+    RenderPathStatistics m_render_statistics[2];
+    
+    //far instances of the frame grouped by lod,size = lod_count,kept across frames
+    std::vector<std::vector<vec4>> m_far_instances;
+    
+    //lod of the scene mesh and crowd instances,selected in Update and read by Render
+    size_t m_mesh_lod;
+    std::vector<size_t> m_crowd_lods;
+    
+    //submitted triangles
+    size_t m_frame_count;
+    size_t m_triangle_count;
+    std::vector<size_t> m_lod_draw_counts;//size = lod_count,draws of each lod
 public:
     Scene(const std::string& asset_dir_path);
     ~Scene();
     void HandleEvent(const SDL_Event& event);
     void Update(double dt);
     void Render();
+private:
+    size_t SelectLOD(const mat4& world,size_t lod) const;
+    void RenderMesh(const Skeleton* skeleton,const mat4& world,size_t lod);
+    void RenderVertexAnimation(const std::vector<vec4>& instances,size_t lod);
+    //reads every finished frame of the ring,oldest first,blocking waits for the unfinished ones
+    void ReadRenderTime(bool is_blocking);
 };
 
 Scene::Scene(const std::string& asset_dir_path){
     //create resource manager
     ResourceManager::CreateInstance();
+    
+    //create worker threads
+    ThreadPool::CreateInstance(0);
+    
+    //create fbx import session
+    FBXImportSession::CreateInstance(FBX_IMPORT_WORKER_COUNT);
+    
+    //create texture loader
+    TextureLoader::CreateInstance(TEXTURE_DECODE_WORKER_COUNT);
+    
+    //create program binary cache
+    ProgramCache::CreateInstance(PROGRAM_CACHE_PATH);
        
     //load scene file
     JSON json(asset_dir_path+"/scene.json");
+    
+    //create trace,zones from here on are recorded
+    if (json.HasMember("trace")){
+        Trace::CreateInstance(asset_dir_path+"/"+json["trace"].GetString());
+        TRACE_THREAD_NAME("main");
+    }
+    TRACE_ZONE("Scene::Scene");
+    
+    //create frame profiler
+    {
+        size_t window_size = FRAME_PROFILER_WINDOW_SIZE;
+        std::string dump_path;
+        if (json.HasMember("profiler")){
+            const JSON::Node& profiler_node = json["profiler"];
+            if (profiler_node.HasMember("window")){
+                window_size = (size_t)profiler_node["window"].GetNumber();
+            }
+            if (profiler_node.HasMember("dump")){
+                dump_path = asset_dir_path+"/"+profiler_node["dump"].GetString();
+            }
+        }
+        FrameProfiler::CreateInstance(window_size,dump_path);
+    }
+    
+    //create input log
+    if (json.HasMember("input")){
+        const JSON::Node& input_node = json["input"];
+        bool is_headless = input_node.HasMember("headless") && input_node["headless"].GetBoolean();
+        if (input_node.HasMember("replay")){
+            InputLog::CreateInstance(InputLog::REPLAY_MODE,asset_dir_path+"/"+input_node["replay"].GetString(),is_headless);
+        }else if (input_node.HasMember("record")){
+            InputLog::CreateInstance(InputLog::RECORD_MODE,asset_dir_path+"/"+input_node["record"].GetString(),false);
+        }
+    }
+    
+    //skinning mode
+    m_skinning_mode = GPU_SKINNING;
+    if (json["mesh"].HasMember("skinning") && json["mesh"]["skinning"].GetString() == "cpu"){
+        m_skinning_mode = CPU_SKINNING;
+    }
+    
+    //vertex format
+    m_vertex_format = FLOAT_VERTEX;
+    if (json["mesh"].HasMember("vertex_format") && json["mesh"]["vertex_format"].GetString() == "quantized"){
+        m_vertex_format = QUANTIZED_VERTEX;
+    }
+    
+    //vertex layout
+    m_vertex_layout = INTERLEAVED_LAYOUT;
+    if (json["mesh"].HasMember("vertex_layout")){
+        const std::string& layout = json["mesh"]["vertex_layout"].GetString();
+        if (layout == "split"){
+            m_vertex_layout = SPLIT_LAYOUT;
+        }else if (layout == "position_split"){
+            m_vertex_layout = POSITION_SPLIT_LAYOUT;
+        }
+    }
        
-    //load shader
+    //shader variants
+    //cpu skinning writes skinned xyz,normal into vbo,so the non skeletal variant is used
+    //cpu skinning keeps float xyz,normal and only uv is quantized,which needs no decode
     const std::string& color = json["mesh"]["color"].GetString();
     m_is_skeletal = json["mesh"]["is_skeletal"].GetBoolean();
-    if (m_is_skeletal){
-        if (color == "texture"){
-            m_mesh_shader = ResourceManager::GetInstance()->LoadShader("./shader/skeletal.vert","./shader/texture.frag");
-        }else if (color == "uv"){
-            m_mesh_shader = ResourceManager::GetInstance()->LoadShader("./shader/skeletal.vert","./shader/uv.frag");
-        }else if (color == "normal"){
-            m_mesh_shader = ResourceManager::GetInstance()->LoadShader("./shader/skeletal.vert","./shader/normal.frag");
-        }
-    }else{
-        if (color == "texture"){
-            m_mesh_shader = ResourceManager::GetInstance()->LoadShader("./shader/non_skeletal.vert","./shader/texture.frag");
-        }else if (color == "uv"){
-            m_mesh_shader = ResourceManager::GetInstance()->LoadShader("./shader/non_skeletal.vert","./shader/uv.frag");
-        }else if (color == "normal"){
-            m_mesh_shader = ResourceManager::GetInstance()->LoadShader("./shader/non_skeletal.vert","./shader/normal.frag");
+    std::string color_define;
+    if (color == "texture"){
+        color_define = "COLOR_TEXTURE";
+    }else if (color == "uv"){
+        color_define = "COLOR_UV";
+    }else if (color == "normal"){
+        color_define = "COLOR_NORMAL";
+    }
+    ShaderVariant mesh_variant;
+    mesh_variant.vs_path = "./shader/mesh.vert";
+    mesh_variant.fs_path = "./shader/mesh.frag";
+    if (m_is_skeletal && m_skinning_mode == GPU_SKINNING){
+        mesh_variant.defines.push_back("SKELETAL");
+    }
+    if (m_vertex_format == QUANTIZED_VERTEX && !(m_is_skeletal && m_skinning_mode == CPU_SKINNING)){
+        mesh_variant.defines.push_back("QUANTIZED");
+    }
+    mesh_variant.defines.push_back(color_define);
+    ShaderVariant vat_variant;
+    vat_variant.vs_path = "./shader/vat.vert";
+    vat_variant.fs_path = "./shader/mesh.frag";
+    vat_variant.defines.push_back(color_define);
+    ShaderVariant square_variant;
+    square_variant.vs_path = "./shader/square.vert";
+    square_variant.fs_path = "./shader/square.frag";
+    
+    //every variant the scene can draw with is compiled before the mesh import,so the driver works on them meanwhile
+    {
+        std::vector<ShaderVariant> variants;
+        variants.push_back(mesh_variant);
+        variants.push_back(square_variant);
+        if (json.HasMember("crowd") && json["crowd"].HasMember("vat_distance") && m_skinning_mode == GPU_SKINNING){
+            variants.push_back(vat_variant);
         }
+        auto t0 = std::chrono::steady_clock::now();
+        ResourceManager::GetInstance()->PrecompileShaders(variants);
+        auto t1 = std::chrono::steady_clock::now();
+        ProgramCache::Statistics statistics = ProgramCache::GetInstance()->GetStatistics();
+        std::cout << "shader:" << variants.size() << " programs," << statistics.hit_count << " from binary cache,";
+        std::cout << std::chrono::duration<double>(t1-t0).count()*1000 << "ms" << "\n";
     }
-    m_square_shader = ResourceManager::GetInstance()->LoadShader("./shader/square.vert","./shader/square.frag");
+    m_mesh_shader = ResourceManager::GetInstance()->LoadShader(mesh_variant.vs_path,mesh_variant.fs_path,mesh_variant.defines);
+    m_square_shader = ResourceManager::GetInstance()->LoadShader(square_variant.vs_path,square_variant.fs_path,square_variant.defines);
     
     //load mesh
     const std::string& mesh_file_path = asset_dir_path+"/mesh/"+json["mesh"]["filename"].GetString();
-    m_mesh = ResourceManager::GetInstance()->LoadMesh(asset_dir_path,mesh_file_path,m_mesh_shader,m_is_skeletal);
+    MeshImportSettings settings;
+    settings.is_skeletal = m_is_skeletal;
+    settings.skinning_mode = m_skinning_mode;
+    settings.vertex_format = m_vertex_format;
+    settings.vertex_layout = m_vertex_layout;
+    settings.is_optimized = json["mesh"].HasMember("optimize") ? json["mesh"]["optimize"].GetBoolean() : true;
+    settings.is_split_per_material = json["mesh"].HasMember("split_per_material") ? json["mesh"]["split_per_material"].GetBoolean() : false;
+    settings.lod_count = json["mesh"].HasMember("lod_count") ? (size_t)json["mesh"]["lod_count"].GetNumber() : 4;
+    settings.lod_count = std::max(std::min(settings.lod_count,LOD_SCREEN_SIZE_COUNT+1),(size_t)1);
+    m_mesh = ResourceManager::GetInstance()->LoadMesh(asset_dir_path,mesh_file_path,m_mesh_shader,settings);
+    
+    //vertex cache report
+    for (size_t i = 0;i < m_mesh->GetSubMeshCount();i++){
+        const Mesh::OptimizationReport& report = m_mesh->GetOptimizationReport(i);
+        std::cout << "sub mesh " << i << ":" << report.vertex_count << " vertices," << report.triangle_count << " triangles,";
+        std::cout << m_mesh->GetSubMesh(i)->GetDrawRangeCount() << " draw ranges,";
+        std::cout << "acmr " << report.before.acmr << " -> " << report.after.acmr << ",";
+        std::cout << "atvr " << report.before.atvr << " -> " << report.after.atvr << "\n";
+        std::cout << "sub mesh " << i << " lod triangles:";
+        for (size_t j = 0;j < report.lod_triangle_counts.size();j++){
+            std::cout << " " << report.lod_triangle_counts[j];
+        }
+        std::cout << "," << report.simplification_time*1000 << "ms" << "\n";
+    }
+    
+    //vertex buffer report
+    size_t vertex_count = 0;
+    for (size_t i = 0;i < m_mesh->GetSubMeshCount();i++){
+        vertex_count += m_mesh->GetSubMesh(i)->GetVertexCount();
+    }
+    std::cout << "vertex buffer size:" << m_mesh->GetVertexBufferSize()/1024 << "KB,";
+    std::cout << ((vertex_count != 0) ? m_mesh->GetVertexBufferSize()/vertex_count : 0) << "bytes/vertex" << "\n";
+    if (m_mesh->GetSubMeshCount() != 0){
+        const std::vector<VertexLayoutBuilder::Stream>& streams = m_mesh->GetSubMesh(0)->GetStreams();
+        std::cout << "vertex layout:" << streams.size() << " streams,stride";
+        for (size_t i = 0;i < streams.size();i++){
+            std::cout << " " << streams[i].stride;
+        }
+        std::cout << "\n";
+    }
+    if (m_vertex_format == QUANTIZED_VERTEX){
+        QuantizationError error = m_mesh->GetQuantizationError();
+        std::cout << "quantization max error xyz:" << error.xyz << ",normal:" << error.normal << "deg,";
+        std::cout << "uv:" << error.uv << ",bone weight:" << error.bone_weight << "\n";
+    }
     
     //create square
     m_square = new Square();
     
     //create animation controller
+    m_animation_state_graph = nullptr;
     m_animation_controller = nullptr;
+    m_pose_cache = nullptr;
+    m_crowd = nullptr;
+    m_vertex_animation = nullptr;
+    m_vat_shader = nullptr;
+    m_vat_distance = 0;
     if (m_is_skeletal){
+        //import animations of all states at once
+        size_t state_count = json["animation_controller"]["states"].GetElementCount();
+        std::vector<std::string> animation_paths;
+        for (size_t i = 0;i < state_count;i++){
+            animation_paths.push_back(asset_dir_path+"/animation/"+json["animation_controller"]["states"][i]["animation"].GetString());
+        }
+        //clips found in the database are mapped,the others are imported and written back to it
+        const std::string& animation_database_path = asset_dir_path+"/animation/"+ANIMATION_DATABASE_FILE_NAME;
+        ResourceManager::GetInstance()->OpenAnimationDatabase(animation_database_path);
+        ResourceManager::GetInstance()->LoadAnimations(animation_paths);
+        ResourceManager::GetInstance()->SaveAnimationDatabase(animation_database_path);
+        
         //create animation state
         std::map<std::string,AnimationController::State> states;
-        size_t state_count = json["animation_controller"]["states"].GetElementCount();
         for (size_t i = 0;i < state_count;i++){
             //state node
             const JSON::Node& state_node = json["animation_controller"]["states"][i];
@@ -264,23 +513,259 @@ Scene::Scene(const std::string& asset_dir_path){
         //entry state id
         const std::string& entry_state_id = json["animation_controller"]["entry_state_id"].GetString();
         
+        //compile state machine
+        m_animation_state_graph = new AnimationStateGraph(states,entry_state_id);
+        
         //create animation controller
-        m_animation_controller = new AnimationController(m_mesh->GetSkeleton(),states,entry_state_id);
+        m_animation_controller = new AnimationController(m_mesh->GetSkeleton(),m_animation_state_graph);
+        
+        //check simd kernel against scalar reference,with random palettes and with the entry pose of the mesh
+        //opt in,only meaningful when the scene is skinned on cpu
+        bool is_skinning_verified = json["mesh"].HasMember("verify_skinning") && json["mesh"]["verify_skinning"].GetBoolean();
+        if (is_skinning_verified && m_skinning_mode == CPU_SKINNING){
+            CPUSkinning::SelfTest();
+            m_animation_controller->UpdateAnimation(0);
+            FLOAT error = m_mesh->VerifySkinning();
+            std::cout << "cpu skinning max error:" << error << "\n";
+            if (error > CPUSkinning::GetTolerance()){
+                std::cout << "cpu skinning differs from the scalar reference,tolerance " << CPUSkinning::GetTolerance() << "\n";
+                std::terminate();
+            }
+        }
+        
+        //per instance update cost of each bone lod,sample+blend+upload of an instance of the skeleton
+        //opt in,it delays the first frame
+        if (json["mesh"].HasMember("benchmark_bone_lod") && json["mesh"]["benchmark_bone_lod"].GetBoolean()){
+            Skeleton* skeleton = Skeleton::CreateInstance(*m_mesh->GetSkeleton());
+            AnimationController* controller = new AnimationController(skeleton,m_animation_state_graph);
+            for (size_t i = 0;i < skeleton->GetLODCount();i++){
+                skeleton->SetLOD(i);
+                auto t0 = std::chrono::steady_clock::now();
+                for (size_t j = 0;j < BONE_LOD_BENCHMARK_UPDATE_COUNT;j++){
+                    controller->UpdateAnimation(1.0/60);
+                }
+                auto t1 = std::chrono::steady_clock::now();
+                double time = std::chrono::duration_cast<std::chrono::nanoseconds>(t1-t0).count()*1e-3/BONE_LOD_BENCHMARK_UPDATE_COUNT;
+                std::cout << "bone lod " << i << ":" << skeleton->GetLODBones(i).size() << "/" << skeleton->GetBoneCount() << " bones," << time << "us per update" << "\n";
+            }
+            delete controller;
+            delete skeleton;
+        }
+        
+        //create crowd
+        //crowd instances are skinned on gpu,so cpu skinning scenes have no crowd
+        if (json.HasMember("crowd") && m_skinning_mode == GPU_SKINNING){
+            const JSON::Node& crowd_node = json["crowd"];
+            size_t count = (size_t)crowd_node["count"].GetNumber();
+            FLOAT spacing = crowd_node["spacing"].GetNumber();
+            size_t phase_count = crowd_node.HasMember("phase_count") ? (size_t)crowd_node["phase_count"].GetNumber() : 1;
+            bool is_pose_cache = crowd_node.HasMember("pose_cache") ? crowd_node["pose_cache"].GetBoolean() : true;
+            double sample_rate = crowd_node.HasMember("sample_rate") ? crowd_node["sample_rate"].GetNumber() : 30;
+            
+            //pose cache is shared by the scene mesh and every crowd instance
+            if (is_pose_cache){
+                m_pose_cache = new PoseCache();
+                m_animation_controller->SetPoseCache(m_pose_cache,sample_rate);
+            }
+            m_crowd = new Crowd(m_mesh,m_animation_state_graph,count,spacing,phase_count,m_pose_cache,sample_rate);
+            
+            //far instances play the entry animation from a vertex animation texture
+            if (crowd_node.HasMember("vat_distance")){
+                m_vat_distance = crowd_node["vat_distance"].GetNumber();
+                double vat_frame_rate = crowd_node.HasMember("vat_frame_rate") ? crowd_node["vat_frame_rate"].GetNumber() : 30;
+                
+                //entry animation file
+                std::string entry_animation_file;
+                for (size_t i = 0;i < state_count;i++){
+                    if (json["animation_controller"]["states"][i]["id"].GetString() == entry_state_id){
+                        entry_animation_file = json["animation_controller"]["states"][i]["animation"].GetString();
+                    }
+                }
+                
+                //bake or load cache
+                const Animation* animation = m_animation_state_graph->GetState(m_animation_state_graph->GetEntryState()).animation;
+                const std::string& cache_path = asset_dir_path+"/animation/"+entry_animation_file+".vat";
+                m_vertex_animation = new VertexAnimationTexture(*m_mesh,*animation,vat_frame_rate,cache_path);
+                std::cout << "vertex animation texture:" << m_vertex_animation->GetVertexCount() << " vertices x " << m_vertex_animation->GetFrameCount() << " frames" << "\n";
+                std::cout << "vertex animation texture size:" << m_vertex_animation->GetByteSize()/1024 << "KB" << "\n";
+                if (m_vertex_animation->GetBakeTime() != 0){
+                    std::cout << "vertex animation bake time:" << m_vertex_animation->GetBakeTime()*1000 << "ms" << "\n";
+                }
+                
+                //shader
+                m_vat_shader = ResourceManager::GetInstance()->LoadShader(vat_variant.vs_path,vat_variant.fs_path,vat_variant.defines);
+            }
+        }
     }
     
+    //fbx import report
+    FBXImportSession* session = FBXImportSession::GetInstance();
+    std::cout << "fbx import:" << session->GetImportCount() << " files," << session->GetImportTime()*1000 << "ms" << "\n";
+    
     //create camera
     m_camera = new Camera();
     m_camera->SetPerspectiveParameters(1,1000,45,1200.0/800);
     m_camera->SetPosition(vec3({5,0,0.5}));
     m_camera->SetTargetY(0.5);
+    
+    //render time query
+    m_time = 0;
+    m_time_queries.resize(2*RENDER_QUERY_FRAME_COUNT);
+    glGenQueries((GLsizei)m_time_queries.size(),m_time_queries.data());
+    m_query_instance_counts.assign(2*RENDER_QUERY_FRAME_COUNT,0);
+    m_is_query_issued.assign(RENDER_QUERY_FRAME_COUNT,false);
+    m_query_frame = 0;
+    m_dropped_query_count = 0;
+    for (size_t i = 0;i < 2;i++){
+        m_render_statistics[i].frame_count = 0;
+        m_render_statistics[i].instance_count = 0;
+        m_render_statistics[i].time = 0;
+    }
+    
+    //lod
+    m_mesh_lod = 0;
+    m_crowd_lods.assign((m_crowd != nullptr) ? m_crowd->GetInstanceCount() : 0,0);
+    m_frame_count = 0;
+    m_triangle_count = 0;
+    m_lod_draw_counts.assign(m_mesh->GetLODCount(),0);
+    m_far_instances.resize(m_mesh->GetLODCount());
 }
 
 
 Scene::~Scene(){
+    //frame time report
+    FrameProfiler* profiler = FrameProfiler::GetInstance();
+    for (int i = 0;i < FrameProfiler::ZONE_COUNT;i++){
+        FrameProfiler::Statistics statistics = profiler->GetStatistics((FrameProfiler::Zone)i);
+        std::cout << "frame " << FrameProfiler::GetZoneName((FrameProfiler::Zone)i) << ":";
+        std::cout << "min " << statistics.min << "ms,avg " << statistics.average << "ms,p99 " << statistics.p99 << "ms";
+        std::cout << " over " << statistics.sample_count << " frames" << "\n";
+    }
+    if (profiler->GetDroppedCount() != 0){
+        std::cout << "frame gpu time dropped:" << profiler->GetDroppedCount() << " frames" << "\n";
+    }
+    
+    //input log report
+    InputLog* input_log = InputLog::GetInstance();
+    if (input_log != nullptr){
+        std::cout << ((input_log->GetMode() == InputLog::RECORD_MODE) ? "input recorded:" : "input replayed:");
+        std::cout << input_log->GetFrameCount() << " frames," << input_log->GetEventCount() << " events" << "\n";
+    }
+    
+    //gl call report,averaged over every frame
+    if (GLCounter::IsEnabled() && GLCounter::GetFrameCount() != 0){
+        const GLCounter::Counters& counters = GLCounter::GetTotalCounters();
+        double frame_count = (double)GLCounter::GetFrameCount();
+        std::cout << "gl calls per frame:";
+        std::cout << counters.draw_count/frame_count << " draws,";
+        std::cout << counters.instance_count/frame_count << " instances,";
+        std::cout << counters.triangle_count/frame_count << " triangles" << "\n";
+        std::cout << "gl state changes per frame:";
+        std::cout << counters.program_bind_count/frame_count << " programs,";
+        std::cout << counters.texture_bind_count/frame_count << " textures,";
+        std::cout << counters.vertex_array_bind_count/frame_count << " vertex arrays,";
+        std::cout << counters.buffer_bind_count/frame_count << " buffers,";
+        std::cout << counters.uniform_count/frame_count << " uniforms" << "\n";
+        std::cout << "gl uploads per frame:";
+        std::cout << counters.upload_count/frame_count << " calls,";
+        std::cout << counters.upload_size/frame_count/1024 << "KB" << "\n";
+    }
+    
+    //pose cache report
+    if (m_pose_cache != nullptr){
+        PoseCache::Statistics statistics = m_pose_cache->GetStatistics();
+        size_t request_count = statistics.hit_count+statistics.miss_count;
+        std::cout << "pose cache hit ratio:" << ((request_count != 0) ? (double)statistics.hit_count/request_count : 0) << "\n";
+        std::cout << "pose cache sampling time:" << statistics.sample_time*1000 << "ms" << "\n";
+        std::cout << "pose cache saved sampling time:" << statistics.saved_time*1000 << "ms" << "\n";
+    }
+    
+    //render throughput report
+    if (m_crowd != nullptr){
+        ReadRenderTime(true);
+        const char* names[2] = {"skeletal","vertex animation"};
+        for (size_t i = 0;i < 2;i++){
+            const RenderPathStatistics& statistics = m_render_statistics[i];
+            if (statistics.instance_count == 0){
+                continue;
+            }
+            std::cout << names[i] << " path:" << statistics.instance_count/statistics.frame_count << " instances/frame,";
+            std::cout << statistics.time/1.0e6/statistics.frame_count << "ms/frame,";
+            std::cout << (double)statistics.time/statistics.instance_count << "ns/instance" << "\n";
+        }
+        if (m_dropped_query_count != 0){
+            std::cout << "render path time dropped:" << m_dropped_query_count << " frames" << "\n";
+        }
+    }
+    glDeleteQueries((GLsizei)m_time_queries.size(),m_time_queries.data());
+    
+    //texture loader report
+    TextureLoader::Statistics texture_statistics = TextureLoader::GetInstance()->GetStatistics();
+    std::cout << "texture decode:" << texture_statistics.decode_count << " files," << texture_statistics.joined_count << " joined requests,";
+    std::cout << texture_statistics.decode_time*1000 << "ms on workers" << "\n";
+    std::cout << "texture upload:" << texture_statistics.upload_count << " files," << texture_statistics.upload_time*1000 << "ms,";
+    std::cout << "max " << texture_statistics.max_upload_time*1000 << "ms/frame,";
+    std::cout << texture_statistics.level_upload_count << " levels," << texture_statistics.upload_size/1024 << "KB streamed,";
+    std::cout << texture_statistics.stall_count << " stalls" << "\n";
+    std::cout << "cooked texture:" << texture_statistics.cooked_count << "/" << texture_statistics.decode_count << " files,";
+    std::cout << texture_statistics.saved_time*1000 << "ms decode saved,";
+    std::cout << "mip overhead " << texture_statistics.mip_size/1024 << "/" << texture_statistics.base_size/1024 << "KB";
+    if (texture_statistics.base_size != 0){
+        std::cout << "(" << 100.0*texture_statistics.mip_size/texture_statistics.base_size << "%)";
+    }
+    std::cout << "\n";
+    
+    //animation database report
+    const AnimationDatabase* animation_database = ResourceManager::GetInstance()->GetAnimationDatabase();
+    if (animation_database != nullptr && animation_database->GetClipCount() != 0){
+        AnimationDatabase::Residency residency = animation_database->GetResidency();
+        std::cout << "animation database:" << animation_database->GetClipCount() << " clips,";
+        std::cout << residency.resident_size/1024 << "/" << residency.mapped_size/1024 << "KB resident,";
+        std::cout << residency.resident_clip_count << " clips fully resident,";
+        std::cout << residency.prefetch_count << " prefetches" << "\n";
+    }
+    
+    //update rate report
+    if (m_crowd != nullptr){
+        Crowd::Statistics statistics = m_crowd->GetStatistics();
+        if (statistics.frame_count != 0){
+            std::cout << "crowd update tiers instances/frame:";
+            for (size_t i = 0;i < Crowd::UPDATE_TIER_COUNT;i++){
+                std::cout << " 1/" << Crowd::UPDATE_INTERVALS[i] << "=" << (double)statistics.tier_instance_counts[i]/statistics.frame_count;
+            }
+            std::cout << "\n";
+            std::cout << "crowd updates:" << (double)statistics.update_count/statistics.frame_count << "/frame,";
+            std::cout << "held poses:" << (double)statistics.skip_count/statistics.frame_count << "/frame" << "\n";
+            std::cout << "crowd update cpu time:" << statistics.update_time*1000/statistics.frame_count << "ms/frame,";
+            std::cout << "saved:" << statistics.saved_time*1000/statistics.frame_count << "ms/frame" << "\n";
+        }
+    }
+    
+    //submitted triangle report
+    if (m_frame_count != 0){
+        std::cout << "submitted triangles:" << m_triangle_count/m_frame_count << "/frame" << "\n";
+        std::cout << "lod draws/frame:";
+        for (size_t i = 0;i < m_lod_draw_counts.size();i++){
+            std::cout << " " << (double)m_lod_draw_counts[i]/m_frame_count;
+        }
+        std::cout << "\n";
+    }
+    
+    delete m_vertex_animation;
+    delete m_crowd;
+    delete m_pose_cache;
     delete m_animation_controller;
+    delete m_animation_state_graph;
     delete m_camera;
+    TextureLoader::DeleteInstance();
+    ProgramCache::DeleteInstance();
+    FrameProfiler::DeleteInstance();
+    InputLog::DeleteInstance();
     ResourceManager::GetInstance()->UnLoadResource();
     ResourceManager::DeleteInstance();
+    FBXImportSession::DeleteInstance();
+    ThreadPool::DeleteInstance();
+    Trace::DeleteInstance();
 }
 
 
@@ -303,75 +788,286 @@ void Scene::HandleEvent(const SDL_Event& event){
             m_camera->MoveTargetY(-0.05);
         }
         
+        //trace so far
+        if (event.key.keysym.sym == SDLK_F12 && Trace::GetInstance() != nullptr){
+            Trace::GetInstance()->Write();
+        }
+        
         //animation controller
         if (m_is_skeletal){
-            std::string key;
-            key = event.key.keysym.sym;
-            m_animation_controller->DoUserTransition(key);
+            m_animation_controller->DoUserTransition(event.key.keysym.sym);
+        }
+        if (m_crowd != nullptr){
+            m_crowd->DoUserTransition(event.key.keysym.sym);
         }
     }
 }
 
 
 void Scene::Update(double dt){
+    TRACE_ZONE("Scene::Update");
+    
+    //scene time
+    m_time += dt;
+    
+    //decoded texture levels within the frame budget
+    TextureLoader::GetInstance()->Upload(TEXTURE_UPLOAD_BYTE_BUDGET);
+    
+    //poses of the previous frame are stale
+    if (m_pose_cache != nullptr){
+        m_pose_cache->BeginFrame();
+    }
+    
+    //select lods before sampling,so that the bones of every skeleton match the mesh lod it is drawn with this frame
+    m_mesh_lod = SelectLOD(m_mesh->GetNormalizingTransform(),m_mesh_lod);
+    if (m_is_skeletal){
+        m_mesh->GetSkeleton()->SetLOD(m_mesh_lod);
+    }
+    if (m_crowd != nullptr){
+        for (size_t i = 0;i < m_crowd->GetInstanceCount();i++){
+            mat4 world = m_crowd->GetInstance(i).placement*m_mesh->GetNormalizingTransform();
+            m_crowd_lods[i] = SelectLOD(world,m_crowd_lods[i]);
+            m_crowd->SetLOD(i,m_crowd_lods[i]);
+        }
+    }
+    
     //update animation
     if (m_is_skeletal){
         m_animation_controller->UpdateAnimation(dt);
+        
+        //cpu skinning
+        if (m_skinning_mode == CPU_SKINNING){
+            m_mesh->UpdateSkinning();
+        }
+    }
+    
+    //update crowd
+    if (m_crowd != nullptr){
+        if (m_vertex_animation != nullptr){
+            m_crowd->UpdateLOD(m_camera->GetWorldPosition(),m_vat_distance);
+        }
+        m_crowd->Update(dt);
     }
 }
 
 
 void Scene::Render(){
+    TRACE_ZONE("Scene::Render");
+    
     //render square
     m_square->Draw(*m_camera,*m_square_shader);
     
     
     //render mesh
+    m_frame_count++;
+    RenderMesh(m_mesh->GetSkeleton(),m_mesh->GetNormalizingTransform(),m_mesh_lod);
+    
+    //render crowd
+    if (m_crowd != nullptr){
+        //times of finished frames
+        ReadRenderTime(false);
+        
+        //the gpu is a whole ring behind,the oldest frame is given up instead of waiting
+        size_t slot = m_query_frame%RENDER_QUERY_FRAME_COUNT;
+        if (m_is_query_issued[slot]){
+            m_is_query_issued[slot] = false;
+            m_dropped_query_count++;
+        }
+        
+        //skeletal path
+        //far instances are grouped by lod
+        for (size_t i = 0;i < m_far_instances.size();i++){
+            m_far_instances[i].clear();
+        }
+        size_t far_instance_count = 0;
+        glBeginQuery(GL_TIME_ELAPSED,m_time_queries[2*slot+0]);
+        for (size_t i = 0;i < m_crowd->GetInstanceCount();i++){
+            const Crowd::Instance& instance = m_crowd->GetInstance(i);
+            mat4 world = instance.placement*m_mesh->GetNormalizingTransform();
+            if (instance.is_far){
+                vec4 t = instance.placement.GetColumn(3);
+                t[3] = instance.time_offset;
+                m_far_instances[m_crowd_lods[i]].push_back(t);
+                far_instance_count++;
+                continue;
+            }
+            RenderMesh(instance.skeleton,world,m_crowd_lods[i]);
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        m_query_instance_counts[2*slot+0] = m_crowd->GetInstanceCount()-far_instance_count;
+        
+        //vertex animation path
+        glBeginQuery(GL_TIME_ELAPSED,m_time_queries[2*slot+1]);
+        for (size_t i = 0;i < m_far_instances.size();i++){
+            if (!m_far_instances[i].empty()){
+                RenderVertexAnimation(m_far_instances[i],i);
+            }
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        m_query_instance_counts[2*slot+1] = far_instance_count;
+        m_is_query_issued[slot] = true;
+        m_query_frame++;
+    }
+}
+
+
+size_t Scene::SelectLOD(const mat4& world,size_t lod) const{
+    //bounding sphere in world space,radius is scaled by the largest axis scale
+    const vec3& center = m_mesh->GetBoundingCenter();
+    vec4 c = world*vec4({center[0],center[1],center[2],1});
+    FLOAT scale = 0;
+    for (size_t i = 0;i < 3;i++){
+        vec4 axis = world.GetColumn(i);
+        scale = std::max(scale,length(vec3({axis[0],axis[1],axis[2]})));
+    }
+    FLOAT radius = m_mesh->GetBoundingRadius()*scale;
+    
+    //projected radius in ndc,perspective(1,1) is the focal length
+    const vec3& eye = m_camera->GetWorldPosition();
+    FLOAT distance = length(vec3({c[0],c[1],c[2]})-eye);
+    FLOAT focal_length = m_camera->GetPerspectiveMatrix().GetComponent(1,1);
+    FLOAT size = (distance > radius) ? radius*focal_length/distance : INFINITY;
+    
+    //move at most to the lod whose range contains size,with margin around each threshold
+    size_t lod_count = m_mesh->GetLODCount();
+    lod = std::min(lod,lod_count-1);
+    while (lod+1 < lod_count && size < LOD_SCREEN_SIZES[lod]*(1-LOD_HYSTERESIS)){
+        lod++;
+    }
+    while (lod > 0 && size > LOD_SCREEN_SIZES[lod-1]*(1+LOD_HYSTERESIS)){
+        lod--;
+    }
+    return lod;
+}
+
+
+void Scene::RenderMesh(const Skeleton* skeleton,const mat4& world,size_t lod){
     //camera parameter
-    const mat4& world = m_mesh->GetNormalizingTransform();
     const mat4& view = m_camera->GetViewMatrix();
     const mat4& perspective = m_camera->GetPerspectiveMatrix();
     
-    //skeleton
-    const Skeleton* skeleton = m_mesh->GetSkeleton();
-    
     //draw sub meshes
     size_t sub_mesh_count = m_mesh->GetSubMeshCount();
     for (size_t i = 0;i < sub_mesh_count;i++){
         //sub mesh
         const SubMesh* sub_mesh = m_mesh->GetSubMesh(i);
         
-        //material
-        const Material* material = sub_mesh->GetMaterial();
-        
-        //bind shader
-        const Shader* shader = material->GetShader();
+        //bind shader,every draw range shares the shader
+        const Shader* shader = sub_mesh->GetMaterial(0)->GetShader();
         shader->Bind();
         
         //bind skeleton
-        if (m_is_skeletal){
+        if (m_is_skeletal && m_skinning_mode == GPU_SKINNING){
             skeleton->Bind(shader->GetUniformLocation("bbp_i"),
                            shader->GetUniformLocation("bbp_iti"),
                            shader->GetUniformLocation("bp"),
                            shader->GetUniformLocation("bp_it"),
+                           shader->GetUniformLocation("lod_source"),
                            0);
         }
         
-        //bind material
-        material->Bind(4);
+        //bind aabb of quantized xyz
+        m_mesh->BindDequantization(shader);
         
         //bind camera
-        glUniformMatrix4fv(shader->GetUniformLocation("world"),1,GL_FALSE,(const GLfloat*)&world);
-        glUniformMatrix4fv(shader->GetUniformLocation("view"),1,GL_FALSE,(const GLfloat*)&view);
-        glUniformMatrix4fv(shader->GetUniformLocation("perspective"),1,GL_FALSE,(const GLfloat*)&perspective);
+        GLCounter::UniformMatrix4fv(shader->GetUniformLocation("world"),1,GL_FALSE,(const GLfloat*)&world);
+        GLCounter::UniformMatrix4fv(shader->GetUniformLocation("view"),1,GL_FALSE,(const GLfloat*)&view);
+        GLCounter::UniformMatrix4fv(shader->GetUniformLocation("perspective"),1,GL_FALSE,(const GLfloat*)&perspective);
         
-        //draw sub mesh
-        sub_mesh->Draw();
+        //draw ranges with one vao bind
+        sub_mesh->Bind();
+        for (size_t j = 0;j < sub_mesh->GetDrawRangeCount();j++){
+            sub_mesh->GetMaterial(j)->Bind(5);
+            sub_mesh->Draw(lod,j);
+        }
+        sub_mesh->UnBind();
+        m_triangle_count += sub_mesh->GetTriangleCount(lod);
         
         //unbind shader
         shader->UnBind();
     }
+    m_lod_draw_counts[lod]++;
+}
+
+
+void Scene::RenderVertexAnimation(const std::vector<vec4>& instances,size_t lod){
+    //camera parameter
+    const mat4& view = m_camera->GetViewMatrix();
+    const mat4& perspective = m_camera->GetPerspectiveMatrix();
+    const mat4& world = m_mesh->GetNormalizingTransform();
+    
+    //time in the loop,instance time offsets are added in the shader
+    GLfloat time = std::fmod(m_time,m_vertex_animation->GetDuration());
+    
+    //bind shader
+    const Shader* shader = m_vat_shader;
+    shader->Bind();
+    
+    //bind vertex animation texture
+    m_vertex_animation->Bind(shader,0);
+    
+    //bind camera
+    GLCounter::UniformMatrix4fv(shader->GetUniformLocation("world"),1,GL_FALSE,(const GLfloat*)&world);
+    GLCounter::UniformMatrix4fv(shader->GetUniformLocation("view"),1,GL_FALSE,(const GLfloat*)&view);
+    GLCounter::UniformMatrix4fv(shader->GetUniformLocation("perspective"),1,GL_FALSE,(const GLfloat*)&perspective);
+    GLCounter::Uniform1f(shader->GetUniformLocation("time"),time);
+    
+    //draw sub meshes
+    GLint instances_location = shader->GetUniformLocation("instances");
+    size_t sub_mesh_count = m_mesh->GetSubMeshCount();
+    for (size_t i = 0;i < sub_mesh_count;i++){
+        //sub mesh
+        const SubMesh* sub_mesh = m_mesh->GetSubMesh(i);
+        
+        GLCounter::Uniform1i(shader->GetUniformLocation("base_vertex"),(GLint)m_vertex_animation->GetBaseVertex(i));
+        
+        //draw instances in batches,materials are bound with the vertex animation shader
+        sub_mesh->Bind();
+        for (size_t j = 0;j < instances.size();j += VAT_INSTANCE_BATCH){
+            size_t count = std::min(VAT_INSTANCE_BATCH,instances.size()-j);
+            GLCounter::Uniform4fv(instances_location,(GLsizei)count,(const GLfloat*)&instances[j]);
+            for (size_t k = 0;k < sub_mesh->GetDrawRangeCount();k++){
+                sub_mesh->GetMaterial(k)->Bind(shader,4);
+                sub_mesh->DrawInstanced(count,lod,k);
+            }
+        }
+        sub_mesh->UnBind();
+        m_triangle_count += sub_mesh->GetTriangleCount(lod)*instances.size();
+    }
+    m_lod_draw_counts[lod] += instances.size();
     
+    //unbind shader
+    shader->UnBind();
+}
+
+
+void Scene::ReadRenderTime(bool is_blocking){
+    size_t first_frame = (m_query_frame > RENDER_QUERY_FRAME_COUNT) ? m_query_frame-RENDER_QUERY_FRAME_COUNT : 0;
+    for (size_t frame = first_frame;frame < m_query_frame;frame++){
+        size_t slot = frame%RENDER_QUERY_FRAME_COUNT;
+        if (!m_is_query_issued[slot]){
+            continue;
+        }
+        
+        //the vertex animation query ends last and queries finish in order,so later frames are not ready either
+        if (!is_blocking){
+            GLint is_available = GL_FALSE;
+            glGetQueryObjectiv(m_time_queries[2*slot+1],GL_QUERY_RESULT_AVAILABLE,&is_available);
+            if (is_available == GL_FALSE){
+                break;
+            }
+        }
+        for (size_t i = 0;i < 2;i++){
+            GLuint64 time;
+            glGetQueryObjectui64v(m_time_queries[2*slot+i],GL_QUERY_RESULT,&time);
+            if (m_query_instance_counts[2*slot+i] != 0){
+                m_render_statistics[i].frame_count++;
+                m_render_statistics[i].instance_count += m_query_instance_counts[2*slot+i];
+                m_render_statistics[i].time += time;
+            }
+        }
+        m_is_query_issued[slot] = false;
+    }
 }
 
 
@@ -424,41 +1120,86 @@ int main(){
     glClearColor(0,0,0,1);
     
     //create scene
+    auto t0 = std::chrono::steady_clock::now();
     Scene scene(asset_dir_path);
     
     //event roop
     StopWatch sw;
     double frame_rate = 60;
     SDL_Event event;
+    bool is_first_frame = true;
+    FrameProfiler* profiler = FrameProfiler::GetInstance();
+    
+    //fixed time step,a replay uses the recorded one
+    InputLog* input_log = InputLog::GetInstance();
+    double dt = 1.0/frame_rate;
+    bool is_headless = false;
+    if (input_log != nullptr){
+        dt = input_log->GetDT(dt);
+        is_headless = input_log->IsHeadless();
+    }
+    if (is_headless){
+        SDL_HideWindow(window);
+    }
     while (1){
         //start stopwtch
         sw.Reset();
         sw.Start();
+        profiler->BeginFrame();
         
         //handle event
+        profiler->BeginZone(FrameProfiler::EVENT_ZONE);
         if (SDL_PollEvent(&event)){
             if (event.type == SDL_QUIT){
+                profiler->EndFrame();
                 break;
-            }else{
+            }else if (input_log == nullptr){
+                scene.HandleEvent(event);
+            }else if (input_log->GetMode() == InputLog::RECORD_MODE){
+                input_log->Record(event);
                 scene.HandleEvent(event);
             }
         }
-
-        //clear
-        glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+        
+        //recorded events of this frame,live input is ignored while replaying
+        while (input_log != nullptr && input_log->Replay(&event)){
+            scene.HandleEvent(event);
+        }
         
         //update scene
-        scene.Update(1.0/frame_rate);
+        profiler->BeginZone(FrameProfiler::UPDATE_ZONE);
+        scene.Update(dt);
+        
+        //clear
+        profiler->BeginZone(FrameProfiler::RENDER_ZONE);
+        glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
         
         //render scene
         scene.Render();
         
         //update window
+        profiler->BeginZone(FrameProfiler::SWAP_ZONE);
         SDL_GL_SwapWindow(window);
+        profiler->EndFrame();
+        
+        //time to first frame,scene load included
+        if (is_first_frame){
+            auto t1 = std::chrono::steady_clock::now();
+            std::cout << "time to first frame:" << std::chrono::duration<double>(t1-t0).count()*1000 << "ms" << "\n";
+            is_first_frame = false;
+        }
+        
+        //end of replay
+        if (input_log != nullptr){
+            input_log->EndFrame(dt);
+            if (input_log->IsFinished()){
+                break;
+            }
+        }
         
-        //stop stopwatch
+        //stop stopwatch,headless replay runs as fast as it can
         uint64_t elapsed_time = sw.GetElapsedTime();
-        if (elapsed_time < 1000.0/frame_rate){
+        if (!is_headless && elapsed_time < 1000.0/frame_rate){
             SDL_Delay(1000.0/frame_rate-elapsed_time);
         }
     }
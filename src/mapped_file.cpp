@@ -0,0 +1,87 @@
+#include "mapped_file.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+bool GetFileStamp(const std::string& path,int64_t& time,uint64_t& size){
+    struct stat st;
+    if (stat(path.c_str(),&st) != 0){
+        return false;
+    }
+    time = (int64_t)st.st_mtime;
+    size = (uint64_t)st.st_size;
+    return true;
+}
+
+uint64_t AlignUp(uint64_t offset,uint64_t alignment){
+    return (offset+alignment-1)/alignment*alignment;
+}
+
+bool WriteFileAtomically(const std::string& path,const std::function<bool(std::FILE*)>& write){
+    const std::string& temporary_path = path+".tmp";
+    std::FILE* fp = std::fopen(temporary_path.c_str(),"wb");
+    if (fp == NULL){
+        return false;
+    }
+    bool is_written = write(fp);
+    is_written = (std::fclose(fp) == 0) && is_written;
+    if (!is_written || std::rename(temporary_path.c_str(),path.c_str()) != 0){
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+MappedFile::MappedFile():m_data(nullptr),m_size(0){
+}
+
+MappedFile::~MappedFile(){
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path){
+    Close();
+    int fd = open(path.c_str(),O_RDONLY);
+    if (fd == -1){
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd,&st) != 0 || st.st_size == 0){
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    void* data = mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (data == MAP_FAILED){
+        std::cout << "failed to map file:" << path << "\n";
+        return false;
+    }
+    m_data = data;
+    m_size = size;
+    return true;
+}
+
+void MappedFile::Close(){
+    if (m_data != nullptr){
+        munmap(m_data,m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool MappedFile::IsOpen() const{
+    return m_data != nullptr;
+}
+
+const char* MappedFile::GetData() const{
+    return (const char*)m_data;
+}
+
+size_t MappedFile::GetSize() const{
+    return m_size;
+}
@@ -0,0 +1,44 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include "library.hpp"
+
+#include <functional>
+
+
+//helpers of the binary caches built from source files(animation database,cooked textures,program cache)
+
+//modification time and size of a file,a cache records those of its source and is stale when they change
+bool GetFileStamp(const std::string& path,int64_t& time,uint64_t& size);
+
+//offset rounded up to a multiple of alignment
+uint64_t AlignUp(uint64_t offset,uint64_t alignment);
+
+//write fills a temporary file next to path,which then replaces path
+//a process still mapping the old file keeps reading the old data,and a failed write leaves path as it was
+bool WriteFileAtomically(const std::string& path,const std::function<bool(std::FILE*)>& write);
+
+
+//read only mapping of a whole file,the mapping outlives its file descriptor
+//every offset read from the file has to be checked against GetSize,so that a truncated file is rejected
+class MappedFile{
+private:
+    void* m_data;
+    size_t m_size;
+public:
+    MappedFile();
+    ~MappedFile();
+
+    //false if the file is absent,empty or cannot be mapped
+    bool Open(const std::string& path);
+    void Close();
+
+    bool IsOpen() const;
+    const char* GetData() const;
+    size_t GetSize() const;
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+#endif // MAPPED_FILE_HPP
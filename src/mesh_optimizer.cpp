@@ -0,0 +1,379 @@
+#include "mesh_optimizer.hpp"
+
+#include <cstring>
+#include <unordered_map>
+
+
+size_t IndexedMesh::GetVertexCount() const{
+    return xyz.size();
+}
+
+size_t IndexedMesh::GetTriangleCount() const{
+    return indices.size()/3;
+}
+
+
+//attributes of one corner,compared bytewise
+struct CornerKey{
+    unsigned char bytes[sizeof(vec3)*2+sizeof(vec2)+4*sizeof(int)+4*sizeof(FLOAT)];
+    bool operator==(const CornerKey& key) const{
+        return std::memcmp(bytes,key.bytes,sizeof(bytes)) == 0;
+    }
+};
+
+struct CornerKeyHash{
+    size_t operator()(const CornerKey& key) const{
+        //fnv-1a
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0;i < sizeof(key.bytes);i++){
+            hash ^= key.bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return (size_t)hash;
+    }
+};
+
+void BuildIndexedMesh(const std::vector<vec3>& xyz,
+                      const std::vector<vec2>& uv,
+                      const std::vector<vec3>& normal,
+                      const std::vector<int>& bone_index,
+                      const std::vector<FLOAT>& bone_weight,
+                      IndexedMesh& mesh)
+{
+    bool is_skeletal = !bone_index.empty();
+    size_t corner_count = xyz.size();
+
+    mesh = IndexedMesh();
+    mesh.indices.resize(corner_count);
+
+    std::unordered_map<CornerKey,uint32_t,CornerKeyHash> vertices;
+    vertices.reserve(corner_count);
+    for (size_t i = 0;i < corner_count;i++){
+        //key
+        CornerKey key;
+        std::memset(key.bytes,0,sizeof(key.bytes));
+        unsigned char* p = key.bytes;
+        std::memcpy(p,&xyz[i],sizeof(vec3));
+        p += sizeof(vec3);
+        std::memcpy(p,&uv[i],sizeof(vec2));
+        p += sizeof(vec2);
+        std::memcpy(p,&normal[i],sizeof(vec3));
+        p += sizeof(vec3);
+        if (is_skeletal){
+            std::memcpy(p,&bone_index[4*i],4*sizeof(int));
+            p += 4*sizeof(int);
+            std::memcpy(p,&bone_weight[4*i],4*sizeof(FLOAT));
+        }
+
+        //new vertex
+        std::pair<std::unordered_map<CornerKey,uint32_t,CornerKeyHash>::iterator,bool> result = vertices.insert(std::make_pair(key,(uint32_t)mesh.xyz.size()));
+        if (result.second){
+            mesh.xyz.push_back(xyz[i]);
+            mesh.uv.push_back(uv[i]);
+            mesh.normal.push_back(normal[i]);
+            if (is_skeletal){
+                mesh.bone_index.insert(mesh.bone_index.end(),bone_index.begin()+4*i,bone_index.begin()+4*i+4);
+                mesh.bone_weight.insert(mesh.bone_weight.end(),bone_weight.begin()+4*i,bone_weight.begin()+4*i+4);
+            }
+        }
+        mesh.indices[i] = result.first->second;
+    }
+}
+
+
+//fifo post transform cache
+class VertexCache{
+private:
+    std::vector<uint32_t> m_entries;
+    std::vector<size_t> m_time_stamps;//size = vertex_count,time at which the vertex entered the cache
+    size_t m_cache_size;
+    size_t m_time;
+public:
+    VertexCache(size_t vertex_count,size_t cache_size):m_time_stamps(vertex_count,0),m_cache_size(cache_size),m_time(cache_size+1){}
+
+    void Reset(){
+        m_time += m_cache_size+1;
+    }
+
+    //true if miss
+    bool Access(uint32_t vertex){
+        if (m_time-m_time_stamps[vertex] > m_cache_size){
+            m_time_stamps[vertex] = m_time;
+            m_time++;
+            return true;
+        }
+        return false;
+    }
+};
+
+VertexCacheStatistics ComputeVertexCacheStatistics(const std::vector<uint32_t>& indices,size_t vertex_count,size_t cache_size){
+    VertexCache cache(vertex_count,cache_size);
+    size_t miss_count = 0;
+    for (size_t i = 0;i < indices.size();i++){
+        if (cache.Access(indices[i])){
+            miss_count++;
+        }
+    }
+
+    VertexCacheStatistics statistics;
+    statistics.acmr = (indices.size() != 0) ? (FLOAT)miss_count/(indices.size()/3) : 0;
+    statistics.atvr = (vertex_count != 0) ? (FLOAT)miss_count/vertex_count : 0;
+    return statistics;
+}
+
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices,size_t vertex_count,size_t cache_size,std::vector<size_t>& hard_boundaries){
+    size_t triangle_count = indices.size()/3;
+    hard_boundaries.clear();
+    if (triangle_count == 0){
+        return;
+    }
+
+    //vertex -> triangles
+    std::vector<size_t> offsets(vertex_count+1,0);
+    for (size_t i = 0;i < indices.size();i++){
+        offsets[indices[i]+1]++;
+    }
+    for (size_t i = 0;i < vertex_count;i++){
+        offsets[i+1] += offsets[i];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<size_t> fill(offsets.begin(),offsets.end()-1);
+    for (size_t i = 0;i < indices.size();i++){
+        adjacency[fill[indices[i]]++] = (uint32_t)(i/3);
+    }
+
+    //live triangle count
+    std::vector<int> live(vertex_count);
+    for (size_t i = 0;i < vertex_count;i++){
+        live[i] = (int)(offsets[i+1]-offsets[i]);
+    }
+
+    std::vector<size_t> time_stamps(vertex_count,0);
+    size_t time = cache_size+1;
+    std::vector<bool> is_emitted(triangle_count,false);
+    std::vector<uint32_t> dead_end;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+
+    //fanning vertex,cursor of the global scan
+    long long fanning = indices[0];
+    size_t cursor = 0;
+    hard_boundaries.push_back(0);
+    std::vector<uint32_t> candidates;
+    while (fanning >= 0){
+        //emit every live triangle around the fanning vertex
+        candidates.clear();
+        for (size_t i = offsets[fanning];i < offsets[fanning+1];i++){
+            uint32_t t = adjacency[i];
+            if (is_emitted[t]){
+                continue;
+            }
+            for (size_t j = 0;j < 3;j++){
+                uint32_t v = indices[3*t+j];
+                output.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time-time_stamps[v] > cache_size){
+                    time_stamps[v] = time;
+                    time++;
+                }
+            }
+            is_emitted[t] = true;
+        }
+
+        //next fanning vertex,the candidate that stays in the cache longest after its fan
+        long long next = -1;
+        long long best_priority = -1;
+        for (size_t i = 0;i < candidates.size();i++){
+            uint32_t v = candidates[i];
+            if (live[v] <= 0){
+                continue;
+            }
+            long long priority = 0;
+            if ((long long)(time-time_stamps[v])+2*live[v] <= (long long)cache_size){
+                priority = (long long)(time-time_stamps[v]);
+            }
+            if (priority > best_priority){
+                best_priority = priority;
+                next = v;
+            }
+        }
+
+        //dead end,recently used vertices first,then global scan
+        if (next < 0){
+            while (!dead_end.empty()){
+                uint32_t v = dead_end.back();
+                dead_end.pop_back();
+                if (live[v] > 0){
+                    next = v;
+                    break;
+                }
+            }
+            if (next < 0){
+                while (cursor < vertex_count){
+                    if (live[cursor] > 0){
+                        next = (long long)cursor;
+                        break;
+                    }
+                    cursor++;
+                }
+            }
+            if (next >= 0){
+                hard_boundaries.push_back(output.size()/3);
+            }
+        }
+        fanning = next;
+    }
+
+    indices.swap(output);
+}
+
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices,
+                      const std::vector<vec3>& xyz,
+                      const std::vector<size_t>& hard_boundaries,
+                      size_t cache_size,
+                      FLOAT threshold)
+{
+    size_t triangle_count = indices.size()/3;
+    if (triangle_count == 0){
+        return;
+    }
+
+    //hard clusters
+    std::vector<size_t> hard(hard_boundaries);
+    hard.push_back(triangle_count);
+    std::sort(hard.begin(),hard.end());
+    hard.erase(std::unique(hard.begin(),hard.end()),hard.end());
+
+    //soft clusters
+    //a cluster is closed as soon as its own cache miss ratio is within threshold of the hard cluster's
+    VertexCache cache(xyz.size(),cache_size);
+    std::vector<size_t> boundaries;
+    for (size_t c = 0;c+1 < hard.size();c++){
+        size_t begin = hard[c];
+        size_t end = hard[c+1];
+        if (begin == end){
+            continue;
+        }
+
+        //miss ratio of the hard cluster
+        cache.Reset();
+        size_t miss_count = 0;
+        for (size_t i = 3*begin;i < 3*end;i++){
+            miss_count += cache.Access(indices[i]) ? 1 : 0;
+        }
+        FLOAT cluster_acmr = (FLOAT)miss_count/(end-begin);
+
+        //split
+        boundaries.push_back(begin);
+        cache.Reset();
+        miss_count = 0;
+        size_t start = begin;
+        for (size_t t = begin;t < end;t++){
+            for (size_t j = 0;j < 3;j++){
+                miss_count += cache.Access(indices[3*t+j]) ? 1 : 0;
+            }
+            if (t+1 < end && (FLOAT)miss_count/(t+1-start) <= cluster_acmr*threshold){
+                boundaries.push_back(t+1);
+                start = t+1;
+                cache.Reset();
+                miss_count = 0;
+            }
+        }
+    }
+    boundaries.push_back(triangle_count);
+
+    //area weighted centroid and normal of clusters and the whole mesh
+    size_t cluster_count = boundaries.size()-1;
+    std::vector<vec3> centroids(cluster_count);
+    std::vector<vec3> normals(cluster_count);
+    vec3 mesh_centroid({0,0,0});
+    FLOAT mesh_area = 0;
+    for (size_t c = 0;c < cluster_count;c++){
+        vec3 centroid({0,0,0});
+        vec3 normal({0,0,0});
+        FLOAT area = 0;
+        for (size_t t = boundaries[c];t < boundaries[c+1];t++){
+            const vec3& p0 = xyz[indices[3*t+0]];
+            const vec3& p1 = xyz[indices[3*t+1]];
+            const vec3& p2 = xyz[indices[3*t+2]];
+            vec3 n = cross(p1-p0,p2-p0);
+            FLOAT a = length(n);
+            centroid = centroid+(p0+p1+p2)*(a/3);
+            normal = normal+n;
+            area += a;
+        }
+        mesh_centroid = mesh_centroid+centroid;
+        mesh_area += area;
+        centroids[c] = (area > 0) ? centroid*(1/area) : xyz[indices[3*boundaries[c]]];
+        FLOAT l = length(normal);
+        normals[c] = (l > 0) ? normal*(1/l) : normal;
+    }
+    if (mesh_area > 0){
+        mesh_centroid = mesh_centroid*(1/mesh_area);
+    }
+
+    //clusters facing away from the center are likely to occlude the others,so draw them first
+    std::vector<FLOAT> keys(cluster_count);
+    std::vector<size_t> order(cluster_count);
+    for (size_t c = 0;c < cluster_count;c++){
+        keys[c] = dot(centroids[c]-mesh_centroid,normals[c]);
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(),order.end(),[&keys](size_t a,size_t b){return keys[a] > keys[b];});
+
+    //reorder
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (size_t i = 0;i < cluster_count;i++){
+        size_t c = order[i];
+        output.insert(output.end(),indices.begin()+3*boundaries[c],indices.begin()+3*boundaries[c+1]);
+    }
+    indices.swap(output);
+}
+
+
+void OptimizeVertexFetch(IndexedMesh& mesh){
+    bool is_skeletal = !mesh.bone_index.empty();
+    size_t vertex_count = mesh.GetVertexCount();
+
+    //new index in order of first use
+    const uint32_t UNUSED = 0xFFFFFFFF;
+    std::vector<uint32_t> remap(vertex_count,UNUSED);
+    uint32_t next = 0;
+    for (size_t i = 0;i < mesh.indices.size();i++){
+        uint32_t& r = remap[mesh.indices[i]];
+        if (r == UNUSED){
+            r = next++;
+        }
+        mesh.indices[i] = r;
+    }
+
+    //move vertices,unused vertices are dropped
+    IndexedMesh reordered;
+    reordered.xyz.resize(next);
+    reordered.uv.resize(next);
+    reordered.normal.resize(next);
+    if (is_skeletal){
+        reordered.bone_index.resize(4*next);
+        reordered.bone_weight.resize(4*next);
+    }
+    for (size_t v = 0;v < vertex_count;v++){
+        uint32_t r = remap[v];
+        if (r == UNUSED){
+            continue;
+        }
+        reordered.xyz[r] = mesh.xyz[v];
+        reordered.uv[r] = mesh.uv[v];
+        reordered.normal[r] = mesh.normal[v];
+        if (is_skeletal){
+            std::copy(mesh.bone_index.begin()+4*v,mesh.bone_index.begin()+4*v+4,reordered.bone_index.begin()+4*r);
+            std::copy(mesh.bone_weight.begin()+4*v,mesh.bone_weight.begin()+4*v+4,reordered.bone_weight.begin()+4*r);
+        }
+    }
+    reordered.indices.swap(mesh.indices);
+    mesh = reordered;
+}
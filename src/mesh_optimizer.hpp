@@ -0,0 +1,58 @@
+#ifndef MESH_OPTIMIZER_HPP
+#define MESH_OPTIMIZER_HPP
+
+#include "library.hpp"
+#include "define.hpp"
+#include "matrix.hpp"
+
+
+//vertex streams with shared vertices and a triangle list
+struct IndexedMesh{
+    std::vector<vec3> xyz;          //size = vertex_count
+    std::vector<vec2> uv;           //size = vertex_count
+    std::vector<vec3> normal;       //size = vertex_count
+    std::vector<int> bone_index;    //size = 4*vertex_count,empty if not skeletal
+    std::vector<FLOAT> bone_weight; //size = 4*vertex_count,empty if not skeletal
+    std::vector<uint32_t> indices;  //size = 3*triangle_count
+
+    size_t GetVertexCount() const;
+    size_t GetTriangleCount() const;
+};
+
+//post transform cache statistics of a fifo cache
+struct VertexCacheStatistics{
+    FLOAT acmr;//average cache miss ratio,misses per triangle
+    FLOAT atvr;//average transformed vertex ratio,misses per vertex
+};
+
+//simulated post transform cache size
+static const size_t VERTEX_CACHE_SIZE = 16;
+
+
+//merges corners whose attributes are identical
+//streams are per corner as FBXMeshLoader::Mesh,bone streams may be empty
+void BuildIndexedMesh(const std::vector<vec3>& xyz,
+                      const std::vector<vec2>& uv,
+                      const std::vector<vec3>& normal,
+                      const std::vector<int>& bone_index,
+                      const std::vector<FLOAT>& bone_weight,
+                      IndexedMesh& mesh);
+
+VertexCacheStatistics ComputeVertexCacheStatistics(const std::vector<uint32_t>& indices,size_t vertex_count,size_t cache_size);
+
+//tipsify,Sander et al. 2007
+//returns triangle offsets where the cache was restarted,used as hard cluster boundaries by OptimizeOverdraw
+void OptimizeVertexCache(std::vector<uint32_t>& indices,size_t vertex_count,size_t cache_size,std::vector<size_t>& hard_boundaries);
+
+//splits clusters where the local cache miss ratio stays within threshold*cluster ratio,
+//then sorts clusters so that outward facing ones come first
+void OptimizeOverdraw(std::vector<uint32_t>& indices,
+                      const std::vector<vec3>& xyz,
+                      const std::vector<size_t>& hard_boundaries,
+                      size_t cache_size,
+                      FLOAT threshold);
+
+//renumbers vertices in order of first use in the index buffer
+void OptimizeVertexFetch(IndexedMesh& mesh);
+
+#endif // MESH_OPTIMIZER_HPP
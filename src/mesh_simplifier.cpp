@@ -0,0 +1,318 @@
+#include "mesh_simplifier.hpp"
+#include "mesh_optimizer.hpp"
+
+#include <queue>
+#include <unordered_map>
+
+
+//cost of moving a vertex onto a neighbor with different bone weights,relative to squared edge length
+static const double SKIN_WEIGHT_PENALTY = 1.0;
+
+//min cosine between a triangle normal before and after a collapse
+static const double MIN_NORMAL_COSINE = 0.2;
+
+
+MeshSimplifier::Quadric::Quadric(){
+    for (size_t i = 0;i < 10;i++){
+        q[i] = 0;
+    }
+}
+
+void MeshSimplifier::Quadric::AddPlane(double a,double b,double c,double d,double weight){
+    q[0] += weight*a*a;
+    q[1] += weight*a*b;
+    q[2] += weight*a*c;
+    q[3] += weight*a*d;
+    q[4] += weight*b*b;
+    q[5] += weight*b*c;
+    q[6] += weight*b*d;
+    q[7] += weight*c*c;
+    q[8] += weight*c*d;
+    q[9] += weight*d*d;
+}
+
+void MeshSimplifier::Quadric::Add(const Quadric& quadric){
+    for (size_t i = 0;i < 10;i++){
+        q[i] += quadric.q[i];
+    }
+}
+
+double MeshSimplifier::Quadric::Evaluate(const vec3& p) const{
+    double x = p[0];
+    double y = p[1];
+    double z = p[2];
+    return q[0]*x*x+2*q[1]*x*y+2*q[2]*x*z+2*q[3]*x
+          +q[4]*y*y+2*q[5]*y*z+2*q[6]*y
+          +q[7]*z*z+2*q[8]*z
+          +q[9];
+}
+
+bool MeshSimplifier::Collapse::operator<(const Collapse& collapse) const{
+    //std::priority_queue pops the largest,so the cheapest collapse has to compare largest
+    return cost > collapse.cost;
+}
+
+
+MeshSimplifier::MeshSimplifier(const IndexedMesh& mesh,const std::vector<uint32_t>& indices):m_mesh(mesh){
+    size_t vertex_count = mesh.GetVertexCount();
+
+    //triangles without degenerate ones
+    for (size_t i = 0;i+2 < indices.size();i += 3){
+        uint32_t a = indices[i];
+        uint32_t b = indices[i+1];
+        uint32_t c = indices[i+2];
+        if (a != b && b != c && c != a){
+            m_triangles.push_back(a);
+            m_triangles.push_back(b);
+            m_triangles.push_back(c);
+        }
+    }
+    size_t triangle_count = m_triangles.size()/3;
+    m_is_triangle_alive.assign(triangle_count,true);
+    m_alive_triangle_count = triangle_count;
+
+    //adjacency
+    m_adjacency.resize(vertex_count);
+    for (size_t t = 0;t < triangle_count;t++){
+        for (size_t j = 0;j < 3;j++){
+            m_adjacency[m_triangles[3*t+j]].push_back((uint32_t)t);
+        }
+    }
+
+    //quadrics,area weighted planes of adjacent triangles
+    m_quadrics.resize(vertex_count);
+    for (size_t t = 0;t < triangle_count;t++){
+        const vec3& p0 = mesh.xyz[m_triangles[3*t+0]];
+        const vec3& p1 = mesh.xyz[m_triangles[3*t+1]];
+        const vec3& p2 = mesh.xyz[m_triangles[3*t+2]];
+        vec3 n = cross(p1-p0,p2-p0);
+        double area2 = length(n);
+        if (area2 == 0){
+            continue;
+        }
+        double a = n[0]/area2;
+        double b = n[1]/area2;
+        double c = n[2]/area2;
+        double d = -(a*p0[0]+b*p0[1]+c*p0[2]);
+        for (size_t j = 0;j < 3;j++){
+            m_quadrics[m_triangles[3*t+j]].AddPlane(a,b,c,d,0.5*area2);
+        }
+    }
+
+    //lock vertices on edges that do not have exactly two triangles
+    std::unordered_map<uint64_t,int> edge_counts;
+    for (size_t t = 0;t < triangle_count;t++){
+        for (size_t j = 0;j < 3;j++){
+            uint64_t a = m_triangles[3*t+j];
+            uint64_t b = m_triangles[3*t+(j+1)%3];
+            edge_counts[(std::min(a,b)<<32)|std::max(a,b)]++;
+        }
+    }
+    m_is_locked.assign(vertex_count,false);
+    for (std::unordered_map<uint64_t,int>::const_iterator ite = edge_counts.begin();ite != edge_counts.end();++ite){
+        if (ite->second != 2){
+            m_is_locked[ite->first>>32] = true;
+            m_is_locked[ite->first&0xFFFFFFFF] = true;
+        }
+    }
+
+    m_is_removed.assign(vertex_count,false);
+    m_versions.assign(vertex_count,0);
+}
+
+void MeshSimplifier::Simplify(const std::vector<size_t>& target_triangle_counts,std::vector<std::vector<uint32_t>>& lods){
+    //initial collapses
+    std::priority_queue<Collapse> heap;
+    for (uint32_t v = 0;v < m_adjacency.size();v++){
+        Collapse collapse;
+        if (ComputeCollapse(v,collapse)){
+            heap.push(collapse);
+        }
+    }
+
+    for (size_t i = 0;i < target_triangle_counts.size();i++){
+        while (m_alive_triangle_count > target_triangle_counts[i] && !heap.empty()){
+            Collapse collapse = heap.top();
+            heap.pop();
+
+            //stale
+            if (m_is_removed[collapse.from] || collapse.version != m_versions[collapse.from]){
+                continue;
+            }
+
+            ApplyCollapse(collapse.from,collapse.to);
+
+            //the neighborhood of to has changed
+            std::vector<uint32_t> neighbors(1,collapse.to);
+            for (size_t j = 0;j < m_adjacency[collapse.to].size();j++){
+                uint32_t t = m_adjacency[collapse.to][j];
+                for (size_t k = 0;k < 3;k++){
+                    neighbors.push_back(m_triangles[3*t+k]);
+                }
+            }
+            std::sort(neighbors.begin(),neighbors.end());
+            neighbors.erase(std::unique(neighbors.begin(),neighbors.end()),neighbors.end());
+            for (size_t j = 0;j < neighbors.size();j++){
+                uint32_t v = neighbors[j];
+                m_versions[v]++;
+                Collapse next;
+                if (ComputeCollapse(v,next)){
+                    heap.push(next);
+                }
+            }
+        }
+
+        lods.push_back(std::vector<uint32_t>());
+        GetIndices(lods.back());
+    }
+}
+
+bool MeshSimplifier::ComputeCollapse(uint32_t from,Collapse& collapse) const{
+    if (m_is_locked[from] || m_is_removed[from]){
+        return false;
+    }
+
+    bool is_found = false;
+    const std::vector<uint32_t>& triangles = m_adjacency[from];
+    for (size_t i = 0;i < triangles.size();i++){
+        uint32_t t = triangles[i];
+        if (!m_is_triangle_alive[t]){
+            continue;
+        }
+        for (size_t j = 0;j < 3;j++){
+            uint32_t to = m_triangles[3*t+j];
+            if (to == from){
+                continue;
+            }
+
+            //quadric error at the destination and skin weight change
+            const vec3& p = m_mesh.xyz[to];
+            vec3 e = p-m_mesh.xyz[from];
+            double cost = m_quadrics[from].Evaluate(p)+m_quadrics[to].Evaluate(p);
+            cost += SKIN_WEIGHT_PENALTY*GetWeightDistance(from,to)*dot(e,e);
+            if (is_found && cost >= collapse.cost){
+                continue;
+            }
+            if (IsFlipped(from,to)){
+                continue;
+            }
+            collapse.cost = cost;
+            collapse.from = from;
+            collapse.to = to;
+            collapse.version = m_versions[from];
+            is_found = true;
+        }
+    }
+    return is_found;
+}
+
+bool MeshSimplifier::IsFlipped(uint32_t from,uint32_t to) const{
+    const std::vector<uint32_t>& triangles = m_adjacency[from];
+    for (size_t i = 0;i < triangles.size();i++){
+        uint32_t t = triangles[i];
+        if (!m_is_triangle_alive[t]){
+            continue;
+        }
+        const uint32_t* v = &m_triangles[3*t];
+        if (v[0] == to || v[1] == to || v[2] == to){
+            continue;//removed by the collapse
+        }
+
+        //normal before and after
+        vec3 p[3],q[3];
+        for (size_t j = 0;j < 3;j++){
+            p[j] = m_mesh.xyz[v[j]];
+            q[j] = (v[j] == from) ? m_mesh.xyz[to] : p[j];
+        }
+        vec3 n0 = cross(p[1]-p[0],p[2]-p[0]);
+        vec3 n1 = cross(q[1]-q[0],q[2]-q[0]);
+        double l0 = length(n0);
+        double l1 = length(n1);
+        if (l1 == 0){
+            return true;
+        }
+        if (l0 != 0 && dot(n0,n1) < MIN_NORMAL_COSINE*l0*l1){
+            return true;
+        }
+    }
+    return false;
+}
+
+double MeshSimplifier::GetWeightDistance(uint32_t a,uint32_t b) const{
+    if (m_mesh.bone_index.empty()){
+        return 0;
+    }
+
+    //l1 distance of sparse weight vectors
+    double distance = 0;
+    for (size_t i = 0;i < 4;i++){
+        int ia = m_mesh.bone_index[4*a+i];
+        FLOAT wa = (ia < 0) ? 0 : m_mesh.bone_weight[4*a+i];
+        FLOAT wb = 0;
+        for (size_t j = 0;j < 4;j++){
+            if (m_mesh.bone_index[4*b+j] == ia){
+                wb = m_mesh.bone_weight[4*b+j];
+            }
+        }
+        distance += std::abs(wa-wb);
+    }
+    for (size_t i = 0;i < 4;i++){
+        int ib = m_mesh.bone_index[4*b+i];
+        if (ib < 0){
+            continue;
+        }
+        bool is_shared = false;
+        for (size_t j = 0;j < 4;j++){
+            is_shared = is_shared || (m_mesh.bone_index[4*a+j] == ib);
+        }
+        if (!is_shared){
+            distance += m_mesh.bone_weight[4*b+i];
+        }
+    }
+    return distance;
+}
+
+void MeshSimplifier::ApplyCollapse(uint32_t from,uint32_t to){
+    //rewrite triangles of from,triangles on the edge disappear
+    const std::vector<uint32_t>& triangles = m_adjacency[from];
+    for (size_t i = 0;i < triangles.size();i++){
+        uint32_t t = triangles[i];
+        if (!m_is_triangle_alive[t]){
+            continue;
+        }
+        uint32_t* v = &m_triangles[3*t];
+        if (v[0] == to || v[1] == to || v[2] == to){
+            m_is_triangle_alive[t] = false;
+            m_alive_triangle_count--;
+            continue;
+        }
+        for (size_t j = 0;j < 3;j++){
+            if (v[j] == from){
+                v[j] = to;
+            }
+        }
+        m_adjacency[to].push_back(t);
+    }
+
+    //drop dead triangles of to
+    std::vector<uint32_t> alive;
+    for (size_t i = 0;i < m_adjacency[to].size();i++){
+        if (m_is_triangle_alive[m_adjacency[to][i]]){
+            alive.push_back(m_adjacency[to][i]);
+        }
+    }
+    m_adjacency[to].swap(alive);
+
+    m_quadrics[to].Add(m_quadrics[from]);
+    m_adjacency[from].clear();
+    m_is_removed[from] = true;
+}
+
+void MeshSimplifier::GetIndices(std::vector<uint32_t>& indices) const{
+    indices.clear();
+    for (size_t t = 0;t < m_is_triangle_alive.size();t++){
+        if (m_is_triangle_alive[t]){
+            indices.insert(indices.end(),m_triangles.begin()+3*t,m_triangles.begin()+3*t+3);
+        }
+    }
+}
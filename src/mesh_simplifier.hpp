@@ -0,0 +1,58 @@
+#ifndef MESH_SIMPLIFIER_HPP
+#define MESH_SIMPLIFIER_HPP
+
+#include "library.hpp"
+#include "define.hpp"
+#include "matrix.hpp"
+
+struct IndexedMesh;
+
+
+//quadric error metric simplification,Garland and Heckbert 1997
+//half edge collapses move a vertex onto one of its neighbors,so no vertex is created and
+//every lod indexes the vertex streams of the source mesh with their original uv and skin weights
+//vertices on open borders,uv seams and hard normal edges are split in the indexed mesh,
+//so they are found as topological border and locked
+class MeshSimplifier{
+private:
+    //symmetric 4x4 matrix,a2 ab ac ad b2 bc bd c2 cd d2
+    struct Quadric{
+        double q[10];
+        Quadric();
+        void AddPlane(double a,double b,double c,double d,double weight);
+        void Add(const Quadric& quadric);
+        double Evaluate(const vec3& p) const;
+    };
+    struct Collapse{
+        double cost;
+        uint32_t from;
+        uint32_t to;
+        uint32_t version;//version of from when the collapse was computed
+        bool operator<(const Collapse& collapse) const;//for max heap of std::priority_queue
+    };
+
+    const IndexedMesh& m_mesh;
+    std::vector<uint32_t> m_triangles;              //size = 3*triangle_count,rewritten by collapses
+    std::vector<bool> m_is_triangle_alive;
+    std::vector<std::vector<uint32_t>> m_adjacency; //vertex -> triangles,may contain dead triangles
+    std::vector<Quadric> m_quadrics;
+    std::vector<bool> m_is_locked;
+    std::vector<bool> m_is_removed;
+    std::vector<uint32_t> m_versions;
+    size_t m_alive_triangle_count;
+public:
+    //indices is a triangle list on the vertex streams of mesh,e.g. one draw range of mesh.indices
+    MeshSimplifier(const IndexedMesh& mesh,const std::vector<uint32_t>& indices);
+
+    //simplifies down to each target in decreasing order and appends the index list of each step to lods
+    //a step that cannot remove enough triangles still outputs the simplest result reached
+    void Simplify(const std::vector<size_t>& target_triangle_counts,std::vector<std::vector<uint32_t>>& lods);
+private:
+    bool ComputeCollapse(uint32_t from,Collapse& collapse) const;
+    bool IsFlipped(uint32_t from,uint32_t to) const;
+    double GetWeightDistance(uint32_t a,uint32_t b) const;
+    void ApplyCollapse(uint32_t from,uint32_t to);
+    void GetIndices(std::vector<uint32_t>& indices) const;
+};
+
+#endif // MESH_SIMPLIFIER_HPP
@@ -0,0 +1,99 @@
+#include "pose_cache.hpp"
+#include "resource.hpp"
+
+#include <thread>
+
+
+bool PoseCache::Key::operator<(const Key& key) const{
+    if (animation != key.animation){
+        return animation < key.animation;
+    }
+    if (rig != key.rig){
+        return rig < key.rig;
+    }
+    if (quantized_time != key.quantized_time){
+        return quantized_time < key.quantized_time;
+    }
+    return sample_rate < key.sample_rate;
+}
+
+PoseCache::PoseCache():m_used_entry_count(0),m_hit_count(0),m_miss_count(0),m_sample_time(0){}
+
+PoseCache::~PoseCache(){
+    for (size_t i = 0;i < m_entry_pool.size();i++){
+        delete m_entry_pool[i];
+    }
+}
+
+void PoseCache::BeginFrame(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_used_entry_count = 0;
+}
+
+void PoseCache::Lookup(const Animation* animation,const Skeleton& skeleton,const BoneRemap* remap,double time,double sample_rate,const mat4*& bp,const mat4*& bp_it){
+    //quantize
+    double duration = animation->GetDuration();
+    long long quantized_time = (long long)std::floor(std::min(std::max(time,0.0),duration)*sample_rate+0.5);
+    Key key = {animation,skeleton.GetRig(),quantized_time,sample_rate};
+    
+    //find or reserve entry
+    Entry* entry;
+    bool is_owner = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto i = m_entries.find(key);
+        if (i != m_entries.end()){
+            entry = i->second;
+        }else{
+            if (m_used_entry_count == m_entry_pool.size()){
+                m_entry_pool.push_back(new Entry());
+            }
+            entry = m_entry_pool[m_used_entry_count];
+            m_used_entry_count++;
+            entry->is_ready = false;
+            m_entries[key] = entry;
+            is_owner = true;
+        }
+    }
+    
+    if (is_owner){
+        //miss,sample outside the lock
+        auto t0 = std::chrono::steady_clock::now();
+        entry->bp.resize(skeleton.GetBoneCount());
+        entry->bp_it.resize(skeleton.GetBoneCount());
+        animation->Sample(entry->bp.data(),entry->bp_it.data(),skeleton,remap,0,std::min(quantized_time/sample_rate,duration));
+        auto t1 = std::chrono::steady_clock::now();
+        m_sample_time += std::chrono::duration_cast<std::chrono::nanoseconds>(t1-t0).count();
+        m_miss_count++;
+        entry->is_ready.store(true,std::memory_order_release);
+    }else{
+        //hit,wait if another thread is still sampling it
+        while (!entry->is_ready.load(std::memory_order_acquire)){
+            std::this_thread::yield();
+        }
+        m_hit_count++;
+    }
+    
+    bp = entry->bp.data();
+    bp_it = entry->bp_it.data();
+}
+
+PoseCache::Statistics PoseCache::GetStatistics() const{
+    Statistics statistics;
+    statistics.hit_count = m_hit_count;
+    statistics.miss_count = m_miss_count;
+    statistics.sample_time = m_sample_time*1e-9;
+    if (statistics.miss_count != 0){
+        statistics.saved_time = statistics.sample_time/statistics.miss_count*statistics.hit_count;
+    }else{
+        statistics.saved_time = 0;
+    }
+    return statistics;
+}
+
+void PoseCache::ResetStatistics(){
+    m_hit_count = 0;
+    m_miss_count = 0;
+    m_sample_time = 0;
+}
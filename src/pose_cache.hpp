@@ -0,0 +1,64 @@
+#ifndef POSE_CACHE_HPP
+#define POSE_CACHE_HPP
+
+#include "library.hpp"
+#include "define.hpp"
+#include "matrix.hpp"
+
+#include <atomic>
+#include <mutex>
+
+class Animation;
+class Skeleton;
+struct BoneRemap;
+
+
+//poses shared by every controller in a frame
+//key = (clip,rig,quantized time,sample rate)
+//the first request of a key samples the clip,later requests in the same frame only read it
+class PoseCache{
+public:
+    struct Statistics{
+        size_t hit_count;
+        size_t miss_count;
+        double sample_time;//seconds spent sampling on misses
+        double saved_time; //estimated seconds saved by hits
+    };
+private:
+    struct Key{
+        const Animation* animation;
+        const Skeleton* rig;//poses are in the bone order of the rig
+        long long quantized_time;
+        double sample_rate;
+        bool operator<(const Key& key) const;
+    };
+    struct Entry{
+        std::atomic<bool> is_ready;
+        std::vector<mat4> bp;   //size = bone_count
+        std::vector<mat4> bp_it;//size = bone_count
+    };
+    
+    std::mutex m_mutex;
+    std::map<Key,Entry*> m_entries;//entries of the current frame
+    std::vector<Entry*> m_entry_pool;//entries are reused across frames
+    size_t m_used_entry_count;
+    
+    std::atomic<size_t> m_hit_count;
+    std::atomic<size_t> m_miss_count;
+    std::atomic<long long> m_sample_time;//nanoseconds
+public:
+    PoseCache();
+    ~PoseCache();
+    
+    //invalidate poses of the previous frame
+    void BeginFrame();
+    
+    //pose of animation for skeleton at time quantized to sample_rate,remap is animation->GetBoneRemap(skeleton)
+    //safe to call from several threads at once
+    void Lookup(const Animation* animation,const Skeleton& skeleton,const BoneRemap* remap,double time,double sample_rate,const mat4*& bp,const mat4*& bp_it);
+    
+    Statistics GetStatistics() const;
+    void ResetStatistics();
+};
+
+#endif // POSE_CACHE_HPP
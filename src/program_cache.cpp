@@ -0,0 +1,185 @@
+#include "program_cache.hpp"
+#include "mapped_file.hpp"
+
+#include <cstring>
+
+
+//file layout
+//header,driver string,then every entry followed by its binary
+static const char PGB_MAGIC[4] = {'P','G','B','1'};
+struct PGBHeader{
+    char magic[4];
+    uint32_t entry_count;
+    uint64_t driver_size;
+};
+struct PGBEntry{
+    uint64_t key;
+    uint32_t format;
+    uint32_t size;
+};
+
+//fnv-1a
+static uint64_t hash_string(uint64_t hash,const std::string& s){
+    for (size_t i = 0;i < s.size();i++){
+        hash = (hash^(unsigned char)s[i])*1099511628211ULL;
+    }
+    return (hash^0xff)*1099511628211ULL;//terminator,so that "ab"+"c" and "a"+"bc" differ
+}
+
+static std::string get_gl_string(GLenum name){
+    const GLubyte* s = glGetString(name);
+    return (s != NULL) ? std::string((const char*)s) : std::string();
+}
+
+
+ProgramCache* ProgramCache::m_instance = nullptr;
+
+ProgramCache::ProgramCache(const std::string& path):m_path(path),m_is_enabled(false),m_is_dirty(false){
+    m_statistics.hit_count = 0;
+    m_statistics.miss_count = 0;
+    m_statistics.reject_count = 0;
+
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,&format_count);
+    m_is_enabled = (format_count > 0);
+    m_driver = get_gl_string(GL_VENDOR)+"/"+get_gl_string(GL_RENDERER)+"/"+get_gl_string(GL_VERSION);
+    if (!m_is_enabled){
+        return;
+    }
+
+    //read the whole file,an absent,broken or foreign file gives an empty cache
+    int64_t file_time;
+    uint64_t file_size;
+    if (!GetFileStamp(path,file_time,file_size)){
+        return;
+    }
+    std::FILE* fp = std::fopen(path.c_str(),"rb");
+    if (fp == NULL){
+        return;
+    }
+    PGBHeader header;
+    bool is_read = std::fread(&header,sizeof(header),1,fp) == 1
+                && std::memcmp(header.magic,PGB_MAGIC,4) == 0
+                && header.driver_size == m_driver.size();
+    std::string driver(is_read ? header.driver_size : 0,'\0');
+    is_read = is_read && std::fread(&driver[0],1,driver.size(),fp) == driver.size() && driver == m_driver;
+    uint64_t offset = sizeof(header)+driver.size();
+    for (uint32_t i = 0;i < header.entry_count && is_read;i++){
+        //a size beyond the end of the file is a truncated or corrupt entry,not an allocation to attempt
+        PGBEntry entry;
+        is_read = std::fread(&entry,sizeof(entry),1,fp) == 1;
+        offset += sizeof(entry);
+        is_read = is_read && entry.size <= file_size-std::min(offset,file_size);
+        if (is_read){
+            offset += entry.size;
+            Entry& cached = m_entries[entry.key];
+            cached.format = (GLenum)entry.format;
+            cached.binary.resize(entry.size);
+            is_read = std::fread(cached.binary.data(),1,entry.size,fp) == entry.size;
+        }
+    }
+    std::fclose(fp);
+    if (!is_read){
+        m_entries.clear();
+    }
+}
+
+ProgramCache::~ProgramCache(){
+    if (m_is_dirty){
+        Save();
+    }
+}
+
+void ProgramCache::CreateInstance(const std::string& path){
+    if (m_instance == nullptr){
+        m_instance = new ProgramCache(path);
+    }
+}
+
+void ProgramCache::DeleteInstance(){
+    delete m_instance;
+    m_instance = nullptr;
+}
+
+ProgramCache* ProgramCache::GetInstance(){
+    return m_instance;
+}
+
+bool ProgramCache::IsEnabled() const{
+    return m_is_enabled;
+}
+
+uint64_t ProgramCache::GetKey(const std::string& vs_source,const std::string& fs_source) const{
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hash_string(hash,m_driver);
+    hash = hash_string(hash,vs_source);
+    hash = hash_string(hash,fs_source);
+    return hash;
+}
+
+bool ProgramCache::Load(GLuint program,uint64_t key){
+    auto i = m_entries.find(key);
+    if (!m_is_enabled || i == m_entries.end()){
+        m_statistics.miss_count++;
+        return false;
+    }
+
+    //the driver may still refuse a binary of its own,e.g. after an update with the same version string
+    glProgramBinary(program,i->second.format,i->second.binary.data(),(GLsizei)i->second.binary.size());
+    GLint state;
+    glGetProgramiv(program,GL_LINK_STATUS,&state);
+    if (state == GL_FALSE){
+        m_entries.erase(i);
+        m_is_dirty = true;
+        m_statistics.reject_count++;
+        m_statistics.miss_count++;
+        return false;
+    }
+    m_statistics.hit_count++;
+    return true;
+}
+
+void ProgramCache::Store(GLuint program,uint64_t key){
+    if (!m_is_enabled){
+        return;
+    }
+    GLint size = 0;
+    glGetProgramiv(program,GL_PROGRAM_BINARY_LENGTH,&size);
+    if (size <= 0){
+        return;
+    }
+    Entry& entry = m_entries[key];
+    entry.binary.resize(size);
+    GLsizei length = 0;
+    glGetProgramBinary(program,size,&length,&entry.format,entry.binary.data());
+    entry.binary.resize(length);
+    m_is_dirty = true;
+}
+
+ProgramCache::Statistics ProgramCache::GetStatistics() const{
+    return m_statistics;
+}
+
+bool ProgramCache::Save() const{
+    PGBHeader header;
+    std::memcpy(header.magic,PGB_MAGIC,4);
+    header.entry_count = (uint32_t)m_entries.size();
+    header.driver_size = m_driver.size();
+    bool is_written = WriteFileAtomically(m_path,[&](std::FILE* fp){
+        bool is_written = std::fwrite(&header,sizeof(header),1,fp) == 1;
+        is_written = is_written && std::fwrite(m_driver.data(),1,m_driver.size(),fp) == m_driver.size();
+        for (auto i = m_entries.begin();i != m_entries.end() && is_written;++i){
+            PGBEntry entry;
+            entry.key = i->first;
+            entry.format = (uint32_t)i->second.format;
+            entry.size = (uint32_t)i->second.binary.size();
+            is_written = std::fwrite(&entry,sizeof(entry),1,fp) == 1;
+            is_written = is_written && std::fwrite(i->second.binary.data(),1,entry.size,fp) == entry.size;
+        }
+        return is_written;
+    });
+    if (!is_written){
+        std::cout << "failed to write program cache:" << m_path << "\n";
+    }
+    return is_written;
+}
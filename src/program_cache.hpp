@@ -0,0 +1,56 @@
+#ifndef PROGRAM_CACHE_HPP
+#define PROGRAM_CACHE_HPP
+
+#include "library.hpp"
+
+#include <OpenGL/gl3.h>
+
+
+//linked program binaries of the driver,so that later runs skip compiling and linking
+//an entry is keyed by a hash of the preprocessed sources and the driver string
+//the whole file is dropped when the driver string has changed,e.g. after a driver update
+//a driver without program binary formats gets a disabled cache
+class ProgramCache{
+public:
+    struct Statistics{
+        size_t hit_count;
+        size_t miss_count;
+        size_t reject_count;//cached binaries refused by the driver
+    };
+private:
+    struct Entry{
+        GLenum format;
+        std::vector<char> binary;
+    };
+
+    static ProgramCache* m_instance;
+
+    std::string m_path;
+    std::string m_driver;//vendor,renderer and version
+    bool m_is_enabled;
+    bool m_is_dirty;
+    std::map<uint64_t,Entry> m_entries;
+    Statistics m_statistics;
+private:
+    ProgramCache(const std::string& path);
+    ~ProgramCache();
+public:
+    //singleton,needs a current gl context
+    static void CreateInstance(const std::string& path);
+    static void DeleteInstance();//writes the file if a program was added
+    static ProgramCache* GetInstance();//nullptr if not created
+
+    bool IsEnabled() const;
+    uint64_t GetKey(const std::string& vs_source,const std::string& fs_source) const;
+
+    //links program from the cached binary,false if there is none or the driver refused it
+    bool Load(GLuint program,uint64_t key);
+    //program has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    void Store(GLuint program,uint64_t key);
+
+    ProgramCache::Statistics GetStatistics() const;
+private:
+    bool Save() const;
+};
+
+#endif // PROGRAM_CACHE_HPP
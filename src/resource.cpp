@@ -1,29 +1,101 @@
 #include "resource.hpp"
 #include "fbx_loader.hpp"
+#include "skinning.hpp"
+#include "pose_cache.hpp"
+#include "mesh_simplifier.hpp"
+#include "fbx_session.hpp"
+#include "texture_loader.hpp"
+#include "cooked_texture.hpp"
+#include "program_cache.hpp"
+#include "trace.hpp"
+#include "gl_counter.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 
+//a lod is dropped when it keeps more than this ratio of the previous lod triangles
+static const double MIN_LOD_REDUCTION = 0.9;
+
+//bone lod k disables bones whose subtree carries less than this share of the total skin weight
+static const double BONE_LOD_WEIGHT_SHARES[] = {0.005,0.02,0.05};
+static const size_t BONE_LOD_WEIGHT_SHARE_COUNT = sizeof(BONE_LOD_WEIGHT_SHARES)/sizeof(BONE_LOD_WEIGHT_SHARES[0]);
+
+
+
+Texture::Texture(){
+    //create opengl buffer with a gray texel
+    const unsigned char placeholder[4] = {128,128,128,255};
+    glGenTextures(1,&m_tbo_rgba);
+    Upload(1,1,placeholder);
+}
 
 Texture::Texture(const std::string& path){
-    //read texture by using stb
-    int w,h,n;
-    unsigned char* data = stbi_load(path.c_str(),&w,&h,&n,4);
-    if (data == NULL){
-        std::cout << "failed to create texture:" << path << "\n";
-        std::terminate();
+    //cooked image next to the source,or read texture by using stb and cook it
+    CookedTexture cooked;
+    const std::string& cooked_path = CookedTexture::GetCookedPath(path);
+    if (!cooked.Load(cooked_path,path)){
+        auto t0 = std::chrono::steady_clock::now();
+        int w,h,n;
+        unsigned char* data = stbi_load(path.c_str(),&w,&h,&n,4);
+        if (data == NULL){
+            std::cout << "failed to create texture:" << path << "\n";
+            std::terminate();
+        }
+        cooked.Cook(w,h,data);
+        stbi_image_free(data);
+        auto t1 = std::chrono::steady_clock::now();
+        cooked.Save(cooked_path,path,std::chrono::duration<double>(t1-t0).count());
     }
     
     //create opengl buffer
     glGenTextures(1,&m_tbo_rgba);
+    Upload(cooked);
+}
+
+void Texture::Upload(int width,int height,const unsigned char* rgba){
     glBindTexture(GL_TEXTURE_2D,m_tbo_rgba);
-    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,w,h,0,GL_RGBA,GL_UNSIGNED_BYTE,data);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,width,height,0,GL_RGBA,GL_UNSIGNED_BYTE,rgba);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_BASE_LEVEL,0);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,0);
     glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
     glBindTexture(GL_TEXTURE_2D,0);
-    
-    stbi_image_free(data);
+}
+
+void Texture::Upload(const CookedTexture& cooked){
+    //levels straight from the cooked data,e.g. the mapped file
+    const std::vector<CookedTexture::Level>& levels = cooked.GetLevels();
+    glBindTexture(GL_TEXTURE_2D,m_tbo_rgba);
+    for (size_t i = 0;i < levels.size();i++){
+        glTexImage2D(GL_TEXTURE_2D,(GLint)i,GL_RGBA,levels[i].width,levels[i].height,0,GL_RGBA,GL_UNSIGNED_BYTE,levels[i].rgba);
+    }
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_BASE_LEVEL,0);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,(GLint)levels.size()-1);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D,0);
+}
+
+void Texture::Allocate(const CookedTexture& cooked){
+    //gl 3.3 has no immutable storage,so every level is defined once with its final size
+    const std::vector<CookedTexture::Level>& levels = cooked.GetLevels();
+    glBindTexture(GL_TEXTURE_2D,m_tbo_rgba);
+    for (size_t i = 0;i < levels.size();i++){
+        glTexImage2D(GL_TEXTURE_2D,(GLint)i,GL_RGBA,levels[i].width,levels[i].height,0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_BASE_LEVEL,(GLint)levels.size()-1);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,(GLint)levels.size()-1);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D,0);
+}
+
+void Texture::UploadLevel(int level,int width,int height,const void* rgba){
+    GLCounter::BindTexture(GL_TEXTURE_2D,m_tbo_rgba);
+    GLCounter::TexSubImage2D(GL_TEXTURE_2D,level,0,0,width,height,GL_RGBA,GL_UNSIGNED_BYTE,rgba);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_BASE_LEVEL,level);
+    GLCounter::BindTexture(GL_TEXTURE_2D,0);
 }
 
 Texture::~Texture(){
@@ -32,8 +104,8 @@ Texture::~Texture(){
 
 void Texture::Bind(GLint uniform_location,GLint texture_unit) const{
     glActiveTexture(GL_TEXTURE0+texture_unit);
-    glBindTexture(GL_TEXTURE_2D,m_tbo_rgba);
-    glUniform1i(uniform_location,texture_unit);
+    GLCounter::BindTexture(GL_TEXTURE_2D,m_tbo_rgba);
+    GLCounter::Uniform1i(uniform_location,texture_unit);
 }
 
 
@@ -44,64 +116,120 @@ void Texture::Bind(GLint uniform_location,GLint texture_unit) const{
 
 
 
-Shader::Shader(const std::string& vs_path,const std::string& fs_path){
+Shader::Shader(const std::string& vs_path,const std::string& fs_path,const std::vector<std::string>& defines):m_vs(0),m_fs(0),m_key(0),m_is_cached(false){
+    TRACE_ZONE_ARG("Shader::Shader",vs_path);
+    
     //read shader file
     std::string vs_file,fs_file;
     ReadFile(vs_file,vs_path);
     ReadFile(fs_file,fs_path);
+    InsertDefines(vs_file,defines);
+    InsertDefines(fs_file,defines);
+    m_name = vs_path+","+fs_path;
+    for (size_t i = 0;i < defines.size();i++){
+        m_name += ","+defines[i];
+    }
+
+    //create program object
+    m_program = glCreateProgram();
+
+    //linked binary of a previous run
+    ProgramCache* cache = ProgramCache::GetInstance();
+    if (cache != nullptr){
+        m_key = cache->GetKey(vs_file,fs_file);
+        m_is_cached = cache->Load(m_program,m_key);
+        if (m_is_cached){
+            return;
+        }
+    }
+
     const char* vs_source = vs_file.c_str();
     const char* fs_source = fs_file.c_str();
     const GLint vs_length = vs_file.size();
     const GLint fs_length = fs_file.size();
 
     //create shader
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(vs,1,&vs_source,&vs_length);
-    glShaderSource(fs,1,&fs_source,&fs_length);
+    m_vs = glCreateShader(GL_VERTEX_SHADER);
+    m_fs = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(m_vs,1,&vs_source,&vs_length);
+    glShaderSource(m_fs,1,&fs_source,&fs_length);
 
     //compile shader
-    glCompileShader(vs);
-    glCompileShader(fs);
+    glCompileShader(m_vs);
+    glCompileShader(m_fs);
+
+    //attach shader
+    glAttachShader(m_program,m_vs);
+    glAttachShader(m_program,m_fs);
+
+    //link program
+    if (cache != nullptr && cache->IsEnabled()){
+        glProgramParameteri(m_program,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+    }
+    glLinkProgram(m_program);
+}
+
+void Shader::Finish(){
+    if (m_vs == 0){
+        return;
+    }
+    TRACE_ZONE_ARG("Shader::Finish",m_name);
 
     //compile error check
     GLint state;
-    glGetShaderiv(vs,GL_COMPILE_STATUS,&state);
+    GLchar log[1024];
+    glGetShaderiv(m_vs,GL_COMPILE_STATUS,&state);
     if (state == GL_FALSE){
-        std::cout << "failed to compile:" << vs_path << "\n";
+        glGetShaderInfoLog(m_vs,sizeof(log),NULL,log);
+        std::cout << "failed to compile:" << m_name << "\n" << log << "\n";
         std::terminate();
     }
-    glGetShaderiv(fs,GL_COMPILE_STATUS,&state);
+    glGetShaderiv(m_fs,GL_COMPILE_STATUS,&state);
     if (state == GL_FALSE){
-        std::cout << "failed to compile:" << fs_path << "\n";
+        glGetShaderInfoLog(m_fs,sizeof(log),NULL,log);
+        std::cout << "failed to compile:" << m_name << "\n" << log << "\n";
         std::terminate();
     }
 
-    //create program object
-    m_program = glCreateProgram();
+    //link error check
+    glGetProgramiv(m_program,GL_LINK_STATUS,&state);
+    if (state == GL_FALSE){
+        glGetProgramInfoLog(m_program,sizeof(log),NULL,log);
+        std::cout << "failed to link:" << m_name << "\n" << log << "\n";
+        std::terminate();
+    }
 
-    //attach shader
-    glAttachShader(m_program,vs);
-    glAttachShader(m_program,fs);
-    
     //delete shader
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+    glDetachShader(m_program,m_vs);
+    glDetachShader(m_program,m_fs);
+    glDeleteShader(m_vs);
+    glDeleteShader(m_fs);
+    m_vs = 0;
+    m_fs = 0;
+
+    if (ProgramCache::GetInstance() != nullptr){
+        ProgramCache::GetInstance()->Store(m_program,m_key);
+    }
+}
 
-    //link program
-    glLinkProgram(m_program);
+bool Shader::IsCached() const{
+    return m_is_cached;
 }
 
 Shader::~Shader(){
+    if (m_vs != 0){
+        glDeleteShader(m_vs);
+        glDeleteShader(m_fs);
+    }
     glDeleteProgram(m_program);
 }
 
 void Shader::Bind() const{
-    glUseProgram(m_program);
+    GLCounter::UseProgram(m_program);
 }
 
 void Shader::UnBind() const{
-    glUseProgram(0);
+    GLCounter::UseProgram(0);
 }
 
 GLint Shader::GetUniformLocation(const std::string& name) const{
@@ -138,6 +266,20 @@ void Shader::ReadFile(std::string& text,const std::string& path){
     std::fclose(fp);
 }
 
+void Shader::InsertDefines(std::string& source,const std::vector<std::string>& defines){
+    //#version has to stay the first line,#line keeps line numbers of compile errors
+    size_t position = source.find('\n',source.find("#version"));
+    if (defines.empty() || position == std::string::npos){
+        return;
+    }
+    std::string text;
+    for (size_t i = 0;i < defines.size();i++){
+        text += "#define "+defines[i]+"\n";
+    }
+    text += "#line 2\n";
+    source.insert(position+1,text);
+}
+
 
 
 
@@ -162,6 +304,7 @@ void Material::AddTexture(const Texture* texture,const std::string& name){
     m_shader->Bind();
     m_textures.push_back(texture);
     m_uniform_locations.push_back(m_shader->GetUniformLocation(name));
+    m_uniform_names.push_back(name);
     m_shader->UnBind();
 }
 
@@ -171,6 +314,12 @@ void Material::Bind(GLint texture_unit_offset) const{
     }
 }
 
+void Material::Bind(const Shader* shader,GLint texture_unit_offset) const{
+    for (size_t i = 0;i < m_textures.size();i++){
+        m_textures[i]->Bind(shader->GetUniformLocation(m_uniform_names[i]),texture_unit_offset+(GLint)i);
+    }
+}
+
 
 
 
@@ -179,10 +328,48 @@ void Material::Bind(GLint texture_unit_offset) const{
 
 
 
-Skeleton::Skeleton(const std::vector<mat4>& bbp_i,const std::vector<mat4>& bbp_iti){
+Skeleton::Skeleton(const std::vector<mat4>& bbp_i,
+                   const std::vector<mat4>& bbp_iti,
+                   const std::vector<std::string>& bone_names,
+                   const std::vector<int>& parent_indices,
+                   SkinningMode skinning_mode){
     //bone count
     m_bone_count = bbp_i.size();
     
+    //skinning mode
+    m_skinning_mode = skinning_mode;
+    m_is_bind_pose_owner = true;
+    
+    //bind pose on cpu
+    m_bbp_i = bbp_i;
+    m_bbp_iti = bbp_iti;
+    
+    //hierarchy
+    m_bone_names = bone_names;
+    m_parent_indices = parent_indices;
+    m_rig = this;
+    
+    //lod 0 enables every bone
+    m_lod = 0;
+    m_pose_lod = 0;
+    m_lod_bones.resize(1);
+    m_lod_sources.resize(1);
+    for (size_t i = 0;i < m_bone_count;i++){
+        m_lod_bones[0].push_back((int)i);
+        m_lod_sources[0].push_back((int)i);
+    }
+    
+    //cpu skinning does not need textures
+    if (m_skinning_mode == CPU_SKINNING){
+        m_palette_xyz.resize(m_bone_count);
+        m_palette_normal.resize(m_bone_count);
+        m_tbo_bbp_i = 0;
+        m_tbo_bbp_iti = 0;
+        m_tbo_bp = 0;
+        m_tbo_bp_it = 0;
+        return;
+    }
+    
     //bbp_i
     glGenTextures(1,&m_tbo_bbp_i);
     glBindTexture(GL_TEXTURE_1D,m_tbo_bbp_i);
@@ -214,11 +401,68 @@ Skeleton::Skeleton(const std::vector<mat4>& bbp_i,const std::vector<mat4>& bbp_i
     glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
     glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
     glBindTexture(GL_TEXTURE_1D,0);
+    
+    //lod sources
+    m_tbo_lod_sources.push_back(CreateLODSourceTexture(m_lod_sources[0]));
+}
+
+Skeleton::Skeleton(const Skeleton* rig){
+    const Skeleton& source = *rig;
+    m_bone_count = source.m_bone_count;
+    m_skinning_mode = source.m_skinning_mode;
+    m_is_bind_pose_owner = false;
+    
+    //bind pose on cpu
+    m_bbp_i = source.m_bbp_i;
+    m_bbp_iti = source.m_bbp_iti;
+    
+    //hierarchy and lods are read through the rig
+    m_rig = source.m_rig;
+    m_lod = 0;
+    m_pose_lod = 0;
+    
+    //cpu skinning
+    m_palette_xyz = source.m_palette_xyz;
+    m_palette_normal = source.m_palette_normal;
+    
+    //shared bind pose
+    m_tbo_bbp_i = source.m_tbo_bbp_i;
+    m_tbo_bbp_iti = source.m_tbo_bbp_iti;
+    if (m_skinning_mode == CPU_SKINNING){
+        m_tbo_bp = 0;
+        m_tbo_bp_it = 0;
+        return;
+    }
+    
+    //bp
+    glGenTextures(1,&m_tbo_bp);
+    glBindTexture(GL_TEXTURE_1D,m_tbo_bp);
+    glTexImage1D(GL_TEXTURE_1D,0,GL_RGBA,4*m_bone_count,0,GL_RGBA,GL_FLOAT,NULL);
+    glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+    glBindTexture(GL_TEXTURE_1D,0);
+    
+    //bp_it
+    glGenTextures(1,&m_tbo_bp_it);
+    glBindTexture(GL_TEXTURE_1D,m_tbo_bp_it);
+    glTexImage1D(GL_TEXTURE_1D,0,GL_RGBA,4*m_bone_count,0,GL_RGBA,GL_FLOAT,NULL);
+    glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+    glBindTexture(GL_TEXTURE_1D,0);
+}
+
+Skeleton* Skeleton::CreateInstance(const Skeleton& rig){
+    return new Skeleton(&rig);
 }
 
 Skeleton::~Skeleton(){
-    glDeleteTextures(1,&m_tbo_bbp_i);
-    glDeleteTextures(1,&m_tbo_bbp_iti);
+    if (m_is_bind_pose_owner){
+        glDeleteTextures(1,&m_tbo_bbp_i);
+        glDeleteTextures(1,&m_tbo_bbp_iti);
+        if (!m_tbo_lod_sources.empty()){
+            glDeleteTextures((GLsizei)m_tbo_lod_sources.size(),m_tbo_lod_sources.data());
+        }
+    }
     glDeleteTextures(1,&m_tbo_bp);
     glDeleteTextures(1,&m_tbo_bp_it);
 }
@@ -227,43 +471,175 @@ size_t Skeleton::GetBoneCount() const{
     return m_bone_count;
 }
 
+SkinningMode Skeleton::GetSkinningMode() const{
+    return m_skinning_mode;
+}
+
+const std::vector<mat4>& Skeleton::GetBBPI() const{
+    return m_bbp_i;
+}
+
+const std::vector<mat4>& Skeleton::GetBBPITI() const{
+    return m_bbp_iti;
+}
+
+const Skeleton* Skeleton::GetRig() const{
+    return m_rig;
+}
+
+const std::vector<std::string>& Skeleton::GetBoneNames() const{
+    return m_rig->m_bone_names;
+}
+
+const std::vector<int>& Skeleton::GetParentIndices() const{
+    return m_rig->m_parent_indices;
+}
+
+void Skeleton::CreateLODs(const std::vector<double>& bone_weights){
+    //skin weight of each subtree,parents come before their children in skeleton order
+    //a parent carries at least the weight of its children,so enabled bones always have enabled ancestors
+    std::vector<double> subtree_weights(bone_weights);
+    double total_weight = 0;
+    for (size_t i = m_bone_count;i-- > 0;){
+        int parent = m_parent_indices[i];
+        if (parent != -1){
+            subtree_weights[parent] += subtree_weights[i];
+        }
+        total_weight += bone_weights[i];
+    }
+    
+    for (size_t k = 0;k < BONE_LOD_WEIGHT_SHARE_COUNT;k++){
+        std::vector<int> bones;
+        std::vector<int> sources(m_bone_count);
+        for (size_t i = 0;i < m_bone_count;i++){
+            int parent = m_parent_indices[i];
+            if (subtree_weights[i] >= BONE_LOD_WEIGHT_SHARES[k]*total_weight || parent == -1){
+                bones.push_back((int)i);
+                sources[i] = (int)i;
+            }else{
+                sources[i] = sources[parent];
+            }
+        }
+        
+        //a lod that disables nothing more is dropped
+        if (bones.size() == m_lod_bones.back().size()){
+            continue;
+        }
+        m_lod_bones.push_back(bones);
+        m_lod_sources.push_back(sources);
+        if (m_skinning_mode == GPU_SKINNING){
+            m_tbo_lod_sources.push_back(CreateLODSourceTexture(sources));
+        }
+    }
+}
+
+size_t Skeleton::GetLODCount() const{
+    return m_rig->m_lod_bones.size();
+}
+
+const std::vector<int>& Skeleton::GetLODBones(size_t lod) const{
+    return m_rig->m_lod_bones[lod];
+}
+
+void Skeleton::SetLOD(size_t lod){
+    m_lod = std::min(lod,GetLODCount()-1);
+}
+
+size_t Skeleton::GetLOD() const{
+    return m_lod;
+}
+
 void Skeleton::Update(const std::vector<mat4>& bp,const std::vector<mat4>& bp_it){
+    Update(bp.data(),bp_it.data());
+}
+
+void Skeleton::Update(const mat4* bp,const mat4* bp_it){
+    //pose holds only the enabled bones of the current lod
+    m_pose_lod = m_lod;
+    
+    //cpu skinning,disabled bones copy the palette of their source
+    if (m_skinning_mode == CPU_SKINNING){
+        const std::vector<int>& bones = GetLODBones(m_pose_lod);
+        for (size_t j = 0;j < bones.size();j++){
+            int i = bones[j];
+            m_palette_xyz[i] = bp[i]*m_bbp_i[i];
+            m_palette_normal[i] = bp_it[i]*m_bbp_iti[i];
+        }
+        if (bones.size() != m_bone_count){
+            const std::vector<int>& sources = m_rig->m_lod_sources[m_pose_lod];
+            for (size_t i = 0;i < m_bone_count;i++){
+                if (sources[i] != (int)i){
+                    m_palette_xyz[i] = m_palette_xyz[sources[i]];
+                    m_palette_normal[i] = m_palette_normal[sources[i]];
+                }
+            }
+        }
+        return;
+    }
+    
+    //gpu skinning,disabled bones are redirected to their source in the shader
+    
     //bp
-    glBindTexture(GL_TEXTURE_1D,m_tbo_bp);
-    glTexSubImage1D(GL_TEXTURE_1D,0,0,4*m_bone_count,GL_RGBA,GL_FLOAT,bp.data());
-    glBindTexture(GL_TEXTURE_1D,0);
+    GLCounter::BindTexture(GL_TEXTURE_1D,m_tbo_bp);
+    GLCounter::TexSubImage1D(GL_TEXTURE_1D,0,0,4*m_bone_count,GL_RGBA,GL_FLOAT,bp);
+    GLCounter::BindTexture(GL_TEXTURE_1D,0);
     
     //bp_it
-    glBindTexture(GL_TEXTURE_1D,m_tbo_bp_it);
-    glTexSubImage1D(GL_TEXTURE_1D,0,0,4*m_bone_count,GL_RGBA,GL_FLOAT,bp_it.data());
-    glBindTexture(GL_TEXTURE_1D,0);
+    GLCounter::BindTexture(GL_TEXTURE_1D,m_tbo_bp_it);
+    GLCounter::TexSubImage1D(GL_TEXTURE_1D,0,0,4*m_bone_count,GL_RGBA,GL_FLOAT,bp_it);
+    GLCounter::BindTexture(GL_TEXTURE_1D,0);
+}
+
+const std::vector<mat4>& Skeleton::GetPaletteXYZ() const{
+    return m_palette_xyz;
+}
+
+const std::vector<mat4>& Skeleton::GetPaletteNormal() const{
+    return m_palette_normal;
 }
 
 void Skeleton::Bind(GLint uniform_location_bbp_i,
                     GLint uniform_location_bbp_iti,
                     GLint uniform_location_bp,
                     GLint uniform_location_bp_it,
+                    GLint uniform_location_lod_source,
                     GLint texture_unit_offset) const
 {
     //bbp_i
     glActiveTexture(GL_TEXTURE0+texture_unit_offset+0);
-    glBindTexture(GL_TEXTURE_1D,m_tbo_bbp_i);
-    glUniform1i(uniform_location_bbp_i,texture_unit_offset+0);
+    GLCounter::BindTexture(GL_TEXTURE_1D,m_tbo_bbp_i);
+    GLCounter::Uniform1i(uniform_location_bbp_i,texture_unit_offset+0);
     
     //bbp_iti
     glActiveTexture(GL_TEXTURE0+texture_unit_offset+1);
-    glBindTexture(GL_TEXTURE_1D,m_tbo_bbp_iti);
-    glUniform1i(uniform_location_bbp_iti,texture_unit_offset+1);
+    GLCounter::BindTexture(GL_TEXTURE_1D,m_tbo_bbp_iti);
+    GLCounter::Uniform1i(uniform_location_bbp_iti,texture_unit_offset+1);
     
     //bp
     glActiveTexture(GL_TEXTURE0+texture_unit_offset+2);
-    glBindTexture(GL_TEXTURE_1D,m_tbo_bp);
-    glUniform1i(uniform_location_bp,texture_unit_offset+2);
+    GLCounter::BindTexture(GL_TEXTURE_1D,m_tbo_bp);
+    GLCounter::Uniform1i(uniform_location_bp,texture_unit_offset+2);
     
     //bp_it
     glActiveTexture(GL_TEXTURE0+texture_unit_offset+3);
-    glBindTexture(GL_TEXTURE_1D,m_tbo_bp_it);
-    glUniform1i(uniform_location_bp_it,texture_unit_offset+3);
+    GLCounter::BindTexture(GL_TEXTURE_1D,m_tbo_bp_it);
+    GLCounter::Uniform1i(uniform_location_bp_it,texture_unit_offset+3);
+    
+    //lod source
+    glActiveTexture(GL_TEXTURE0+texture_unit_offset+4);
+    GLCounter::BindTexture(GL_TEXTURE_1D,m_rig->m_tbo_lod_sources[m_pose_lod]);
+    GLCounter::Uniform1i(uniform_location_lod_source,texture_unit_offset+4);
+}
+
+GLuint Skeleton::CreateLODSourceTexture(const std::vector<int>& sources) const{
+    GLuint tbo;
+    glGenTextures(1,&tbo);
+    glBindTexture(GL_TEXTURE_1D,tbo);
+    glTexImage1D(GL_TEXTURE_1D,0,GL_R32I,(GLsizei)sources.size(),0,GL_RED_INTEGER,GL_INT,sources.data());
+    glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+    glBindTexture(GL_TEXTURE_1D,0);
+    return tbo;
 }
 
 
@@ -274,80 +650,244 @@ void Skeleton::Bind(GLint uniform_location_bbp_i,
 
 
 
-SubMesh::SubMesh(const std::vector<vec3>& xyz,
-                 const std::vector<vec2>& uv,
-                 const std::vector<vec3>& normal,
-                 const std::vector<int>& bone_index,
-                 const std::vector<FLOAT>& bone_weight,
-                 const Material* material)
+SubMesh::SubMesh(const IndexedMesh& mesh,
+                 const std::vector<size_t>& index_offsets,
+                 const std::vector<const Material*>& materials,
+                 bool is_cpu_skinning,
+                 const VertexQuantizer* quantizer,
+                 VertexLayout layout)
 {
-    //vao
-    glGenVertexArrays(1,&m_vao);
-    glBindVertexArray(m_vao);
-
+    //streams
+    const std::vector<vec3>& xyz = mesh.xyz;
+    const std::vector<vec2>& uv = mesh.uv;
+    const std::vector<vec3>& normal = mesh.normal;
+    const std::vector<int>& bone_index = mesh.bone_index;
+    const std::vector<FLOAT>& bone_weight = mesh.bone_weight;
+    
+    //quantize
+    //cpu skinning writes float xyz,normal,so only uv is quantized
+    QuantizedStreams streams;
+    if (quantizer != nullptr){
+        quantizer->Quantize(xyz,uv,normal,bone_index,bone_weight,streams,m_quantization_error);
+    }
+    bool is_quantized_xyz_normal = (quantizer != nullptr && !is_cpu_skinning);
+    
+    //attributes
+    //xyz and normal are rewritten every frame by cpu skinning,so they are dynamic
+    VertexLayoutBuilder builder(xyz.size());
+    
     //xyz
-    glGenBuffers(1,&m_vbo_xyz);
-    glBindBuffer(GL_ARRAY_BUFFER,m_vbo_xyz);
-    glBufferData(GL_ARRAY_BUFFER,sizeof(vec3)*xyz.size(),xyz.data(),GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,0,0);
-
+    if (is_quantized_xyz_normal){
+        //unorm16x4,w is padding
+        builder.AddAttribute(0,4,GL_UNSIGNED_SHORT,GL_TRUE,false,false,4*sizeof(uint16_t),streams.xyz.data());
+    }else{
+        builder.AddAttribute(0,3,GL_FLOAT,GL_FALSE,false,is_cpu_skinning,sizeof(vec3),xyz.data());
+    }
+    
     //uv
-    glGenBuffers(1,&m_vbo_uv);
-    glBindBuffer(GL_ARRAY_BUFFER,m_vbo_uv);
-    glBufferData(GL_ARRAY_BUFFER,sizeof(vec2)*uv.size(),uv.data(),GL_STATIC_DRAW);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1,2,GL_FLOAT,GL_FALSE,0,0);
+    if (quantizer != nullptr){
+        //half float,no decode in shader
+        builder.AddAttribute(1,2,GL_HALF_FLOAT,GL_FALSE,false,false,2*sizeof(uint16_t),streams.uv.data());
+    }else{
+        builder.AddAttribute(1,2,GL_FLOAT,GL_FALSE,false,false,sizeof(vec2),uv.data());
+    }
     
     //normal
-    glGenBuffers(1,&m_vbo_normal);
-    glBindBuffer(GL_ARRAY_BUFFER,m_vbo_normal);
-    glBufferData(GL_ARRAY_BUFFER,sizeof(vec3)*normal.size(),normal.data(),GL_STATIC_DRAW);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2,3,GL_FLOAT,GL_FALSE,0,0);
-    
-    //bone index
-    glGenBuffers(1,&m_vbo_bone_index);
-    glBindBuffer(GL_ARRAY_BUFFER,m_vbo_bone_index);
-    glBufferData(GL_ARRAY_BUFFER,sizeof(int)*bone_index.size(),bone_index.data(),GL_STATIC_DRAW);
-    glEnableVertexAttribArray(3);
-    glVertexAttribIPointer(3,4,GL_INT,0,0);//caution
-    
-    //bone weight
-    glGenBuffers(1,&m_vbo_bone_weight);
-    glBindBuffer(GL_ARRAY_BUFFER,m_vbo_bone_weight);
-    glBufferData(GL_ARRAY_BUFFER,sizeof(FLOAT)*bone_weight.size(),bone_weight.data(),GL_STATIC_DRAW);
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4,4,GL_FLOAT,GL_FALSE,0,0);
+    if (is_quantized_xyz_normal){
+        //octahedral snorm16x2,not normalized by gl because snorm conversion differs between gl versions
+        builder.AddAttribute(2,2,GL_SHORT,GL_FALSE,false,false,2*sizeof(int16_t),streams.normal.data());
+    }else{
+        builder.AddAttribute(2,3,GL_FLOAT,GL_FALSE,false,is_cpu_skinning,sizeof(vec3),normal.data());
+    }
+    
+    //bone index,bone weight
+    //cpu skinning consumes them on cpu side
+    std::vector<int> float_bone_index;
+    std::vector<FLOAT> float_bone_weight;
+    if (is_cpu_skinning || bone_index.empty()){
+        //no bone attribute
+    }else if (quantizer != nullptr){
+        //bone index,u8x4 or u16x4
+        if (quantizer->IsWideBoneIndex()){
+            builder.AddAttribute(3,4,GL_UNSIGNED_SHORT,GL_FALSE,true,false,4*sizeof(uint16_t),streams.bone_index16.data());
+        }else{
+            builder.AddAttribute(3,4,GL_UNSIGNED_BYTE,GL_FALSE,true,false,4*sizeof(uint8_t),streams.bone_index8.data());
+        }
+        
+        //bone weight,unorm8x4
+        builder.AddAttribute(4,4,GL_UNSIGNED_BYTE,GL_TRUE,false,false,4*sizeof(uint8_t),streams.bone_weight.data());
+    }else{
+        //unused slot(-1) becomes bone 0 with weight 0 as in the quantized and cpu paths,
+        //so the shader never fetches out of range and a zero weight always cancels the slot
+        float_bone_index.resize(bone_index.size());
+        float_bone_weight.resize(bone_weight.size());
+        for (size_t i = 0;i < bone_index.size();i++){
+            float_bone_index[i] = std::max(bone_index[i],0);
+            float_bone_weight[i] = (bone_index[i] < 0) ? 0 : bone_weight[i];
+        }
+        
+        //bone index
+        builder.AddAttribute(3,4,GL_INT,GL_FALSE,true,false,4*sizeof(int),float_bone_index.data());//caution
+        
+        //bone weight
+        builder.AddAttribute(4,4,GL_FLOAT,GL_FALSE,false,false,4*sizeof(FLOAT),float_bone_weight.data());
+    }
+    
+    //vao
+    glGenVertexArrays(1,&m_vao);
+    glBindVertexArray(m_vao);
+    
+    //vbo
+    m_layout = layout;
+    builder.Build(m_layout,m_streams);
+    
+    //ibo,16 bit indices when every vertex is addressable
+    m_vertex_count = xyz.size();
+    m_index_count = mesh.indices.size();
+    m_index_offsets = index_offsets;
+    glGenBuffers(1,&m_ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m_ibo);
+    if (m_vertex_count <= 65536){
+        std::vector<uint16_t> indices(mesh.indices.begin(),mesh.indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(uint16_t)*indices.size(),indices.data(),GL_STATIC_DRAW);
+        m_index_type = GL_UNSIGNED_SHORT;
+    }else{
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(uint32_t)*mesh.indices.size(),mesh.indices.data(),GL_STATIC_DRAW);
+        m_index_type = GL_UNSIGNED_INT;
+    }
     
     //unbind vao
     glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER,0);
     
-    //polygon vertex count
-    m_polygon_vertex_count = xyz.size();
+    //vertex buffer size,skinned xyz and normal vbo
+    m_vertex_buffer_size = 0;
+    m_vbo_xyz = 0;
+    m_vbo_normal = 0;
+    for (size_t i = 0;i < m_streams.size();i++){
+        m_vertex_buffer_size += (size_t)m_streams[i].stride*xyz.size();
+        if (is_cpu_skinning && m_streams[i].locations.size() == 1){
+            if (m_streams[i].locations[0] == 0){
+                m_vbo_xyz = m_streams[i].vbo;
+            }else if (m_streams[i].locations[0] == 2){
+                m_vbo_normal = m_streams[i].vbo;
+            }
+        }
+    }
     
     //material
-    m_material = material;
+    m_materials = materials;
+    
+    //skinning source,kept for every skeletal sub mesh so that vertex animation can be baked
+    if (!bone_index.empty()){
+        m_skinning = new CPUSkinning(xyz,normal,bone_index,bone_weight);
+    }else{
+        m_skinning = nullptr;
+    }
 }
 
 SubMesh::~SubMesh(){
     glDeleteVertexArrays(1,&m_vao);
-    glDeleteBuffers(1,&m_vbo_xyz);
-    glDeleteBuffers(1,&m_vbo_uv);
-    glDeleteBuffers(1,&m_vbo_normal);
-    glDeleteBuffers(1,&m_vbo_bone_index);
-    glDeleteBuffers(1,&m_vbo_bone_weight);
-    delete m_material;
+    glDeleteBuffers(1,&m_ibo);
+    for (size_t i = 0;i < m_streams.size();i++){
+        glDeleteBuffers(1,&m_streams[i].vbo);
+    }
+    for (size_t i = 0;i < m_materials.size();i++){
+        delete m_materials[i];
+    }
+    delete m_skinning;
 }
 
-void SubMesh::Draw() const{
-    glBindVertexArray(m_vao);
-    glDrawArrays(GL_TRIANGLES,0,m_polygon_vertex_count);
-    glBindVertexArray(0);
+void SubMesh::Bind() const{
+    GLCounter::BindVertexArray(m_vao);
+}
+
+void SubMesh::UnBind() const{
+    GLCounter::BindVertexArray(0);
+}
+
+void SubMesh::Draw(size_t lod,size_t range) const{
+    size_t index = std::min(lod,GetLODCount()-1)*m_materials.size()+range;
+    size_t index_size = (m_index_type == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+    const GLvoid* offset = (const GLvoid*)(m_index_offsets[index]*index_size);
+    GLsizei count = (GLsizei)(m_index_offsets[index+1]-m_index_offsets[index]);
+    GLCounter::DrawElements(GL_TRIANGLES,count,m_index_type,offset);
+}
+
+void SubMesh::DrawInstanced(size_t instance_count,size_t lod,size_t range) const{
+    size_t index = std::min(lod,GetLODCount()-1)*m_materials.size()+range;
+    size_t index_size = (m_index_type == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+    const GLvoid* offset = (const GLvoid*)(m_index_offsets[index]*index_size);
+    GLsizei count = (GLsizei)(m_index_offsets[index+1]-m_index_offsets[index]);
+    GLCounter::DrawElementsInstanced(GL_TRIANGLES,count,m_index_type,offset,instance_count);
+}
+
+size_t SubMesh::GetVertexCount() const{
+    return m_vertex_count;
+}
+
+size_t SubMesh::GetLODCount() const{
+    return (m_index_offsets.size()-1)/m_materials.size();
+}
+
+size_t SubMesh::GetDrawRangeCount() const{
+    return m_materials.size();
+}
+
+size_t SubMesh::GetTriangleCount(size_t lod) const{
+    size_t index = std::min(lod,GetLODCount()-1)*m_materials.size();
+    return (m_index_offsets[index+m_materials.size()]-m_index_offsets[index])/3;
+}
+
+size_t SubMesh::GetVertexBufferSize() const{
+    return m_vertex_buffer_size;
+}
+
+const QuantizationError& SubMesh::GetQuantizationError() const{
+    return m_quantization_error;
 }
 
-const Material* SubMesh::GetMaterial() const{
-    return m_material;
+VertexLayout SubMesh::GetLayout() const{
+    return m_layout;
+}
+
+const std::vector<VertexLayoutBuilder::Stream>& SubMesh::GetStreams() const{
+    return m_streams;
+}
+
+const CPUSkinning* SubMesh::GetSkinning() const{
+    return m_skinning;
+}
+
+const Material* SubMesh::GetMaterial(size_t range) const{
+    return m_materials[range];
+}
+
+void SubMesh::UpdateSkinning(const Skeleton& skeleton){
+    if (m_skinning == nullptr || m_vbo_xyz == 0){
+        return;
+    }
+    
+    //skin
+    m_skinning->Skin(skeleton.GetPaletteXYZ(),skeleton.GetPaletteNormal());
+    const std::vector<vec3>& xyz = m_skinning->GetSkinnedXYZ();
+    const std::vector<vec3>& normal = m_skinning->GetSkinnedNormal();
+    
+    //upload,orphan the old storage so that the driver does not wait for the previous draw
+    GLCounter::BindBuffer(GL_ARRAY_BUFFER,m_vbo_xyz);
+    GLCounter::BufferData(GL_ARRAY_BUFFER,sizeof(vec3)*xyz.size(),NULL,GL_DYNAMIC_DRAW);
+    GLCounter::BufferSubData(GL_ARRAY_BUFFER,0,sizeof(vec3)*xyz.size(),xyz.data());
+    GLCounter::BindBuffer(GL_ARRAY_BUFFER,m_vbo_normal);
+    GLCounter::BufferData(GL_ARRAY_BUFFER,sizeof(vec3)*normal.size(),NULL,GL_DYNAMIC_DRAW);
+    GLCounter::BufferSubData(GL_ARRAY_BUFFER,0,sizeof(vec3)*normal.size(),normal.data());
+    GLCounter::BindBuffer(GL_ARRAY_BUFFER,0);
+}
+
+FLOAT SubMesh::VerifySkinning(const Skeleton& skeleton){
+    if (m_skinning == nullptr){
+        return 0;
+    }
+    return m_skinning->Verify(skeleton.GetPaletteXYZ(),skeleton.GetPaletteNormal());
 }
 
 
@@ -360,47 +900,198 @@ const Material* SubMesh::GetMaterial() const{
 Mesh::Mesh(const std::string& asset_dir_path,
            const std::string& mesh_file_path,
            const Shader* shader,
-           bool is_skeletal)
+           const MeshImportSettings& settings)
 {
     //load fbx file
-    FBXMeshLoader loader(mesh_file_path);
+    FBXMeshLoader loader(mesh_file_path,settings.is_split_per_material);
     const std::vector<FBXMeshLoader::Mesh>& mh = loader.GetMeshes();
     const FBXMeshLoader::Skeleton& sn = loader.GetSkeleton();
     
     //create skeleton
-    if (is_skeletal){
-        m_skeleton = new Skeleton(sn.bbp_i,sn.bbp_iti);
+    if (settings.is_skeletal){
+        m_skeleton = new Skeleton(sn.bbp_i,sn.bbp_iti,sn.bone_names,sn.parent_indices,settings.skinning_mode);
+        
+        //skin weight of each bone for bone lods
+        std::vector<double> bone_weights(sn.bbp_i.size(),0);
+        for (size_t i = 0;i < mh.size();i++){
+            for (size_t j = 0;j < mh[i].bone_index.size();j++){
+                if (mh[i].bone_index[j] >= 0){
+                    bone_weights[mh[i].bone_index[j]] += mh[i].bone_weight[j];
+                }
+            }
+        }
+        m_skeleton->CreateLODs(bone_weights);
     }else{
         m_skeleton = nullptr;
     }
     
+    //vertex layout
+    m_vertex_layout = settings.vertex_layout;
+    
+    //create quantizer,every sub mesh shares the aabb of the whole mesh
+    m_vertex_format = settings.vertex_format;
+    m_quantizer = nullptr;
+    if (m_vertex_format == QUANTIZED_VERTEX){
+        vec3 xyz_min({INFINITY,INFINITY,INFINITY});
+        vec3 xyz_max({-INFINITY,-INFINITY,-INFINITY});
+        for (size_t i = 0;i < mh.size();i++){
+            for (size_t j = 0;j < mh[i].xyz.size();j++){
+                for (size_t k = 0;k < 3;k++){
+                    xyz_min[k] = std::min(xyz_min[k],mh[i].xyz[j][k]);
+                    xyz_max[k] = std::max(xyz_max[k],mh[i].xyz[j][k]);
+                }
+            }
+        }
+        m_quantizer = new VertexQuantizer(xyz_min,xyz_max,sn.bbp_i.size());
+    }
+    
     //normalizing transform
     m_normalizing_transform = loader.GetNormalizingTransform();
     
+    //bounding sphere,center of aabb
+    vec3 aabb_min({INFINITY,INFINITY,INFINITY});
+    vec3 aabb_max({-INFINITY,-INFINITY,-INFINITY});
+    for (size_t i = 0;i < mh.size();i++){
+        for (size_t j = 0;j < mh[i].xyz.size();j++){
+            for (size_t k = 0;k < 3;k++){
+                aabb_min[k] = std::min(aabb_min[k],mh[i].xyz[j][k]);
+                aabb_max[k] = std::max(aabb_max[k],mh[i].xyz[j][k]);
+            }
+        }
+    }
+    m_bounding_center = (aabb_min+aabb_max)*0.5;
+    m_bounding_radius = 0;
+    for (size_t i = 0;i < mh.size();i++){
+        for (size_t j = 0;j < mh[i].xyz.size();j++){
+            m_bounding_radius = std::max(m_bounding_radius,length(mh[i].xyz[j]-m_bounding_center));
+        }
+    }
+    
     //create sub meshes
     m_sub_meshes.resize(mh.size());
+    m_optimization_reports.resize(mh.size());
+    m_lod_count = 1;
+    bool is_textured = (shader->GetUniformLocation("diffuse_texture") != -1);
     for (size_t i = 0;i < m_sub_meshes.size();i++){
-        
+        //index,bone streams are dropped for non skeletal mesh
+        IndexedMesh indexed_mesh;
+        if (settings.is_skeletal){
+            BuildIndexedMesh(mh[i].xyz,mh[i].uv,mh[i].normal,mh[i].bone_index,mh[i].bone_weight,indexed_mesh);
+        }else{
+            BuildIndexedMesh(mh[i].xyz,mh[i].uv,mh[i].normal,std::vector<int>(),std::vector<FLOAT>(),indexed_mesh);
+        }
+        
+        OptimizationReport& report = m_optimization_reports[i];
+        report.vertex_count = indexed_mesh.GetVertexCount();
+        report.triangle_count = indexed_mesh.GetTriangleCount();
+        report.before = ComputeVertexCacheStatistics(indexed_mesh.indices,indexed_mesh.GetVertexCount(),VERTEX_CACHE_SIZE);
+        
+        //draw ranges,triangle order of the indexed mesh is the polygon order of the fbx mesh
+        //ranges whose materials bind the same texture are merged,so that every range needs a material bind
+        //a shader without texture draws the whole sub mesh as one range
+        std::vector<std::string> textures;
+        std::vector<std::vector<uint32_t>> range_indices;
+        for (size_t j = 0;j < mh[i].draw_ranges.size();j++){
+            const FBXMeshLoader::DrawRange& range = mh[i].draw_ranges[j];
+            const std::string& texture = is_textured ? range.texture : std::string();
+            size_t r = std::find(textures.begin(),textures.end(),texture)-textures.begin();
+            if (r == textures.size()){
+                textures.push_back(texture);
+                range_indices.push_back(std::vector<uint32_t>());
+            }
+            std::vector<uint32_t>::const_iterator first = indexed_mesh.indices.begin()+3*range.first_polygon;
+            range_indices[r].insert(range_indices[r].end(),first,first+3*range.polygon_count);
+        }
+        if (range_indices.empty()){
+            textures.push_back(std::string());
+            range_indices.push_back(indexed_mesh.indices);
+        }
+        size_t range_count = range_indices.size();
+        
+        //lod chain of each range,every level halves the triangle count of the previous one
+        //material borders are open borders of a range,so the simplifier keeps them in place
+        std::vector<std::vector<std::vector<uint32_t>>> lods(range_count);//[range][level]
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (size_t r = 0;r < range_count;r++){
+            lods[r].push_back(range_indices[r]);
+            if (settings.lod_count > 1){
+                std::vector<size_t> target_triangle_counts;
+                for (size_t j = 1;j < settings.lod_count;j++){
+                    target_triangle_counts.push_back((range_indices[r].size()/3)>>j);
+                }
+                MeshSimplifier simplifier(indexed_mesh,range_indices[r]);
+                simplifier.Simplify(target_triangle_counts,lods[r]);
+            }
+        }
+        report.simplification_time = std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+        
+        //levels which do not reduce the whole sub mesh enough are dropped
+        std::vector<size_t> levels(1,0);
+        size_t previous_index_count = indexed_mesh.indices.size();
+        for (size_t j = 1;j < lods[0].size();j++){
+            size_t index_count = 0;
+            for (size_t r = 0;r < range_count;r++){
+                index_count += lods[r][j].size();
+            }
+            if (index_count <= MIN_LOD_REDUCTION*previous_index_count){
+                levels.push_back(j);
+                previous_index_count = index_count;
+            }
+        }
+        
+        //optimize each range of each lod
+        if (settings.is_optimized){
+            for (size_t j = 0;j < levels.size();j++){
+                for (size_t r = 0;r < range_count;r++){
+                    std::vector<uint32_t>& indices = lods[r][levels[j]];
+                    std::vector<size_t> hard_boundaries;
+                    OptimizeVertexCache(indices,indexed_mesh.GetVertexCount(),VERTEX_CACHE_SIZE,hard_boundaries);
+                    OptimizeOverdraw(indices,indexed_mesh.xyz,hard_boundaries,VERTEX_CACHE_SIZE,1.05);
+                }
+            }
+        }
+        
+        //concatenate into one index buffer,lod major so that a lod is contiguous
+        //vertex fetch order follows lod 0
+        std::vector<size_t> index_offsets(1,0);
+        indexed_mesh.indices.clear();
+        report.lod_triangle_counts.clear();
+        for (size_t j = 0;j < levels.size();j++){
+            for (size_t r = 0;r < range_count;r++){
+                const std::vector<uint32_t>& indices = lods[r][levels[j]];
+                indexed_mesh.indices.insert(indexed_mesh.indices.end(),indices.begin(),indices.end());
+                index_offsets.push_back(indexed_mesh.indices.size());
+            }
+            report.lod_triangle_counts.push_back((index_offsets.back()-index_offsets[j*range_count])/3);
+        }
+        std::vector<uint32_t> lod0_indices(indexed_mesh.indices.begin(),indexed_mesh.indices.begin()+index_offsets[range_count]);
+        report.after = ComputeVertexCacheStatistics(lod0_indices,indexed_mesh.GetVertexCount(),VERTEX_CACHE_SIZE);
+        if (settings.is_optimized){
+            OptimizeVertexFetch(indexed_mesh);
+        }
+        m_lod_count = std::max(m_lod_count,levels.size());
+        
         //今回はマテリアルファイルを用意しない
         //通常、マテリアル、シェーダーの作成はマテリアルファイルのロード時に行うので、以下の処理はイレギュラー
         //通常、sub meshが持っているマテリアル名をキーにしてResourceManagerからマテリアルのインスタンスを得る
         //マテリアルファイルにシェーダー変数名と型のリストがあることを期待する
         
-        //create material
-        Material* material = new Material();
-        material->SetShader(shader);
-        if (mh[i].texture != ""){
-            //テクスチャ名が格納されているときのみロード
-            const Texture* texture = ResourceManager::GetInstance()->LoadTexture(asset_dir_path+"/texture/"+mh[i].texture);
-            material->AddTexture(texture,"diffuse_texture");
+        //create material of each range
+        std::vector<const Material*> materials(range_count);
+        for (size_t r = 0;r < range_count;r++){
+            Material* material = new Material();
+            material->SetShader(shader);
+            if (textures[r] != ""){
+                //テクスチャ名が格納されているときのみロード
+                const Texture* texture = ResourceManager::GetInstance()->LoadTexture(asset_dir_path+"/texture/"+textures[r]);
+                material->AddTexture(texture,"diffuse_texture");
+            }
+            materials[r] = material;
         }
         
         //create sub mesh
-        if (is_skeletal){
-            m_sub_meshes[i] = new SubMesh(mh[i].xyz,mh[i].uv,mh[i].normal,mh[i].bone_index,mh[i].bone_weight,material);
-        }else{
-            m_sub_meshes[i] = new SubMesh(mh[i].xyz,mh[i].uv,mh[i].normal,std::vector<int>(),std::vector<FLOAT>(),material);
-        }
+        bool is_cpu_skinning = (settings.is_skeletal && settings.skinning_mode == CPU_SKINNING);
+        m_sub_meshes[i] = new SubMesh(indexed_mesh,index_offsets,materials,is_cpu_skinning,m_quantizer,m_vertex_layout);
     }
 }
 
@@ -409,6 +1100,7 @@ Mesh::~Mesh(){
         delete m_sub_meshes[i];
     }
     delete m_skeleton;
+    delete m_quantizer;
 }
 
 const SubMesh* Mesh::GetSubMesh(size_t index) const{
@@ -423,10 +1115,80 @@ Skeleton* Mesh::GetSkeleton() const{
     return m_skeleton;
 }
 
+VertexFormat Mesh::GetVertexFormat() const{
+    return m_vertex_format;
+}
+
+VertexLayout Mesh::GetVertexLayout() const{
+    return m_vertex_layout;
+}
+
+void Mesh::BindDequantization(const Shader* shader) const{
+    if (m_quantizer == nullptr){
+        return;
+    }
+    const vec3& xyz_min = m_quantizer->GetXYZMin();
+    const vec3& xyz_extent = m_quantizer->GetXYZExtent();
+    GLCounter::Uniform3fv(shader->GetUniformLocation("xyz_min"),1,(const GLfloat*)&xyz_min);
+    GLCounter::Uniform3fv(shader->GetUniformLocation("xyz_extent"),1,(const GLfloat*)&xyz_extent);
+}
+
+size_t Mesh::GetVertexBufferSize() const{
+    size_t size = 0;
+    for (size_t i = 0;i < m_sub_meshes.size();i++){
+        size += m_sub_meshes[i]->GetVertexBufferSize();
+    }
+    return size;
+}
+
+const Mesh::OptimizationReport& Mesh::GetOptimizationReport(size_t sub_mesh_index) const{
+    return m_optimization_reports[sub_mesh_index];
+}
+
+size_t Mesh::GetLODCount() const{
+    return m_lod_count;
+}
+
+const vec3& Mesh::GetBoundingCenter() const{
+    return m_bounding_center;
+}
+
+FLOAT Mesh::GetBoundingRadius() const{
+    return m_bounding_radius;
+}
+
+QuantizationError Mesh::GetQuantizationError() const{
+    QuantizationError error;
+    for (size_t i = 0;i < m_sub_meshes.size();i++){
+        error.Merge(m_sub_meshes[i]->GetQuantizationError());
+    }
+    return error;
+}
+
 mat4 Mesh::GetNormalizingTransform() const{
     return m_normalizing_transform;
 }
 
+void Mesh::UpdateSkinning(){
+    if (m_skeleton == nullptr || m_skeleton->GetSkinningMode() != CPU_SKINNING){
+        return;
+    }
+    for (size_t i = 0;i < m_sub_meshes.size();i++){
+        m_sub_meshes[i]->UpdateSkinning(*m_skeleton);
+    }
+}
+
+FLOAT Mesh::VerifySkinning(){
+    FLOAT error = 0;
+    if (m_skeleton == nullptr || m_skeleton->GetSkinningMode() != CPU_SKINNING){
+        return error;
+    }
+    for (size_t i = 0;i < m_sub_meshes.size();i++){
+        error = std::max(error,m_sub_meshes[i]->VerifySkinning(*m_skeleton));
+    }
+    return error;
+}
+
 
 
 
@@ -437,30 +1199,93 @@ mat4 Mesh::GetNormalizingTransform() const{
 
 Animation::Animation(const std::string& path){
     //load fbx file
-    FBXAnimationLoader loader(path);
+    FBXAnimationLoader loader(path,false);
     const FBXAnimationLoader::Animation& an = loader.GetAnimation();
     
     m_duration = an.duration;
     m_frame_count = an.frame_count;
-    m_bp = an.bp;
-    m_bp_it = an.bp_it;
+    m_bone_count = an.bp.size()/an.frame_count;
+    m_bp_data = an.bp;
+    m_bp_it_data = an.bp_it;
+    m_bp = m_bp_data.data();
+    m_bp_it = m_bp_it_data.data();
+    m_bone_names = an.bone_names;
+    m_database = nullptr;
+    m_clip = nullptr;
 }
 
-Animation::~Animation(){}
+Animation::Animation(double duration,
+                     size_t frame_count,
+                     const std::vector<mat4>& bp,
+                     const std::vector<mat4>& bp_it,
+                     const std::vector<std::string>& bone_names)
+    :m_duration(duration),m_frame_count(frame_count),m_bp_data(bp),m_bp_it_data(bp_it),m_bone_names(bone_names)
+{
+    m_bone_count = bp.size()/frame_count;
+    m_bp = m_bp_data.data();
+    m_bp_it = m_bp_it_data.data();
+    m_database = nullptr;
+    m_clip = nullptr;
+}
+
+Animation::Animation(AnimationDatabase* database,const AnimationDatabase::Clip& clip)
+    :m_duration(clip.duration),m_frame_count(clip.frame_count),m_bone_count(clip.bone_count),m_bone_names(clip.bone_names)
+{
+    m_bp = clip.bp;
+    m_bp_it = clip.bp_it;
+    m_database = database;
+    m_clip = &clip;
+}
+
+Animation::~Animation(){
+    for (auto i = m_remaps.begin();i != m_remaps.end();++i){
+        delete i->second;
+    }
+}
 
 double Animation::GetDuration() const{
     return m_duration;
 }
 
-void Animation::Sample(std::vector<mat4>& bp,std::vector<mat4>& bp_it,double time) const{
-    //bone count
-    size_t bone_count = m_bp.size()/m_frame_count;
-    
-    //check bp size
-    if (bone_count != bp.size()){
-        std::cout << "Error/AnimationClip::SampleBonePose" << "\n";
-        std::terminate();
+size_t Animation::GetFrameCount() const{
+    return m_frame_count;
+}
+
+size_t Animation::GetBoneCount() const{
+    return m_bone_count;
+}
+
+const std::vector<std::string>& Animation::GetBoneNames() const{
+    return m_bone_names;
+}
+
+const mat4* Animation::GetBP() const{
+    return m_bp;
+}
+
+const mat4* Animation::GetBPIT() const{
+    return m_bp_it;
+}
+
+bool Animation::IsMapped() const{
+    return m_database != nullptr;
+}
+
+void Animation::Prefetch() const{
+    if (m_database != nullptr){
+        m_database->Prefetch(*m_clip);
     }
+}
+
+void Animation::Sample(std::vector<mat4>& bp,std::vector<mat4>& bp_it,const Skeleton& skeleton,double time) const{
+    bp.resize(skeleton.GetBoneCount());
+    bp_it.resize(skeleton.GetBoneCount());
+    Sample(bp.data(),bp_it.data(),skeleton,GetBoneRemap(skeleton),0,time);
+}
+
+void Animation::Sample(mat4* bp,mat4* bp_it,const Skeleton& skeleton,const BoneRemap* remap,size_t lod,double time) const{
+    const std::vector<int>& bones = skeleton.GetLODBones(lod);
+    size_t clip_bone_count = GetBoneCount();
     
     //frame interval
     double frame_interval = m_duration/(m_frame_count-1);
@@ -478,17 +1303,94 @@ void Animation::Sample(std::vector<mat4>& bp,std::vector<mat4>& bp_it,double tim
     double w = (time-frame_interval*sampled_frame)/frame_interval;
     
     //linear interpolation
+    const mat4* bp1 = m_bp+sampled_frame*clip_bone_count;
+    const mat4* bp2 = m_bp+(sampled_frame+1)*clip_bone_count;
+    const mat4* bp_it1 = m_bp_it+sampled_frame*clip_bone_count;
+    const mat4* bp_it2 = m_bp_it+(sampled_frame+1)*clip_bone_count;
+    if (remap->is_identity){
+        for (size_t j = 0;j < bones.size();j++){
+            int i = bones[j];
+            bp[i] = bp1[i]*(1-w)+bp2[i]*w;
+            bp_it[i] = bp_it1[i]*(1-w)+bp_it2[i]*w;
+        }
+        return;
+    }
+    
+    //through the remap,parents are written before their children
+    //parents of enabled bones are enabled,so a missing bone always finds its parent written
+    for (size_t j = 0;j < bones.size();j++){
+        int i = bones[j];
+        int clip_bone = remap->clip_bones[i];
+        int parent = remap->parents[i];
+        if (clip_bone != -1){
+            bp[i] = bp1[clip_bone]*(1-w)+bp2[clip_bone]*w;
+            bp_it[i] = bp_it1[clip_bone]*(1-w)+bp_it2[clip_bone]*w;
+        }else if (parent != -1){
+            bp[i] = bp[parent]*remap->offsets[i];
+            bp_it[i] = bp_it[parent]*remap->offsets_it[i];
+        }else{
+            bp[i] = remap->offsets[i];
+            bp_it[i] = remap->offsets_it[i];
+        }
+    }
+}
+
+const BoneRemap* Animation::GetBoneRemap(const Skeleton& skeleton) const{
+    std::lock_guard<std::mutex> lock(m_remap_mutex);
+    BoneRemap*& remap = m_remaps[skeleton.GetRig()];
+    if (remap == nullptr){
+        remap = CreateBoneRemap(skeleton);
+    }
+    return remap;
+}
+
+BoneRemap* Animation::CreateBoneRemap(const Skeleton& skeleton) const{
+    const std::vector<std::string>& names = skeleton.GetBoneNames();
+    const std::vector<int>& parent_indices = skeleton.GetParentIndices();
+    const std::vector<mat4>& bbp_i = skeleton.GetBBPI();
+    const std::vector<mat4>& bbp_iti = skeleton.GetBBPITI();
+    size_t bone_count = skeleton.GetBoneCount();
+    
+    //clip bone by name
+    std::map<std::string,int> clip_bones;
+    for (size_t i = 0;i < m_bone_names.size();i++){
+        clip_bones[m_bone_names[i]] = (int)i;
+    }
+    
+    BoneRemap* remap = new BoneRemap();
+    remap->clip_bones.assign(bone_count,-1);
+    remap->parents.assign(bone_count,-1);
+    remap->offsets.resize(bone_count);
+    remap->offsets_it.resize(bone_count);
+    remap->is_identity = (bone_count == GetBoneCount());
+    size_t missing_count = 0;
     for (size_t i = 0;i < bone_count;i++){
-        //bp
-        const mat4& m1 = m_bp[sampled_frame*bone_count+i];
-        const mat4& m2 = m_bp[(sampled_frame+1)*bone_count+i];
-        bp[i] = m1*(1-w)+m2*w;
+        auto clip_bone = clip_bones.find(names[i]);
+        if (clip_bone != clip_bones.end()){
+            remap->clip_bones[i] = clip_bone->second;
+            remap->is_identity = remap->is_identity && (clip_bone->second == (int)i);
+            continue;
+        }
+        remap->is_identity = false;
+        missing_count++;
         
-        //bp_it
-        const mat4& m3 = m_bp_it[sampled_frame*bone_count+i];
-        const mat4& m4 = m_bp_it[(sampled_frame+1)*bone_count+i];
-        bp_it[i] = m3*(1-w)+m4*w;
+        //bp*bbp_i of the bone follows the parent,inverse(bbp_i) = transpose(bbp_iti)
+        //a parent later in the skeleton order cannot be followed and falls back to the bind pose
+        int parent = parent_indices[i];
+        if (parent != -1 && parent < (int)i){
+            remap->parents[i] = parent;
+            remap->offsets[i] = bbp_i[parent]*bbp_iti[i].Transpose();
+            remap->offsets_it[i] = bbp_iti[parent]*bbp_i[i].Transpose();
+        }else{
+            remap->offsets[i] = bbp_iti[i].Transpose();
+            remap->offsets_it[i] = bbp_i[i].Transpose();
+        }
     }
+    
+    if (!remap->is_identity){
+        std::cout << "animation bone remap:" << bone_count-missing_count << " bones mapped," << missing_count << " bones follow the parent" << "\n";
+    }
+    return remap;
 }
 
 
@@ -498,68 +1400,94 @@ void Animation::Sample(std::vector<mat4>& bp,std::vector<mat4>& bp_it,double tim
 
 
 
+PosePool::PosePool(size_t bone_count,size_t capacity){
+    m_bone_count = bone_count;
+    m_bp.resize(capacity*bone_count);
+    m_bp_it.resize(capacity*bone_count);
+    m_free_slots.reserve(capacity);
+    for (size_t i = 0;i < capacity;i++){
+        m_free_slots.push_back((int)(capacity-1-i));
+    }
+}
 
-AnimationController::AnimationController(Skeleton* skeleton,
-                                         const std::map<std::string,State>& states,
-                                         const std::string& entry_state_id)
-{
-    //check states
-    for (auto i = states.begin();i != states.end();++i){
-        const State& state = i->second;
-        
-        //auto transition
-        if (state.auto_transition_exist){
-            const Transition& transition = state.auto_transition;
-            if (states.count(transition.dst_state_id) == 0){
-                std::cout << "void AnimationController::Initialize" << "\n";
-                std::cout << "auto transition's dst state:" << transition.dst_state_id << "does not exist" << "\n";
-                std::terminate();
-            }
-        }
-        
-        //user transition
-        if (state.user_transition_exist){
-            for (auto j = state.user_transitions.begin();j != state.user_transitions.end();j++){
-                const Transition& transition = j->second;
-                if (states.count(transition.dst_state_id) == 0){
-                    std::cout << "void AnimationController::Initialize" << "\n";
-                    std::cout << "user transition's dst state:" << transition.dst_state_id << "does not exist" << "\n";
-                    std::terminate();
-                }
-            }
-        }
+size_t PosePool::GetBoneCount() const{
+    return m_bone_count;
+}
+
+int PosePool::Acquire(){
+    if (m_free_slots.empty()){
+        return -1;
     }
+    int slot = m_free_slots.back();
+    m_free_slots.pop_back();
+    return slot;
+}
+
+void PosePool::Release(int slot){
+    m_free_slots.push_back(slot);
+}
+
+mat4* PosePool::GetBP(int slot){
+    return &m_bp[slot*m_bone_count];
+}
+
+mat4* PosePool::GetBPIT(int slot){
+    return &m_bp_it[slot*m_bone_count];
+}
+
+
+
+
+
+
+
+
+const size_t AnimationController::MAX_LAYER_COUNT;
+
+AnimationController::AnimationController(Skeleton* skeleton,const AnimationStateGraph* graph)
+    :m_pose_pool(skeleton->GetBoneCount(),MAX_LAYER_COUNT+1)
+{
+    m_skeleton = skeleton;
+    m_graph = graph;
     
-    //check entry state
-    if (states.count(entry_state_id) == 0){
-        std::cout << "void AnimationController::Initialize" << "\n";
-        std::cout << "entry state:" << entry_state_id << "does not exist" << "\n";
-        std::terminate();
+    //remaps are resolved once here,so sampling on workers takes no lock
+    m_remaps.resize(m_graph->GetStateCount());
+    for (size_t i = 0;i < m_remaps.size();i++){
+        m_remaps[i] = m_graph->GetState((int)i).animation->GetBoneRemap(*m_skeleton);
     }
     
+    m_layer_count = 0;
+    m_pending_transition = AnimationStateGraph::NONE;
+    m_output_pose = m_pose_pool.Acquire();
     
-    m_skeleton = skeleton;
-    m_states = states;
+    m_pose_cache = nullptr;
+    m_pose_cache_sample_rate = 0;
     
-    m_current_time = 0;
-    m_current_state = &m_states.at(entry_state_id);
-    m_current_transition = nullptr;
+    m_result_bp = m_pose_pool.GetBP(m_output_pose);
+    m_result_bp_it = m_pose_pool.GetBPIT(m_output_pose);
     
-    for (int i = 0;i < 6;i++){
-        m_buf[i].resize(m_skeleton->GetBoneCount());
-    }
+    //entry state
+    PushLayer(m_graph->GetEntryState(),0,1,0);
 }
 
 AnimationController::~AnimationController(){}
 
+void AnimationController::SetPoseCache(PoseCache* pose_cache,double sample_rate){
+    m_pose_cache = pose_cache;
+    m_pose_cache_sample_rate = sample_rate;
+}
+
 void AnimationController::DoAutoTransition(){
     //遷移が既に発動しているならは発動しない
-    if (m_current_transition != nullptr){
+    //自動遷移は実行中の遷移を中断しない
+    if (m_pending_transition != AnimationStateGraph::NONE || m_layer_count != 1){
         return;
     }
     
     //現在のステートがそもそも自動遷移を持っていなかったら、発動しない
-    if (!m_current_state->auto_transition_exist){
+    const Layer& top = m_layers[m_layer_count-1];
+    const AnimationStateGraph::State& state = m_graph->GetState(top.state);
+    if (state.auto_transition == AnimationStateGraph::NONE){
         return;
     }
     
@@ -567,145 +1495,385 @@ void AnimationController::DoAutoTransition(){
     //遷移が発動する条件は
     //１　現在時刻が遷移区間に入った後（遷移区間はアニメーションの終端を含む）
     //２　遷移先の遷移区間がduration内に収まっていること
-    //現在時刻が自動遷移区間に入る前なら発動
-    const Transition& transition = m_current_state->auto_transition;
-    const State& dst_state = m_states.at(m_current_state->auto_transition.dst_state_id);
-    
-    double transition_beg1 = m_current_state->animation->GetDuration()*(1-transition.duration);
-    double transition_end1 = m_current_state->animation->GetDuration();
-    double transition_beg2 = dst_state.animation->GetDuration()*transition.offset;
-    double transition_end2 = transition_beg2+transition_end1-transition_beg1;
-    
-    if (m_current_time >= transition_beg1 && transition_end2 <= dst_state.animation->GetDuration()){
-        m_current_transition = &transition;
-        m_transition_beg1 = transition_beg1;
-        m_transition_end1 = transition_end1;
-        m_transition_beg2 = transition_beg2;
-        m_transition_end2 = transition_end2;
+    const AnimationStateGraph::Transition& transition = m_graph->GetTransition(state.auto_transition);
+    if (top.time >= transition.src_begin && transition.is_dst_fit){
+        StartTransition(state.auto_transition,top.time-transition.src_begin);
     }
 }
 
-void AnimationController::DoUserTransition(const std::string& trigger){
+void AnimationController::DoUserTransition(int keycode){
     //トリガーが未登録なら発動しない
-    if (m_current_state->user_transitions.count(trigger) == 0){
-        return;
-    }
-    
-    //遷移が既に発動しているなら発動しない
-    if (m_current_transition != nullptr){
+    const Layer& top = m_layers[m_layer_count-1];
+    int transition_index = m_graph->GetUserTransition(top.state,keycode);
+    if (transition_index == AnimationStateGraph::NONE){
         return;
     }
     
-    //現在のステートがそもそもユーザー遷移を持っていなかったら、発動しない
-    if (!m_current_state->user_transition_exist){
+    //遷移開始待ちの遷移があるなら発動しない
+    //クロスフェード中の遷移は中断される
+    if (m_pending_transition != AnimationStateGraph::NONE){
         return;
     }
     
     //ユーザー遷移の場合、遷移がimmediateかそうでないかで場合分けをする
-    const Transition& transition = m_current_state->user_transitions.at(trigger);
-    const State& dst_state = m_states.at(transition.dst_state_id);
+    const AnimationStateGraph::State& state = m_graph->GetState(top.state);
+    const AnimationStateGraph::Transition& transition = m_graph->GetTransition(transition_index);
     if (transition.is_immediate){
         //immediate
         //遷移が発動する条件は
         //１　遷移元の遷移区間がduration内に収まっていること（遷移区間はアニメーションの終端を含まない）
         //２　遷移先の遷移区間がduration内に収まっていること
-        double transition_beg1 = m_current_time;
-        double transition_end1 = transition_beg1+m_current_state->animation->GetDuration()*transition.duration;
-        double transition_beg2 = dst_state.animation->GetDuration()*transition.offset;
-        double transition_end2 = transition_beg2+transition_end1-transition_beg1;
-        
-        if (transition_end1 <= m_current_state->animation->GetDuration() && transition_end2 <= dst_state.animation->GetDuration()){
-            m_current_transition = &transition;
-            m_transition_beg1 = transition_beg1;
-            m_transition_end1 = transition_end1;
-            m_transition_beg2 = transition_beg2;
-            m_transition_end2 = transition_end2;
+        if (top.time+transition.length <= state.duration && transition.is_dst_fit){
+            StartTransition(transition_index,0);
         }
     }else{
         //non immediate
         //遷移が発動する条件は
         //１　現在時刻が遷移区間に入る前（遷移区間はアニメーションの終端を含む）
         //２　遷移先の遷移区間がduration内に収まっていること
-        double transition_beg1 = m_current_state->animation->GetDuration()*(1-transition.duration);
-        double transition_end1 = m_current_state->animation->GetDuration();
-        double transition_beg2 = dst_state.animation->GetDuration()*transition.offset;
-        double transition_end2 = transition_beg2+transition_end1-transition_beg1;
-        
-        if (m_current_time < transition_beg1 && transition_end2 <= dst_state.animation->GetDuration()){
-            m_current_transition = &transition;
-            m_transition_beg1 = transition_beg1;
-            m_transition_end1 = transition_end1;
-            m_transition_beg2 = transition_beg2;
-            m_transition_end2 = transition_end2;
+        //遷移区間に入った時点でクロスフェードを開始する
+        if (top.time < transition.src_begin && transition.is_dst_fit){
+            m_pending_transition = transition_index;
         }
     }
 }
 
 void AnimationController::UpdateAnimation(double dt){
-    //現在時刻を更新
-    m_current_time += dt;
+    TRACE_ZONE("UpdateAnimation");
+    Advance(dt);
+    Evaluate();
+    ApplyPose();
+}
+
+void AnimationController::Advance(double dt){
+    //現在時刻と重みを更新
+    for (size_t i = 0;i < m_layer_count;i++){
+        Layer& layer = m_layers[i];
+        layer.time += dt;
+        layer.weight += layer.fade_rate*dt;
+        if (layer.weight >= 1){
+            layer.weight = 1;
+            layer.fade_rate = 0;
+        }
+    }
+    
+    //フェードアウトし終えたレイヤーを除去
+    for (size_t i = m_layer_count-1;i-- > 0;){
+        if (m_layers[i].weight <= 0){
+            RemoveLayer(i);
+        }
+    }
+    
+    //遷移開始待ちの遷移が遷移区間に入ったらクロスフェードを開始
+    if (m_pending_transition != AnimationStateGraph::NONE){
+        const Layer& top = m_layers[m_layer_count-1];
+        const AnimationStateGraph::Transition& transition = m_graph->GetTransition(m_pending_transition);
+        if (top.time >= transition.src_begin){
+            StartTransition(m_pending_transition,top.time-transition.src_begin);
+        }
+    }
     
     //自動遷移を発動させる
     //場合によってはキャンセルされる
     DoAutoTransition();
     
-    //遷移が発動中かどうかで場合分け
-    if (m_current_transition == nullptr){
-        //現在、遷移が発動していない
-        //アニメーションの終端を超えていたら時間をループさせる
-        if (m_current_time > m_current_state->animation->GetDuration()){
-            m_current_time = 0;
+    //遷移が発動していない時、アニメーションの終端を超えていたら時間をループさせる
+    //それ以外のレイヤーは終端で止める
+    for (size_t i = 0;i < m_layer_count;i++){
+        Layer& layer = m_layers[i];
+        double duration = m_graph->GetState(layer.state).duration;
+        if (layer.time > duration){
+            if (m_layer_count == 1 && m_pending_transition == AnimationStateGraph::NONE){
+                layer.time = 0;
+            }else{
+                layer.time = duration;
+            }
         }
+    }
+}
+
+void AnimationController::ApplyPose(){
+    //スケルトンの更新
+    m_skeleton->Update(m_result_bp,m_result_bp_it);
+}
+
+void AnimationController::SetTime(double time){
+    m_layers[m_layer_count-1].time = time;
+}
+
+int AnimationController::GetCurrentState() const{
+    return m_layers[m_layer_count-1].state;
+}
+
+size_t AnimationController::GetLayerCount() const{
+    return m_layer_count;
+}
+
+void AnimationController::StartTransition(int transition_index,double elapsed_time){
+    const AnimationStateGraph::Transition& transition = m_graph->GetTransition(transition_index);
+    m_pending_transition = AnimationStateGraph::NONE;
+    
+    //長さ0の遷移は即座に切り替える
+    if (transition.length <= 0){
+        while (m_layer_count != 0){
+            RemoveLayer(m_layer_count-1);
+        }
+        PushLayer(transition.dst_state,transition.dst_begin+elapsed_time,1,0);
+        return;
+    }
+    
+    //スタックが一杯なら最も古いレイヤーを捨てる
+    if (m_layer_count == MAX_LAYER_COUNT){
+        RemoveLayer(0);
+    }
+    
+    //既存のレイヤーは全て遷移の長さでフェードアウトする
+    for (size_t i = 0;i < m_layer_count;i++){
+        m_layers[i].fade_rate = -m_layers[i].weight/transition.length;
+    }
+    PushLayer(transition.dst_state,transition.dst_begin,0,1/transition.length);
+    
+    //遷移区間に入ってから経過した分だけ進める
+    for (size_t i = 0;i < m_layer_count;i++){
+        m_layers[i].weight = std::max(0.0,std::min(1.0,m_layers[i].weight+m_layers[i].fade_rate*elapsed_time));
+    }
+    m_layers[m_layer_count-1].time += elapsed_time;
+}
+
+void AnimationController::PushLayer(int state,double time,double weight,double fade_rate){
+    Layer& layer = m_layers[m_layer_count];
+    layer.state = state;
+    layer.time = time;
+    layer.weight = weight;
+    layer.fade_rate = fade_rate;
+    layer.pose = m_pose_pool.Acquire();
+    m_layer_count++;
+    
+    //the next transition can start from this state
+    m_graph->Prefetch(state);
+}
+
+void AnimationController::RemoveLayer(size_t index){
+    m_pose_pool.Release(m_layers[index].pose);
+    for (size_t i = index;i+1 < m_layer_count;i++){
+        m_layers[i] = m_layers[i+1];
+    }
+    m_layer_count--;
+}
+
+void AnimationController::Evaluate(){
+    //only the enabled bones of the skeleton lod are sampled and blended
+    size_t lod = m_skeleton->GetLOD();
+    const std::vector<int>& bones = m_skeleton->GetLODBones(lod);
+    
+    //pose of every layer,from the shared cache or sampled into the layer's own buffer
+    double weight_sum = 0;
+    const mat4* layer_bp[MAX_LAYER_COUNT];
+    const mat4* layer_bp_it[MAX_LAYER_COUNT];
+    for (size_t i = 0;i < m_layer_count;i++){
+        const Layer& layer = m_layers[i];
+        const Animation* animation = m_graph->GetState(layer.state).animation;
+        if (m_pose_cache != nullptr){
+            m_pose_cache->Lookup(animation,*m_skeleton,m_remaps[layer.state],layer.time,m_pose_cache_sample_rate,layer_bp[i],layer_bp_it[i]);
+        }else{
+            mat4* bp = m_pose_pool.GetBP(layer.pose);
+            mat4* bp_it = m_pose_pool.GetBPIT(layer.pose);
+            animation->Sample(bp,bp_it,*m_skeleton,m_remaps[layer.state],lod,layer.time);
+            layer_bp[i] = bp;
+            layer_bp_it[i] = bp_it;
+        }
+        weight_sum += layer.weight;
+    }
+    
+    //single layer needs no blend
+    if (m_layer_count == 1){
+        m_result_bp = layer_bp[0];
+        m_result_bp_it = layer_bp_it[0];
+        return;
+    }
+    
+    //normalized weights and source pointers
+    FLOAT w[MAX_LAYER_COUNT];
+    const FLOAT* bp[MAX_LAYER_COUNT];
+    const FLOAT* bp_it[MAX_LAYER_COUNT];
+    for (size_t i = 0;i < m_layer_count;i++){
+        w[i] = (weight_sum > 0) ? m_layers[i].weight/weight_sum : (FLOAT)1/m_layer_count;
+        bp[i] = (const FLOAT*)layer_bp[i];
+        bp_it[i] = (const FLOAT*)layer_bp_it[i];
+    }
+    
+    //fused accumulate over all layers,each output element is written once
+    FLOAT* out_bp = (FLOAT*)m_pose_pool.GetBP(m_output_pose);
+    FLOAT* out_bp_it = (FLOAT*)m_pose_pool.GetBPIT(m_output_pose);
+    for (size_t k = 0;k < bones.size();k++){
+        size_t offset = 16*bones[k];
+        for (size_t j = offset;j < offset+16;j++){
+            FLOAT a = 0;
+            FLOAT b = 0;
+            for (size_t i = 0;i < m_layer_count;i++){
+                a += w[i]*bp[i][j];
+                b += w[i]*bp_it[i][j];
+            }
+            out_bp[j] = a;
+            out_bp_it[j] = b;
+        }
+    }
+    m_result_bp = m_pose_pool.GetBP(m_output_pose);
+    m_result_bp_it = m_pose_pool.GetBPIT(m_output_pose);
+}
+
+
+
+
+
+
+
+
+const int AnimationStateGraph::NONE;
+const int AnimationStateGraph::KEYCODE_COUNT;
+
+AnimationStateGraph::AnimationStateGraph(const std::map<std::string,AnimationController::State>& states,
+                                         const std::string& entry_state_id)
+{
+    //state index
+    //std::map is ordered,so indices are stable for the same scene file
+    std::map<std::string,int> state_indices;
+    for (auto i = states.begin();i != states.end();++i){
+        state_indices[i->first] = (int)m_state_ids.size();
+        m_state_ids.push_back(i->first);
+    }
+    
+    //check entry state
+    if (state_indices.count(entry_state_id) == 0){
+        std::cout << "AnimationStateGraph::AnimationStateGraph" << "\n";
+        std::cout << "entry state:" << entry_state_id << "does not exist" << "\n";
+        std::terminate();
+    }
+    m_entry_state = state_indices.at(entry_state_id);
+    
+    //states
+    m_states.resize(states.size());
+    m_dispatch.assign(states.size()*KEYCODE_COUNT,NONE);
+    for (auto i = states.begin();i != states.end();++i){
+        int state_index = state_indices.at(i->first);
+        State& state = m_states[state_index];
+        state.animation = i->second.animation;
+        state.duration = i->second.animation->GetDuration();
+        state.auto_transition = NONE;
+    }
+    
+    //transitions
+    for (auto i = states.begin();i != states.end();++i){
+        int state_index = state_indices.at(i->first);
+        const AnimationController::State& src = i->second;
         
-        //現在のステートのアニメーションのみからサンプリング
-        m_current_state->animation->Sample(m_buf[0],m_buf[1],m_current_time);
-        
-        //スケルトンの更新
-        m_skeleton->Update(m_buf[0],m_buf[1]);
-    }else{
-        //現在、遷移が発動している
-        //クロスフェード対象区間に入る前か、入っている最中か、出た後かで場合分け
-        if (m_current_time < m_transition_beg1){
-            //入る前
-            //現在のステートのアニメーションのみからサンプリング
-            m_current_state->animation->Sample(m_buf[0],m_buf[1],m_current_time);
-            
-            //スケルトンの更新
-            m_skeleton->Update(m_buf[0],m_buf[1]);
-        }else if (m_current_time >= m_transition_beg1 && m_current_time <= m_transition_end1){
-            //入っている最中
-            //遷移元ステートの重み
-            double w = (m_transition_end1-m_current_time)/(m_transition_end1-m_transition_beg1);
-            
-            //遷移元ステートと遷移先ステートのアニメーションをサンプリングして線形補間
-            double time1 = m_current_time;
-            double time2 = m_transition_beg2+(m_current_time-m_transition_beg1);
-            m_current_state->animation->Sample(m_buf[0],m_buf[1],time1);
-            m_states.at(m_current_transition->dst_state_id).animation->Sample(m_buf[2],m_buf[3],time2);
-            
-            for (size_t i = 0;i < m_buf[0].size();i++){
-                m_buf[4][i] = m_buf[0][i]*w+m_buf[2][i]*(1-w);
-                m_buf[5][i] = m_buf[1][i]*w+m_buf[3][i]*(1-w);
+        //auto transition
+        if (src.auto_transition_exist){
+            const AnimationController::Transition& transition = src.auto_transition;
+            if (state_indices.count(transition.dst_state_id) == 0){
+                std::cout << "AnimationStateGraph::AnimationStateGraph" << "\n";
+                std::cout << "auto transition's dst state:" << transition.dst_state_id << "does not exist" << "\n";
+                std::terminate();
             }
             
-            //スケルトンの更新
-            m_skeleton->Update(m_buf[4],m_buf[5]);
-        }else if (m_current_time > m_transition_end1){
-            //出た後
-            //遷移終了
-            m_current_time = m_transition_end2+(m_current_time-m_transition_end1);
-            m_current_state = &m_states.at(m_current_transition->dst_state_id);
-            m_current_transition = nullptr;
-            
-            //現在のステートのアニメーションのみからサンプリング
-            m_current_state->animation->Sample(m_buf[0],m_buf[1],m_current_time);
-            
-            //スケルトンの更新
-            m_skeleton->Update(m_buf[0],m_buf[1]);
+            //自動遷移は全てnon immediateとして扱う
+            Transition t;
+            t.is_immediate = false;
+            t.dst_state = state_indices.at(transition.dst_state_id);
+            t.length = m_states[state_index].duration*transition.duration;
+            t.src_begin = m_states[state_index].duration*(1-transition.duration);
+            t.dst_begin = m_states[t.dst_state].duration*transition.offset;
+            t.is_dst_fit = (t.dst_begin+t.length <= m_states[t.dst_state].duration);
+            m_states[state_index].auto_transition = (int)m_transitions.size();
+            m_transitions.push_back(t);
+        }
+        
+        //user transition
+        if (src.user_transition_exist){
+            for (auto j = src.user_transitions.begin();j != src.user_transitions.end();++j){
+                const std::string& trigger = j->first;
+                const AnimationController::Transition& transition = j->second;
+                if (state_indices.count(transition.dst_state_id) == 0){
+                    std::cout << "AnimationStateGraph::AnimationStateGraph" << "\n";
+                    std::cout << "user transition's dst state:" << transition.dst_state_id << "does not exist" << "\n";
+                    std::terminate();
+                }
+                
+                //trigger is a single ascii character
+                if (trigger.size() != 1 || (unsigned char)trigger[0] >= KEYCODE_COUNT){
+                    std::cout << "AnimationStateGraph::AnimationStateGraph" << "\n";
+                    std::cout << "trigger:" << trigger << " is not a single ascii character,ignored" << "\n";
+                    continue;
+                }
+                
+                Transition t;
+                t.is_immediate = transition.is_immediate;
+                t.dst_state = state_indices.at(transition.dst_state_id);
+                t.length = m_states[state_index].duration*transition.duration;
+                t.src_begin = m_states[state_index].duration*(1-transition.duration);
+                t.dst_begin = m_states[t.dst_state].duration*transition.offset;
+                t.is_dst_fit = (t.dst_begin+t.length <= m_states[t.dst_state].duration);
+                m_dispatch[state_index*KEYCODE_COUNT+trigger[0]] = (int)m_transitions.size();
+                m_transitions.push_back(t);
+            }
+        }
+    }
+    
+    //animations reachable in one transition
+    for (size_t i = 0;i < m_states.size();i++){
+        State& state = m_states[i];
+        std::vector<int> transitions;
+        if (state.auto_transition != NONE){
+            transitions.push_back(state.auto_transition);
+        }
+        for (int j = 0;j < KEYCODE_COUNT;j++){
+            if (m_dispatch[i*KEYCODE_COUNT+j] != NONE){
+                transitions.push_back(m_dispatch[i*KEYCODE_COUNT+j]);
+            }
+        }
+        for (size_t j = 0;j < transitions.size();j++){
+            const Animation* animation = m_states[m_transitions[transitions[j]].dst_state].animation;
+            if (animation != state.animation && std::find(state.dst_animations.begin(),state.dst_animations.end(),animation) == state.dst_animations.end()){
+                state.dst_animations.push_back(animation);
+            }
         }
     }
 }
 
+size_t AnimationStateGraph::GetStateCount() const{
+    return m_states.size();
+}
+
+const AnimationStateGraph::State& AnimationStateGraph::GetState(int state) const{
+    return m_states[state];
+}
+
+const AnimationStateGraph::Transition& AnimationStateGraph::GetTransition(int transition) const{
+    return m_transitions[transition];
+}
+
+const std::string& AnimationStateGraph::GetStateId(int state) const{
+    return m_state_ids[state];
+}
+
+int AnimationStateGraph::GetEntryState() const{
+    return m_entry_state;
+}
+
+int AnimationStateGraph::GetUserTransition(int state,int keycode) const{
+    if (keycode < 0 || keycode >= KEYCODE_COUNT){
+        return NONE;
+    }
+    return m_dispatch[state*KEYCODE_COUNT+keycode];
+}
+
+void AnimationStateGraph::Prefetch(int state) const{
+    const std::vector<const Animation*>& animations = m_states[state].dst_animations;
+    for (size_t i = 0;i < animations.size();i++){
+        animations[i]->Prefetch();
+    }
+}
+
 
 
 
@@ -713,7 +1881,10 @@ void AnimationController::UpdateAnimation(double dt){
 
 
 ResourceManager* ResourceManager::m_instance = nullptr;
-ResourceManager::ResourceManager(){}
+ResourceManager::ResourceManager(){
+    m_animation_database = nullptr;
+    m_imported_animation_count = 0;
+}
 
 void ResourceManager::CreateInstance(){
     if (m_instance == nullptr){
@@ -737,7 +1908,15 @@ ResourceManager* ResourceManager::GetInstance(){
 
 Texture* ResourceManager::LoadTexture(const std::string& path){
     if (m_textures.count(path) == 0){
-        Texture* texture = new Texture(path);
+        //decoded on the loader workers when the loader exists,the placeholder is drawn until the upload
+        Texture* texture;
+        TextureLoader* loader = TextureLoader::GetInstance();
+        if (loader != nullptr){
+            texture = new Texture();
+            loader->Load(texture,path);
+        }else{
+            texture = new Texture(path);
+        }
         m_textures[path] = texture;
         return texture;
     }else{
@@ -745,23 +1924,49 @@ Texture* ResourceManager::LoadTexture(const std::string& path){
     }
 }
 
-Shader* ResourceManager::LoadShader(const std::string& vs_path,const std::string& fs_path){
-    if (m_shaders.count(vs_path+fs_path) == 0){
-        Shader* shader = new Shader(vs_path,fs_path);
-        m_shaders[vs_path+fs_path] = shader;
+Shader* ResourceManager::LoadShader(const std::string& vs_path,const std::string& fs_path,const std::vector<std::string>& defines){
+    const std::string& key = GetShaderKey(vs_path,fs_path,defines);
+    if (m_shaders.count(key) == 0){
+        Shader* shader = new Shader(vs_path,fs_path,defines);
+        shader->Finish();
+        m_shaders[key] = shader;
         return shader;
     }else{
-        return m_shaders.at(vs_path+fs_path);
+        return m_shaders.at(key);
+    }
+}
+
+void ResourceManager::PrecompileShaders(const std::vector<ShaderVariant>& variants){
+    //issue every compile before the first status query
+    std::vector<Shader*> shaders;
+    for (size_t i = 0;i < variants.size();i++){
+        const std::string& key = GetShaderKey(variants[i].vs_path,variants[i].fs_path,variants[i].defines);
+        if (m_shaders.count(key) == 0){
+            Shader* shader = new Shader(variants[i].vs_path,variants[i].fs_path,variants[i].defines);
+            m_shaders[key] = shader;
+            shaders.push_back(shader);
+        }
     }
+    for (size_t i = 0;i < shaders.size();i++){
+        shaders[i]->Finish();
+    }
+}
+
+std::string ResourceManager::GetShaderKey(const std::string& vs_path,const std::string& fs_path,const std::vector<std::string>& defines){
+    std::string key = vs_path+fs_path;
+    for (size_t i = 0;i < defines.size();i++){
+        key += "#"+defines[i];
+    }
+    return key;
 }
 
 Mesh* ResourceManager::LoadMesh(const std::string& asset_dir_path,
                                 const std::string& mesh_file_path,
                                 const Shader* shader,
-                                bool is_skeletal)
+                                const MeshImportSettings& settings)
 {
     if (m_meshes.count(mesh_file_path) == 0){
-        Mesh* mesh = new Mesh(asset_dir_path,mesh_file_path,shader,is_skeletal);
+        Mesh* mesh = new Mesh(asset_dir_path,mesh_file_path,shader,settings);
         m_meshes[mesh_file_path] = mesh;
         return mesh;
     }else{
@@ -770,15 +1975,118 @@ Mesh* ResourceManager::LoadMesh(const std::string& asset_dir_path,
 }
 
 Animation* ResourceManager::LoadAnimation(const std::string& path){
+    TRACE_ZONE_ARG("LoadAnimation",path);
+    if (m_animations.count(path) == 0 && LoadAnimationFromDatabase(path)){
+        return m_animations.at(path);
+    }
     if (m_animations.count(path) == 0){
+        //take of a multi take file
+        size_t separator = path.rfind('#');
+        if (separator != std::string::npos){
+            LoadAnimationTakes(path.substr(0,separator));
+            if (m_animations.count(path) == 0){
+                std::cout << "animation take is not found:" << path << "\n";
+                std::terminate();
+            }
+            return m_animations.at(path);
+        }
+        
         Animation* animation = new Animation(path);
         m_animations[path] = animation;
+        m_imported_animation_count++;
         return animation;
     }else{
         return m_animations.at(path);
     }
 }
 
+size_t ResourceManager::LoadAnimationTakes(const std::string& path){
+    //one import for all takes
+    FBXAnimationLoader loader(path,true);
+    RegisterAnimations(path,loader,true);
+    return loader.GetAnimations().size();
+}
+
+void ResourceManager::LoadAnimations(const std::vector<std::string>& paths){
+    TRACE_ZONE("ResourceManager::LoadAnimations");
+    
+    //files to import,a file referenced by a take is imported with all takes
+    std::vector<std::string> files;
+    std::vector<bool> is_all_takes;
+    for (size_t i = 0;i < paths.size();i++){
+        if (m_animations.count(paths[i]) != 0 || LoadAnimationFromDatabase(paths[i])){
+            continue;
+        }
+        size_t separator = paths[i].rfind('#');
+        const std::string& file = paths[i].substr(0,separator);
+        if (std::find(files.begin(),files.end(),file) == files.end()){
+            files.push_back(file);
+            is_all_takes.push_back(separator != std::string::npos);
+        }
+    }
+    
+    //import on the session workers,resource maps are only touched by this thread
+    std::vector<FBXAnimationLoader*> loaders(files.size(),nullptr);
+    FBXImportSession* session = FBXImportSession::GetInstance();
+    for (size_t i = 0;i < files.size();i++){
+        const std::string& file = files[i];
+        bool is_all = is_all_takes[i];
+        FBXAnimationLoader** loader = &loaders[i];
+        session->Enqueue([file,is_all,loader](){
+            *loader = new FBXAnimationLoader(file,is_all);
+        });
+    }
+    session->Wait();
+    
+    //register
+    for (size_t i = 0;i < files.size();i++){
+        RegisterAnimations(files[i],*loaders[i],is_all_takes[i]);
+        delete loaders[i];
+    }
+}
+
+void ResourceManager::RegisterAnimations(const std::string& path,const FBXAnimationLoader& loader,bool is_all_takes){
+    const std::vector<FBXAnimationLoader::Animation>& ans = loader.GetAnimations();
+    for (size_t i = 0;i < ans.size();i++){
+        const std::string& key = is_all_takes ? path+"#"+ans[i].name : path;
+        if (m_animations.count(key) == 0){
+            m_animations[key] = new Animation(ans[i].duration,ans[i].frame_count,ans[i].bp,ans[i].bp_it,ans[i].bone_names);
+            m_imported_animation_count++;
+        }
+    }
+}
+
+bool ResourceManager::LoadAnimationFromDatabase(const std::string& path){
+    if (m_animation_database == nullptr){
+        return false;
+    }
+    const AnimationDatabase::Clip* clip = m_animation_database->FindClip(path);
+    if (clip == nullptr){
+        return false;
+    }
+    m_animations[path] = new Animation(m_animation_database,*clip);
+    return true;
+}
+
+void ResourceManager::OpenAnimationDatabase(const std::string& path){
+    if (m_animation_database == nullptr){
+        m_animation_database = new AnimationDatabase(path);
+    }
+}
+
+void ResourceManager::SaveAnimationDatabase(const std::string& path){
+    if (m_imported_animation_count == 0){
+        return;
+    }
+    if (AnimationDatabase::Write(path,m_animations)){
+        m_imported_animation_count = 0;
+    }
+}
+
+const AnimationDatabase* ResourceManager::GetAnimationDatabase() const{
+    return m_animation_database;
+}
+
 void ResourceManager::UnLoadResource(){
     for (auto i = m_textures.begin();i != m_textures.end();++i){
         delete i->second;
@@ -796,4 +2104,8 @@ void ResourceManager::UnLoadResource(){
     m_shaders.clear();
     m_meshes.clear();
     m_animations.clear();
+    
+    //after the animations mapping it
+    delete m_animation_database;
+    m_animation_database = nullptr;
 }
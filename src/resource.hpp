@@ -5,8 +5,36 @@
 #include "define.hpp"
 #include "matrix.hpp"
 
+#include "vertex_format.hpp"
+#include "vertex_layout.hpp"
+#include "mesh_optimizer.hpp"
+#include "animation_database.hpp"
+
 #include <OpenGL/gl3.h>
+#include <mutex>
+
+class CookedTexture;
+class CPUSkinning;
+class FBXAnimationLoader;
+class PoseCache;
+
+
+enum SkinningMode{
+    GPU_SKINNING,//mesh.vert with SKELETAL
+    CPU_SKINNING,//CPUSkinning + mesh.vert
+};
+
 
+//how a mesh file is turned into gpu buffers
+struct MeshImportSettings{
+    bool is_skeletal;
+    SkinningMode skinning_mode;
+    VertexFormat vertex_format;
+    VertexLayout vertex_layout;
+    bool is_optimized;//vertex cache,overdraw and vertex fetch order
+    bool is_split_per_material;//one sub mesh per material instead of draw ranges in one sub mesh
+    size_t lod_count;//levels including the source mesh,1 disables simplification
+};
 
 
 class Texture{
@@ -16,26 +44,60 @@ private:
     
     GLuint m_tbo_rgba;
 public:
+    //1x1 placeholder,the image is set later by Upload,e.g. from TextureLoader
+    Texture();
+    //loads the cooked image or decodes and cooks it,and uploads at once
     Texture(const std::string& path);
     ~Texture();
     
+    //single level,bilinear
+    void Upload(int width,int height,const unsigned char* rgba);
+    //every level of the mip chain,trilinear
+    void Upload(const CookedTexture& cooked);
+    //storage of every level of cooked without pixels,trilinear
+    //levels are then uploaded from the smallest one,each UploadLevel makes its level the finest sampled one
+    void Allocate(const CookedTexture& cooked);
+    //rgba may be an offset into the bound pixel unpack buffer
+    void UploadLevel(int level,int width,int height,const void* rgba);
     void Bind(GLint uniform_location,GLint texture_unit) const;
 };
 
 
+//program built from shared sources,defines are inserted after #version,e.g. "SKELETAL"
 class Shader{
 private:
     GLuint m_program;
+    
+    //checked by Finish,0 once finished or when the program came from the binary cache
+    GLuint m_vs;
+    GLuint m_fs;
+    std::string m_name;
+    uint64_t m_key;
+    bool m_is_cached;
 public:
-    Shader(const std::string& vs_path,const std::string& fs_path);
+    //loads the program binary cache or issues compile and link
+    //status is not queried here,so the driver can compile several programs while the next one is issued
+    Shader(const std::string& vs_path,const std::string& fs_path,const std::vector<std::string>& defines);
     ~Shader();
     
+    //waits for compile and link,stores the binary into the cache
+    void Finish();
+    bool IsCached() const;
+    
     void Bind() const;
     void UnBind() const;
     
     GLint GetUniformLocation(const std::string& name) const;
 private:
     void ReadFile(std::string& text,const std::string& path);
+    static void InsertDefines(std::string& source,const std::vector<std::string>& defines);
+};
+
+
+struct ShaderVariant{
+    std::string vs_path;
+    std::string fs_path;
+    std::vector<std::string> defines;
 };
 
 
@@ -44,6 +106,7 @@ private:
     const Shader* m_shader;
     std::vector<const Texture*> m_textures;
     std::vector<GLint> m_uniform_locations;
+    std::vector<std::string> m_uniform_names;
 public:
     Material();
     void SetShader(const Shader* shader);
@@ -53,74 +116,187 @@ public:
     void AddTexture(const Texture* texture,const std::string& name);
     
     void Bind(GLint texture_unit_offset) const;
+    //bind with another shader than the material's one,uniform locations are looked up by name
+    void Bind(const Shader* shader,GLint texture_unit_offset) const;
 };
 
 
 class Skeleton{
 private:
     //CPU側でデータを持つべきか否か・・・
-    //std::vector<mat4> m_bbp_i;  //size = bone_count
-    //std::vector<mat4> m_bbp_iti;//size = bone_count
     //std::vector<mat4> m_bp;     //size = bone_count
     //std::vector<mat4> m_bp_it;  //size = bone_count
     
+    //bind pose is also kept on cpu for cpu skinning and vertex animation bake
+    std::vector<mat4> m_bbp_i;         //size = bone_count
+    std::vector<mat4> m_bbp_iti;       //size = bone_count
+    
+    //bone names and hierarchy,kept only by the bind pose owner
+    std::vector<std::string> m_bone_names;//size = bone_count
+    std::vector<int> m_parent_indices;    //-1 for roots,size = bone_count
+    const Skeleton* m_rig;                //bind pose owner,this or the rig of an instance
+    
+    //bone lod,kept only by the bind pose owner
+    //lod 0 enables every bone,a disabled bone takes the palette of its nearest enabled ancestor
+    std::vector<std::vector<int>> m_lod_bones;  //enabled bones of each lod in skeleton order
+    std::vector<std::vector<int>> m_lod_sources;//bone whose palette each bone uses,size = bone_count per lod
+    std::vector<GLuint> m_tbo_lod_sources;      //gpu skinning only,m_lod_sources of each lod
+    size_t m_lod;                               //per instance,lod of the next pose
+    size_t m_pose_lod;                          //lod of the uploaded pose,used by Bind
+    
+    //cpu skinning only
+    std::vector<mat4> m_palette_xyz;   //bp*bbp_i,size = bone_count
+    std::vector<mat4> m_palette_normal;//bp_it*bbp_iti,size = bone_count
+    
+    SkinningMode m_skinning_mode;
     size_t m_bone_count;
     
+    //gpu skinning only
     GLuint m_tbo_bbp_i;
     GLuint m_tbo_bbp_iti;
     GLuint m_tbo_bp;
     GLuint m_tbo_bp_it;
+    bool m_is_bind_pose_owner;
+private:
+    //instance of rig,see CreateInstance
+    explicit Skeleton(const Skeleton* rig);
 public:
-    Skeleton(const std::vector<mat4>& bbp_i,const std::vector<mat4>& bbp_iti);
+    Skeleton(const std::vector<mat4>& bbp_i,
+             const std::vector<mat4>& bbp_iti,
+             const std::vector<std::string>& bone_names,
+             const std::vector<int>& parent_indices,
+             SkinningMode skinning_mode);
     ~Skeleton();
+    //a copy would alias the gl textures of the source,instances are made only through CreateInstance
+    Skeleton(const Skeleton&) = delete;
+    Skeleton& operator=(const Skeleton&) = delete;
+    
+    //new instance of the same rig,shares the bind pose of rig and owns only the bone pose
+    //rig has to outlive the instance
+    static Skeleton* CreateInstance(const Skeleton& rig);
     
     size_t GetBoneCount() const;
+    SkinningMode GetSkinningMode() const;
+    
+    const std::vector<mat4>& GetBBPI() const;
+    const std::vector<mat4>& GetBBPITI() const;
+    
+    //every instance of a skeleton returns the same rig,animations cache their bone remap per rig
+    const Skeleton* GetRig() const;
+    const std::vector<std::string>& GetBoneNames() const;
+    const std::vector<int>& GetParentIndices() const;
+    
+    //appends lods disabling bones whose subtree carries a small share of the skin weight
+    //bone_weights = sum of skin weights of each bone over the mesh,call before creating instances
+    void CreateLODs(const std::vector<double>& bone_weights);
+    size_t GetLODCount() const;
+    const std::vector<int>& GetLODBones(size_t lod) const;
+    //sampling,blending and Update process only the enabled bones of the lod
+    void SetLOD(size_t lod);
+    size_t GetLOD() const;
     
     void Update(const std::vector<mat4>& bp,const std::vector<mat4>& bp_it);
+    void Update(const mat4* bp,const mat4* bp_it);
+    
+    //cpu skinning only
+    const std::vector<mat4>& GetPaletteXYZ() const;
+    const std::vector<mat4>& GetPaletteNormal() const;
     
     void Bind(GLint uniform_location_bbp_i,
               GLint uniform_location_bbp_iti,
               GLint uniform_location_bp,
               GLint uniform_location_bp_it,
+              GLint uniform_location_lod_source,
               GLint texture_unit_offset) const;
+private:
+    GLuint CreateLODSourceTexture(const std::vector<int>& sources) const;
 };
 
 
 class SubMesh{
 private:
     //CPU側でデータを持つべきか否か・・・
-    //std::vector<vec3> m_xyz;         //size = 3*polygon_count
-    //std::vector<vec2> m_uv;          //size = 3*polygon_count
-    //std::vector<vec3> m_normal;      //size = 3*polygon_count
-    //std::vector<int> m_bone_index;   //size = 4*3*polygon_count
-    //std::vector<FLOAT> m_bone_weight;//size = 4*3*polygon_count
+    //std::vector<vec3> m_xyz;         //size = vertex_count
+    //std::vector<vec2> m_uv;          //size = vertex_count
+    //std::vector<vec3> m_normal;      //size = vertex_count
+    //std::vector<int> m_bone_index;   //size = 4*vertex_count
+    //std::vector<FLOAT> m_bone_weight;//size = 4*vertex_count
     
     GLuint m_vao;
+    GLuint m_ibo;
+    std::vector<VertexLayoutBuilder::Stream> m_streams;
+    VertexLayout m_layout;
+    
+    //cpu skinning only,vbos of skinned xyz and normal
     GLuint m_vbo_xyz;
-    GLuint m_vbo_uv;
     GLuint m_vbo_normal;
-    GLuint m_vbo_bone_index;
-    GLuint m_vbo_bone_weight;
     
-    size_t m_polygon_vertex_count;
+    size_t m_vertex_count;
+    size_t m_index_count;
+    GLenum m_index_type;//GL_UNSIGNED_SHORT if vertex_count <= 65536
+    //index offset of each draw range of each lod,lod major,size = lod_count*draw_range_count+1
+    //every lod shares the ibo and vertex buffers
+    std::vector<size_t> m_index_offsets;
+    size_t m_vertex_buffer_size;//bytes,without index buffer
+    QuantizationError m_quantization_error;
+    
+    //size = draw_range_count
+    std::vector<const Material*> m_materials;
     
-    const Material* m_material;
+    //skeletal only,source of cpu skinning and vertex animation bake
+    //with cpu skinning,xyz and normal vbo are rewritten every frame
+    CPUSkinning* m_skinning;
 public:
-    SubMesh(const std::vector<vec3>& xyz,
-            const std::vector<vec2>& uv,
-            const std::vector<vec3>& normal,
-            const std::vector<int>& bone_index,
-            const std::vector<FLOAT>& bone_weight,
-            const Material* material);
+    //mesh.indices is the concatenation of all draw ranges of all lods,lod major
+    //index_offsets has lod_count*draw_range_count+1 entries,a draw range uses materials[range]
+    SubMesh(const IndexedMesh& mesh,
+            const std::vector<size_t>& index_offsets,
+            const std::vector<const Material*>& materials,
+            bool is_cpu_skinning,
+            const VertexQuantizer* quantizer,//nullptr for float vertex format
+            VertexLayout layout);
     ~SubMesh();
     
-    void Draw() const;
+    //vao is bound once for all draw ranges
+    void Bind() const;
+    void UnBind() const;
+    
+    //vao has to be bound,lod is clamped to the coarsest level of this sub mesh
+    void Draw(size_t lod,size_t range) const;
+    void DrawInstanced(size_t instance_count,size_t lod,size_t range) const;
+    
+    size_t GetVertexCount() const;
+    size_t GetLODCount() const;
+    size_t GetDrawRangeCount() const;
+    //total of all draw ranges
+    size_t GetTriangleCount(size_t lod) const;
+    size_t GetVertexBufferSize() const;
+    const QuantizationError& GetQuantizationError() const;
+    VertexLayout GetLayout() const;
+    const std::vector<VertexLayoutBuilder::Stream>& GetStreams() const;
     
-    const Material* GetMaterial() const;
+    //nullptr if not skeletal
+    const CPUSkinning* GetSkinning() const;
+    
+    //cpu skinning only
+    void UpdateSkinning(const Skeleton& skeleton);
+    FLOAT VerifySkinning(const Skeleton& skeleton);
+    
+    const Material* GetMaterial(size_t range) const;
 };
 
 
 class Mesh{
+public:
+    //vertex cache statistics of one sub mesh in import order and after optimization
+    struct OptimizationReport{
+        size_t vertex_count;
+        size_t triangle_count;
+        VertexCacheStatistics before;
+        VertexCacheStatistics after;
+        std::vector<size_t> lod_triangle_counts;
+        double simplification_time;//sec
+    };
 private:
     //sub mesh
     std::vector<SubMesh*> m_sub_meshes;
@@ -128,6 +304,21 @@ private:
     //skeleton
     Skeleton* m_skeleton;
     
+    //vertex format
+    VertexFormat m_vertex_format;
+    VertexQuantizer* m_quantizer;//nullptr for float vertex format
+    VertexLayout m_vertex_layout;
+    
+    //size = sub_mesh_count
+    std::vector<OptimizationReport> m_optimization_reports;
+    
+    //lod,max of sub meshes
+    size_t m_lod_count;
+    
+    //bounding sphere in mesh space
+    vec3 m_bounding_center;
+    FLOAT m_bounding_radius;
+    
     //今回だけの特別仕様
     //transform for normalizing mesh
     mat4 m_normalizing_transform;
@@ -136,7 +327,7 @@ public:
     Mesh(const std::string& asset_dir_path,
          const std::string& mesh_file_path,
          const Shader* shader,
-         bool is_skeletal);
+         const MeshImportSettings& settings);
     ~Mesh();
     
     const SubMesh* GetSubMesh(size_t index) const;
@@ -144,28 +335,122 @@ public:
     
     Skeleton* GetSkeleton() const;
     
+    VertexFormat GetVertexFormat() const;
+    VertexLayout GetVertexLayout() const;
+    //sets xyz_min and xyz_extent of the quantized shaders,does nothing for float vertex format
+    void BindDequantization(const Shader* shader) const;
+    //total of all sub meshes
+    size_t GetVertexBufferSize() const;
+    QuantizationError GetQuantizationError() const;
+    const OptimizationReport& GetOptimizationReport(size_t sub_mesh_index) const;
+    
+    size_t GetLODCount() const;
+    const vec3& GetBoundingCenter() const;
+    FLOAT GetBoundingRadius() const;
+    
+    //cpu skinning only
+    //skin all sub meshes with the current skeleton pose and upload the result
+    void UpdateSkinning();
+    //max difference between simd kernel and scalar reference
+    FLOAT VerifySkinning();
+    
     mat4 GetNormalizingTransform() const;
 };
 
 
+//maps the bones of a skeleton onto the bones of a clip by name
+//a bone missing from the clip keeps its bind pose offset from the parent,
+//so rigs with extra leaf bones or another bone order share one baked clip
+struct BoneRemap{
+    bool is_identity;
+    std::vector<int> clip_bones;  //clip bone of each skeleton bone,-1 if missing
+    std::vector<int> parents;     //skeleton bone a missing bone follows,-1 for bind pose
+    std::vector<mat4> offsets;    //bp of a missing bone = bp of parent*offset
+    std::vector<mat4> offsets_it; //bp_it of a missing bone = bp_it of parent*offset_it
+};
+
+
 class Animation{
 private:
     double m_duration;
     size_t m_frame_count;
-    std::vector<mat4> m_bp;   //size = frame_count*bone_count
-    std::vector<mat4> m_bp_it;//size = frame_count*bone_count
+    size_t m_bone_count;
+    const mat4* m_bp;   //size = frame_count*bone_count,m_bp_data or mapped database
+    const mat4* m_bp_it;//size = frame_count*bone_count,m_bp_it_data or mapped database
+    std::vector<mat4> m_bp_data;   //empty if the clip is in a database
+    std::vector<mat4> m_bp_it_data;//empty if the clip is in a database
+    std::vector<std::string> m_bone_names;//size = bone_count
+    
+    //nullptr if the clip is on the heap
+    AnimationDatabase* m_database;
+    const AnimationDatabase::Clip* m_clip;
+    
+    //built on the first request of each rig,the lock guards only the map
+    mutable std::mutex m_remap_mutex;
+    mutable std::map<const Skeleton*,BoneRemap*> m_remaps;
 public:
     Animation(const std::string& path);
+    Animation(double duration,
+              size_t frame_count,
+              const std::vector<mat4>& bp,
+              const std::vector<mat4>& bp_it,
+              const std::vector<std::string>& bone_names);
+    //clip data stays in the mapped file,database has to outlive the animation
+    Animation(AnimationDatabase* database,const AnimationDatabase::Clip& clip);
     ~Animation();
     
     double GetDuration() const;
+    size_t GetFrameCount() const;
+    size_t GetBoneCount() const;
+    const std::vector<std::string>& GetBoneNames() const;
+    const mat4* GetBP() const;
+    const mat4* GetBPIT() const;
+    //true if clip data is in a mapped database
+    bool IsMapped() const;
+    
+    //asks the os to page in a clip of a database,nothing for clips on the heap
+    void Prefetch() const;
+    
+    //remap of the rig of skeleton onto this clip,valid for every instance of the rig
+    //takes a lock,so per frame callers resolve it once when they are bound to a rig
+    const BoneRemap* GetBoneRemap(const Skeleton& skeleton) const;
     
-    void Sample(std::vector<mat4>& bp,std::vector<mat4>& bp_it,double time) const;
+    //writes bones in the bone order of skeleton,the vector version writes every bone and resolves the remap itself
+    //the pointer version writes only the enabled bones of the skeleton lod,remap is GetBoneRemap(skeleton)
+    //safe to call from several threads at once
+    void Sample(std::vector<mat4>& bp,std::vector<mat4>& bp_it,const Skeleton& skeleton,double time) const;
+    void Sample(mat4* bp,mat4* bp_it,const Skeleton& skeleton,const BoneRemap* remap,size_t lod,double time) const;
+private:
+    BoneRemap* CreateBoneRemap(const Skeleton& skeleton) const;
 };
 
 
+//fixed set of pose buffers allocated once from the bone count
+class PosePool{
+private:
+    size_t m_bone_count;
+    std::vector<mat4> m_bp;   //size = capacity*bone_count
+    std::vector<mat4> m_bp_it;//size = capacity*bone_count
+    std::vector<int> m_free_slots;
+public:
+    PosePool(size_t bone_count,size_t capacity);
+    
+    size_t GetBoneCount() const;
+    
+    //-1 if every slot is in use
+    int Acquire();
+    void Release(int slot);
+    
+    mat4* GetBP(int slot);
+    mat4* GetBPIT(int slot);
+};
+
+
+class AnimationStateGraph;
+
 class AnimationController{
 public:
+    //authoring form,compiled into AnimationStateGraph
     struct Transition{
         bool is_immediate;
         double duration;//normalized time [0,1]
@@ -179,31 +464,113 @@ public:
         Transition auto_transition;
         std::map<std::string,Transition> user_transitions;//key == trigger
     };
+    //one entry of the blend stack
+    struct Layer{
+        int state;
+        double time;     //local time of the state's animation
+        double weight;   //normalized over the stack at evaluation
+        double fade_rate;//weight change per second
+        int pose;        //pose pool slot
+    };
+    static const size_t MAX_LAYER_COUNT = 8;
 private:
     Skeleton* m_skeleton;
     
-    std::map<std::string,State> m_states;
+    const AnimationStateGraph* m_graph;
+    std::vector<const BoneRemap*> m_remaps;//size = state count,animation of each state onto the rig of m_skeleton
+    
+    //blend stack,the last layer is the current state
+    //a transition pushes the dst state and fades every other layer out,
+    //so a running transition can be interrupted by another one
+    Layer m_layers[MAX_LAYER_COUNT];
+    size_t m_layer_count;
+    
+    //non immediate transition waiting until the current state reaches src_begin
+    int m_pending_transition;
     
-    double m_current_time;
-    double m_transition_beg1;//src state
-    double m_transition_end1;//src state
-    double m_transition_beg2;//dst state
-    double m_transition_end2;//dst state
-    const State* m_current_state;
-    const Transition* m_current_transition;
+    //pose buffers,one per layer and one for the blended output
+    PosePool m_pose_pool;
+    int m_output_pose;
     
-    //used for calculation
-    std::vector<mat4> m_buf[6];
+    //optional,layers read shared poses instead of sampling into their own buffer
+    PoseCache* m_pose_cache;
+    double m_pose_cache_sample_rate;
+    
+    //result of Evaluate
+    const mat4* m_result_bp;
+    const mat4* m_result_bp_it;
 public:
-    AnimationController(Skeleton* skeleton,
-                        const std::map<std::string,State>& states,
-                        const std::string& entry_state_id);
+    AnimationController(Skeleton* skeleton,const AnimationStateGraph* graph);
     ~AnimationController();
     
+    void SetPoseCache(PoseCache* pose_cache,double sample_rate);
+    
     void DoAutoTransition();
-    void DoUserTransition(const std::string& trigger);
+    void DoUserTransition(int keycode);
     
+    //Advance+Evaluate+ApplyPose
     void UpdateAnimation(double dt);
+    
+    //Advance and Evaluate touch only the controller,so controllers can run them on worker threads
+    //ApplyPose uploads to the skeleton and must run on the gl thread
+    void Advance(double dt);
+    void Evaluate();
+    void ApplyPose();
+    
+    //local time of the current state
+    void SetTime(double time);
+    
+    int GetCurrentState() const;
+    size_t GetLayerCount() const;
+private:
+    void StartTransition(int transition_index,double elapsed_time);
+    void PushLayer(int state,double time,double weight,double fade_rate);
+    void RemoveLayer(size_t index);
+};
+
+
+//state machine compiled at load time
+//states and transitions are addressed by index and user transitions by a dense keycode table
+//read only after construction,so one graph can be shared by many controllers
+class AnimationStateGraph{
+public:
+    static const int NONE = -1;
+    static const int KEYCODE_COUNT = 128;//triggers are single ascii characters
+    struct Transition{
+        bool is_immediate;
+        int dst_state;
+        double length;   //src duration*normalized duration
+        double src_begin;//src time at which a non immediate transition starts
+        double dst_begin;//dst duration*normalized offset
+        bool is_dst_fit; //dst_begin+length <= dst duration
+    };
+    struct State{
+        const Animation* animation;
+        double duration;
+        int auto_transition;//NONE if not exist
+        std::vector<const Animation*> dst_animations;//animations of the dst states of every transition,without duplicates
+    };
+private:
+    std::vector<State> m_states;
+    std::vector<Transition> m_transitions;
+    std::vector<int> m_dispatch;//size = state_count*KEYCODE_COUNT,transition index or NONE
+    std::vector<std::string> m_state_ids;
+    int m_entry_state;
+public:
+    AnimationStateGraph(const std::map<std::string,AnimationController::State>& states,
+                        const std::string& entry_state_id);
+    
+    size_t GetStateCount() const;
+    const State& GetState(int state) const;
+    const Transition& GetTransition(int transition) const;
+    const std::string& GetStateId(int state) const;
+    int GetEntryState() const;
+    
+    //NONE if keycode does not trigger a transition in the state
+    int GetUserTransition(int state,int keycode) const;
+    
+    //pages in the animations the state can transition to
+    void Prefetch(int state) const;
 };
 
 
@@ -214,8 +581,13 @@ private:
     std::map<std::string,Shader*> m_shaders;
     std::map<std::string,Mesh*> m_meshes;
     std::map<std::string,Animation*> m_animations;
+    
+    //optional,animations found in it are mapped instead of imported
+    AnimationDatabase* m_animation_database;
+    size_t m_imported_animation_count;
 private:
     ResourceManager();
+    static std::string GetShaderKey(const std::string& vs_path,const std::string& fs_path,const std::vector<std::string>& defines);
 public:
     //singleton
     static void CreateInstance();
@@ -223,10 +595,28 @@ public:
     static ResourceManager* GetInstance();
     
     Texture* LoadTexture(const std::string& path);
-    Shader* LoadShader(const std::string& vs_path,const std::string& fs_path);
-    Mesh* LoadMesh(const std::string& asset_dir_path,const std::string& mesh_file_path,const Shader* shader,bool is_skeletal);
+    Shader* LoadShader(const std::string& vs_path,const std::string& fs_path,const std::vector<std::string>& defines = std::vector<std::string>());
+    //compiles every variant not loaded yet at once,LoadShader returns them afterwards
+    void PrecompileShaders(const std::vector<ShaderVariant>& variants);
+    Mesh* LoadMesh(const std::string& asset_dir_path,const std::string& mesh_file_path,const Shader* shader,const MeshImportSettings& settings);
+    //"file#take" loads the animation stack named take,every take of the file is imported at once
     Animation* LoadAnimation(const std::string& path);
+    //registers every take of the file under "file#take",returns the take count
+    size_t LoadAnimationTakes(const std::string& path);
+    //imports files of paths which are not loaded yet on the fbx import session workers
+    void LoadAnimations(const std::vector<std::string>& paths);
+    
+    //maps the database at path,call before loading animations
+    void OpenAnimationDatabase(const std::string& path);
+    //adds the imported animations to the database at path if any
+    void SaveAnimationDatabase(const std::string& path);
+    //nullptr if no database is open
+    const AnimationDatabase* GetAnimationDatabase() const;
+    
     void UnLoadResource();
+private:
+    bool LoadAnimationFromDatabase(const std::string& path);
+    void RegisterAnimations(const std::string& path,const FBXAnimationLoader& loader,bool is_all_takes);
 };
 
 #endif // RESOURCE_HPP
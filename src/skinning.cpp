@@ -0,0 +1,303 @@
+#include "skinning.hpp"
+#include "thread_pool.hpp"
+
+#include <cstring>
+#include <random>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+
+//vertices per parallel range
+static const size_t SKINNING_GRAIN = 2048;
+
+//difference of the simd kernel from the scalar reference,relative to the reference
+//float sums in a different order stay far below this,a wrong index or column does not
+static const FLOAT SKINNING_TOLERANCE = 1e-4;
+
+//self test streams,the vertex count is not a multiple of the grain so that a partial range is skinned too
+static const size_t SKINNING_TEST_VERTEX_COUNT = 3*SKINNING_GRAIN+7;
+static const int SKINNING_TEST_BONE_COUNT = 64;
+
+
+CPUSkinning::CPUSkinning(const std::vector<vec3>& xyz,
+                         const std::vector<vec3>& normal,
+                         const std::vector<int>& bone_index,
+                         const std::vector<FLOAT>& bone_weight)
+{
+    //check size
+    if (normal.size() != xyz.size() || bone_index.size() != 4*xyz.size() || bone_weight.size() != 4*xyz.size()){
+        std::cout << "CPUSkinning::CPUSkinning" << "\n";
+        std::cout << "stream size mismatch" << "\n";
+        std::terminate();
+    }
+
+    m_xyz = xyz;
+    m_normal = normal;
+
+    //unused slot(-1) is redirected to bone 0 with weight 0,so that kernels have no branch
+    m_bone_index.resize(bone_index.size());
+    m_bone_weight.resize(bone_weight.size());
+    m_max_bone_index = 0;
+    for (size_t i = 0;i < bone_index.size();i++){
+        if (bone_index[i] < 0){
+            m_bone_index[i] = 0;
+            m_bone_weight[i] = 0;
+        }else{
+            m_bone_index[i] = bone_index[i];
+            m_bone_weight[i] = bone_weight[i];
+            m_max_bone_index = std::max(m_max_bone_index,bone_index[i]);
+        }
+    }
+
+    m_skinned_xyz = xyz;
+    m_skinned_normal = normal;
+}
+
+size_t CPUSkinning::GetVertexCount() const{
+    return m_xyz.size();
+}
+
+const std::vector<vec3>& CPUSkinning::GetXYZ() const{
+    return m_xyz;
+}
+
+void CPUSkinning::Skin(const std::vector<mat4>& palette_xyz,const std::vector<mat4>& palette_normal){
+    Skin(palette_xyz,palette_normal,m_skinned_xyz,m_skinned_normal);
+}
+
+void CPUSkinning::Skin(const std::vector<mat4>& palette_xyz,
+                       const std::vector<mat4>& palette_normal,
+                       std::vector<vec3>& xyz,
+                       std::vector<vec3>& normal) const
+{
+    CheckPalette(palette_xyz,palette_normal);
+
+    xyz.resize(m_xyz.size());
+    normal.resize(m_normal.size());
+
+    const mat4* pxyz = palette_xyz.data();
+    const mat4* pnormal = palette_normal.data();
+    vec3* oxyz = xyz.data();
+    vec3* onormal = normal.data();
+    ThreadPool* pool = ThreadPool::GetInstance();
+    if (pool != nullptr){
+        pool->ParallelFor(m_xyz.size(),SKINNING_GRAIN,[this,pxyz,pnormal,oxyz,onormal](size_t beg,size_t end){
+            SkinRange(pxyz,pnormal,oxyz,onormal,beg,end);
+        });
+    }else{
+        SkinRange(pxyz,pnormal,oxyz,onormal,0,m_xyz.size());
+    }
+}
+
+void CPUSkinning::SkinReference(const std::vector<mat4>& palette_xyz,
+                                const std::vector<mat4>& palette_normal,
+                                std::vector<vec3>& xyz,
+                                std::vector<vec3>& normal) const
+{
+    CheckPalette(palette_xyz,palette_normal);
+
+    xyz.resize(m_xyz.size());
+    normal.resize(m_normal.size());
+    for (size_t i = 0;i < m_xyz.size();i++){
+        const int* id = &m_bone_index[4*i];
+        const FLOAT* wt = &m_bone_weight[4*i];
+
+        //same as mesh.vert with SKELETAL
+        mat4 bone_matrix_xyz = palette_xyz[id[0]]*wt[0]
+                              +palette_xyz[id[1]]*wt[1]
+                              +palette_xyz[id[2]]*wt[2]
+                              +palette_xyz[id[3]]*wt[3];
+        mat4 bone_matrix_normal = palette_normal[id[0]]*wt[0]
+                                 +palette_normal[id[1]]*wt[1]
+                                 +palette_normal[id[2]]*wt[2]
+                                 +palette_normal[id[3]]*wt[3];
+
+        xyz[i] = bone_matrix_xyz*vec4(m_xyz[i],1);
+        normal[i] = normalize(vec3(bone_matrix_normal*vec4(m_normal[i],0)));
+    }
+}
+
+FLOAT CPUSkinning::Verify(const std::vector<mat4>& palette_xyz,const std::vector<mat4>& palette_normal){
+    std::vector<vec3> xyz,normal;
+    SkinReference(palette_xyz,palette_normal,xyz,normal);
+    Skin(palette_xyz,palette_normal);
+
+    FLOAT error = 0;
+    for (size_t i = 0;i < m_xyz.size();i++){
+        for (size_t j = 0;j < 3;j++){
+            error = std::max(error,std::abs(xyz[i][j]-m_skinned_xyz[i][j])/std::max(std::abs(xyz[i][j]),(FLOAT)1));
+            error = std::max(error,std::abs(normal[i][j]-m_skinned_normal[i][j]));
+        }
+    }
+    return error;
+}
+
+FLOAT CPUSkinning::GetTolerance(){
+    return SKINNING_TOLERANCE;
+}
+
+void CPUSkinning::SelfTest(){
+    //fixed seed,a failure is reproducible
+    std::mt19937 random(1);
+    std::uniform_real_distribution<FLOAT> unit(-1,1);
+    std::uniform_int_distribution<int> bone(-1,SKINNING_TEST_BONE_COUNT-1);
+
+    //vertices with up to 4 influences,-1 is an unused slot
+    std::vector<vec3> xyz(SKINNING_TEST_VERTEX_COUNT);
+    std::vector<vec3> normal(SKINNING_TEST_VERTEX_COUNT);
+    std::vector<int> bone_index(4*SKINNING_TEST_VERTEX_COUNT);
+    std::vector<FLOAT> bone_weight(4*SKINNING_TEST_VERTEX_COUNT);
+    for (size_t i = 0;i < SKINNING_TEST_VERTEX_COUNT;i++){
+        xyz[i] = vec3{100*unit(random),100*unit(random),100*unit(random)};
+        normal[i] = normalize(vec3{unit(random),unit(random),unit(random)+2});
+        FLOAT weight_sum = 0;
+        for (size_t j = 0;j < 4;j++){
+            bone_index[4*i+j] = (j == 0) ? std::max(bone(random),0) : bone(random);
+            bone_weight[4*i+j] = (bone_index[4*i+j] < 0) ? 0 : unit(random)+1;
+            weight_sum += bone_weight[4*i+j];
+        }
+        for (size_t j = 0;j < 4;j++){
+            bone_weight[4*i+j] /= (weight_sum != 0) ? weight_sum : 1;
+        }
+    }
+
+    //affine palettes
+    std::vector<mat4> palette_xyz(SKINNING_TEST_BONE_COUNT);
+    std::vector<mat4> palette_normal(SKINNING_TEST_BONE_COUNT);
+    for (int i = 0;i < SKINNING_TEST_BONE_COUNT;i++){
+        for (size_t r = 0;r < 3;r++){
+            for (size_t c = 0;c < 4;c++){
+                palette_xyz[i].SetComponent(r,c,(c == 3) ? 10*unit(random) : unit(random)+((r == c) ? 2 : 0));
+                palette_normal[i].SetComponent(r,c,(c == 3) ? 0 : unit(random)+((r == c) ? 2 : 0));
+            }
+        }
+        palette_xyz[i].SetComponent(3,3,1);
+        palette_normal[i].SetComponent(3,3,1);
+    }
+
+    CPUSkinning skinning(xyz,normal,bone_index,bone_weight);
+    FLOAT error = skinning.Verify(palette_xyz,palette_normal);
+    if (error > SKINNING_TOLERANCE){
+        std::cout << "CPUSkinning::SelfTest" << "\n";
+        std::cout << "simd kernel differs from the scalar reference by " << error << ",tolerance " << SKINNING_TOLERANCE << "\n";
+        std::terminate();
+    }
+}
+
+const std::vector<vec3>& CPUSkinning::GetSkinnedXYZ() const{
+    return m_skinned_xyz;
+}
+
+const std::vector<vec3>& CPUSkinning::GetSkinnedNormal() const{
+    return m_skinned_normal;
+}
+
+void CPUSkinning::CheckPalette(const std::vector<mat4>& palette_xyz,const std::vector<mat4>& palette_normal) const{
+    if (palette_xyz.size() != palette_normal.size() || (size_t)m_max_bone_index >= palette_xyz.size()){
+        std::cout << "CPUSkinning::CheckPalette" << "\n";
+        std::cout << "palette is smaller than referenced bone index" << "\n";
+        std::terminate();
+    }
+}
+
+#ifdef __AVX__
+
+//mat4 is 16 floats in column major order
+//one __m256 holds two columns,so a blended matrix is two registers
+//both palettes share the weight broadcast
+static inline void blend_palette(const float* pxyz,const float* pnormal,const int* id,const FLOAT* wt,
+                                 __m256& x01,__m256& x23,__m256& n01,__m256& n23)
+{
+    __m256 w = _mm256_broadcast_ss(&wt[0]);
+    const float* a = pxyz+16*id[0];
+    const float* b = pnormal+16*id[0];
+    x01 = _mm256_mul_ps(w,_mm256_loadu_ps(a));
+    x23 = _mm256_mul_ps(w,_mm256_loadu_ps(a+8));
+    n01 = _mm256_mul_ps(w,_mm256_loadu_ps(b));
+    n23 = _mm256_mul_ps(w,_mm256_loadu_ps(b+8));
+    for (int k = 1;k < 4;k++){
+        w = _mm256_broadcast_ss(&wt[k]);
+        a = pxyz+16*id[k];
+        b = pnormal+16*id[k];
+        x01 = _mm256_add_ps(x01,_mm256_mul_ps(w,_mm256_loadu_ps(a)));
+        x23 = _mm256_add_ps(x23,_mm256_mul_ps(w,_mm256_loadu_ps(a+8)));
+        n01 = _mm256_add_ps(n01,_mm256_mul_ps(w,_mm256_loadu_ps(b)));
+        n23 = _mm256_add_ps(n23,_mm256_mul_ps(w,_mm256_loadu_ps(b+8)));
+    }
+}
+
+//c0*v[0]+c1*v[1]+c2*v[2](+c3 if has_w)
+static inline __m128 transform(__m256 c01,__m256 c23,const vec3& v,bool has_w){
+    __m256 xy = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(v[0])),_mm_set1_ps(v[1]),1);
+    __m256 t = _mm256_mul_ps(c01,xy);
+    __m128 r = _mm_add_ps(_mm256_castps256_ps128(t),_mm256_extractf128_ps(t,1));
+    r = _mm_add_ps(r,_mm_mul_ps(_mm256_castps256_ps128(c23),_mm_set1_ps(v[2])));
+    if (has_w){
+        r = _mm_add_ps(r,_mm256_extractf128_ps(c23,1));
+    }
+    return r;
+}
+
+void CPUSkinning::SkinRange(const mat4* palette_xyz,const mat4* palette_normal,vec3* xyz,vec3* normal,size_t beg,size_t end) const{
+    const float* pxyz = (const float*)palette_xyz;
+    const float* pnormal = (const float*)palette_normal;
+    float tmp[4];
+    for (size_t i = beg;i < end;i++){
+        __m256 x01,x23,n01,n23;
+        blend_palette(pxyz,pnormal,&m_bone_index[4*i],&m_bone_weight[4*i],x01,x23,n01,n23);
+
+        //xyz
+        _mm_storeu_ps(tmp,transform(x01,x23,m_xyz[i],true));
+        std::memcpy(&xyz[i],tmp,sizeof(vec3));
+
+        //normal
+        __m128 r = transform(n01,n23,m_normal[i],false);
+        __m128 l2 = _mm_dp_ps(r,r,0x7F);
+        if (_mm_cvtss_f32(l2) != 0){
+            r = _mm_div_ps(r,_mm_sqrt_ps(l2));
+        }
+        _mm_storeu_ps(tmp,r);
+        std::memcpy(&normal[i],tmp,sizeof(vec3));
+    }
+}
+
+#else
+
+void CPUSkinning::SkinRange(const mat4* palette_xyz,const mat4* palette_normal,vec3* xyz,vec3* normal,size_t beg,size_t end) const{
+    const float* pxyz = (const float*)palette_xyz;
+    const float* pnormal = (const float*)palette_normal;
+    for (size_t i = beg;i < end;i++){
+        const int* id = &m_bone_index[4*i];
+        const FLOAT* wt = &m_bone_weight[4*i];
+
+        //blend palette matrices
+        float mxyz[16] = {0};
+        float mnormal[16] = {0};
+        for (int k = 0;k < 4;k++){
+            const float* a = pxyz+16*id[k];
+            const float* b = pnormal+16*id[k];
+            for (int j = 0;j < 16;j++){
+                mxyz[j] += wt[k]*a[j];
+                mnormal[j] += wt[k]*b[j];
+            }
+        }
+
+        //xyz
+        const vec3& p = m_xyz[i];
+        for (int j = 0;j < 3;j++){
+            xyz[i][j] = mxyz[j]*p[0]+mxyz[4+j]*p[1]+mxyz[8+j]*p[2]+mxyz[12+j];
+        }
+
+        //normal
+        const vec3& n = m_normal[i];
+        vec3 r;
+        for (int j = 0;j < 3;j++){
+            r[j] = mnormal[j]*n[0]+mnormal[4+j]*n[1]+mnormal[8+j]*n[2];
+        }
+        normal[i] = normalize(r);
+    }
+}
+
+#endif
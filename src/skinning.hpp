@@ -0,0 +1,61 @@
+#ifndef SKINNING_HPP
+#define SKINNING_HPP
+
+#include "library.hpp"
+#include "define.hpp"
+#include "matrix.hpp"
+
+
+//software version of mesh.vert with SKELETAL
+//palette_xyz[i] = bp[i]*bbp_i[i],palette_normal[i] = bp_it[i]*bbp_iti[i]
+
+class CPUSkinning{
+private:
+    //source streams
+    std::vector<vec3> m_xyz;           //size = vertex_count
+    std::vector<vec3> m_normal;        //size = vertex_count
+    std::vector<int> m_bone_index;     //size = 4*vertex_count,unused slot is 0
+    std::vector<FLOAT> m_bone_weight;  //size = 4*vertex_count,unused slot is 0
+    int m_max_bone_index;
+
+    //skinned streams
+    std::vector<vec3> m_skinned_xyz;   //size = vertex_count
+    std::vector<vec3> m_skinned_normal;//size = vertex_count
+public:
+    CPUSkinning(const std::vector<vec3>& xyz,
+                const std::vector<vec3>& normal,
+                const std::vector<int>& bone_index,
+                const std::vector<FLOAT>& bone_weight);
+
+    size_t GetVertexCount() const;
+    const std::vector<vec3>& GetXYZ() const;
+
+    //skin with simd kernel,multithreaded over vertex ranges
+    void Skin(const std::vector<mat4>& palette_xyz,const std::vector<mat4>& palette_normal);
+    //same,but writes into the given streams and leaves the skinned streams untouched
+    void Skin(const std::vector<mat4>& palette_xyz,
+              const std::vector<mat4>& palette_normal,
+              std::vector<vec3>& xyz,
+              std::vector<vec3>& normal) const;
+
+    //scalar reference
+    void SkinReference(const std::vector<mat4>& palette_xyz,
+                       const std::vector<mat4>& palette_normal,
+                       std::vector<vec3>& xyz,
+                       std::vector<vec3>& normal) const;
+
+    //skin with both and return max difference of xyz and normal,relative to the magnitude of the reference
+    FLOAT Verify(const std::vector<mat4>& palette_xyz,const std::vector<mat4>& palette_normal);
+    //largest difference Verify accepts
+    static FLOAT GetTolerance();
+    //skins random streams with random palettes through both kernels,terminates if they differ by more than the tolerance
+    static void SelfTest();
+
+    const std::vector<vec3>& GetSkinnedXYZ() const;
+    const std::vector<vec3>& GetSkinnedNormal() const;
+private:
+    void CheckPalette(const std::vector<mat4>& palette_xyz,const std::vector<mat4>& palette_normal) const;
+    void SkinRange(const mat4* palette_xyz,const mat4* palette_normal,vec3* xyz,vec3* normal,size_t beg,size_t end) const;
+};
+
+#endif // SKINNING_HPP
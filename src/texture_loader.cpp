@@ -0,0 +1,280 @@
+#include "texture_loader.hpp"
+#include "resource.hpp"
+#include "cooked_texture.hpp"
+#include "trace.hpp"
+#include "gl_counter.hpp"
+
+#include "stb_image.h"
+
+#include <cstring>
+
+
+//pixel unpack buffers in the ring,a buffer is reused once the gpu has finished the upload from it
+static const size_t TEXTURE_STREAM_BUFFER_COUNT = 3;
+//initial size of a buffer,grown to the largest level
+static const size_t TEXTURE_STREAM_BUFFER_SIZE = 1024*1024;
+
+
+TextureLoader* TextureLoader::m_instance = nullptr;
+
+TextureLoader::TextureLoader(size_t worker_count):m_pool(worker_count),m_stream_buffer_index(0){
+    //buffers are created at the first upload
+    StreamBuffer buffer;
+    buffer.pbo = 0;
+    buffer.capacity = 0;
+    buffer.fence = nullptr;
+    m_stream_buffers.assign(TEXTURE_STREAM_BUFFER_COUNT,buffer);
+
+    m_statistics.decode_count = 0;
+    m_statistics.joined_count = 0;
+    m_statistics.cooked_count = 0;
+    m_statistics.upload_count = 0;
+    m_statistics.level_upload_count = 0;
+    m_statistics.upload_size = 0;
+    m_statistics.stall_count = 0;
+    m_statistics.decode_time = 0;
+    m_statistics.saved_time = 0;
+    m_statistics.base_size = 0;
+    m_statistics.mip_size = 0;
+    m_statistics.upload_time = 0;
+    m_statistics.max_upload_time = 0;
+}
+
+TextureLoader::~TextureLoader(){
+    //textures may already be deleted,so decoded images are dropped without upload
+    m_pool.Wait();
+    for (auto i = m_entries.begin();i != m_entries.end();++i){
+        delete i->second->cooked;
+        delete i->second;
+    }
+    for (size_t i = 0;i < m_streaming_entries.size();i++){
+        delete m_streaming_entries[i]->cooked;
+        delete m_streaming_entries[i];
+    }
+    for (size_t i = 0;i < m_stream_buffers.size();i++){
+        if (m_stream_buffers[i].fence != nullptr){
+            glDeleteSync(m_stream_buffers[i].fence);
+        }
+        glDeleteBuffers(1,&m_stream_buffers[i].pbo);
+    }
+}
+
+void TextureLoader::CreateInstance(size_t worker_count){
+    if (m_instance == nullptr){
+        m_instance = new TextureLoader(worker_count);
+    }
+}
+
+void TextureLoader::DeleteInstance(){
+    delete m_instance;
+    m_instance = nullptr;
+}
+
+TextureLoader* TextureLoader::GetInstance(){
+    return m_instance;
+}
+
+void TextureLoader::Load(Texture* texture,const std::string& path){
+    Entry* entry;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        //join the decode in flight
+        auto i = m_entries.find(path);
+        if (i != m_entries.end()){
+            i->second->textures.push_back(texture);
+            m_statistics.joined_count++;
+            return;
+        }
+
+        entry = new Entry();
+        entry->path = path;
+        entry->textures.push_back(texture);
+        entry->cooked = nullptr;
+        entry->next_level = 0;
+        m_entries[path] = entry;
+        m_statistics.decode_count++;
+    }
+    m_pool.Enqueue([this,entry](){
+        Decode(entry);
+    });
+}
+
+void TextureLoader::Decode(Entry* entry){
+    TRACE_ZONE_ARG("TextureDecode",entry->path);
+    auto t0 = std::chrono::steady_clock::now();
+    CookedTexture* cooked = new CookedTexture();
+    const std::string& cooked_path = CookedTexture::GetCookedPath(entry->path);
+    bool is_cooked = cooked->Load(cooked_path,entry->path);
+    if (!is_cooked){
+        //decode,build the mip chain and keep it for the next run
+        int w,h,n;
+        unsigned char* rgba = stbi_load(entry->path.c_str(),&w,&h,&n,4);
+        if (rgba != nullptr){
+            cooked->Cook(w,h,rgba);
+            stbi_image_free(rgba);
+            double time = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+            cooked->Save(cooked_path,entry->path,time);
+        }
+        else{
+            delete cooked;
+            cooked = nullptr;
+        }
+    }
+    entry->cooked = cooked;
+    auto t1 = std::chrono::steady_clock::now();
+    double time = std::chrono::duration<double>(t1-t0).count();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_statistics.decode_time += time;
+    if (is_cooked){
+        m_statistics.cooked_count++;
+        m_statistics.saved_time += cooked->GetCookTime()-time;
+    }
+    if (cooked != nullptr){
+        const CookedTexture::Level& base = cooked->GetLevels()[0];
+        size_t base_size = 4*(size_t)base.width*base.height;
+        m_statistics.base_size += base_size;
+        m_statistics.mip_size += cooked->GetByteSize()-base_size;
+    }
+    m_decoded_entries.push_back(entry);
+}
+
+size_t TextureLoader::Upload(size_t byte_budget){
+    return Stream(byte_budget,false);
+}
+
+void TextureLoader::Flush(){
+    m_pool.Wait();
+    Stream(SIZE_MAX,true);
+}
+
+size_t TextureLoader::Stream(size_t byte_budget,bool is_blocking){
+    TRACE_ZONE("TextureUpload");
+    auto t0 = std::chrono::steady_clock::now();
+
+    //decoded entries join the streaming set
+    //the entry leaves the map here,so a later Load of the same path decodes again
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (!m_decoded_entries.empty()){
+            Entry* entry = m_decoded_entries.front();
+            m_decoded_entries.pop_front();
+            m_entries.erase(entry->path);
+            if (entry->cooked == nullptr){
+                std::cout << "failed to create texture:" << entry->path << "\n";
+                std::terminate();
+            }
+            entry->next_level = (int)entry->cooked->GetLevels().size()-1;
+            m_streaming_entries.push_back(entry);
+        }
+    }
+
+    size_t upload_count = 0;
+    size_t level_upload_count = 0;
+    size_t upload_size = 0;
+    bool is_stalled = false;
+    while (!m_streaming_entries.empty()){
+        //the smallest pending level over every texture
+        size_t index = 0;
+        size_t level_size = SIZE_MAX;
+        for (size_t i = 0;i < m_streaming_entries.size();i++){
+            const Entry* entry = m_streaming_entries[i];
+            const CookedTexture::Level& level = entry->cooked->GetLevels()[entry->next_level];
+            size_t size = 4*(size_t)level.width*level.height;
+            if (size < level_size){
+                index = i;
+                level_size = size;
+            }
+        }
+        if (level_upload_count != 0 && upload_size+level_size > byte_budget){
+            break;
+        }
+        StreamBuffer* buffer = AcquireStreamBuffer(level_size,is_blocking);
+        if (buffer == nullptr){
+            is_stalled = true;
+            break;
+        }
+
+        //copy into the buffer,the gpu reads it after this call has returned
+        Entry* entry = m_streaming_entries[index];
+        const CookedTexture::Level& level = entry->cooked->GetLevels()[entry->next_level];
+        GLCounter::BindBuffer(GL_PIXEL_UNPACK_BUFFER,buffer->pbo);
+        void* data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,0,level_size,GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT|GL_MAP_UNSYNCHRONIZED_BIT);
+        if (data == nullptr){
+            std::cout << "failed to map pixel unpack buffer:" << entry->path << "\n";
+            std::terminate();
+        }
+        std::memcpy(data,level.rgba,level_size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        //storage of every level is allocated with the smallest one
+        bool is_first_level = (entry->next_level == (int)entry->cooked->GetLevels().size()-1);
+        for (size_t i = 0;i < entry->textures.size();i++){
+            if (is_first_level){
+                entry->textures[i]->Allocate(*entry->cooked);
+            }
+            entry->textures[i]->UploadLevel(entry->next_level,level.width,level.height,(const void*)0);
+        }
+        GLCounter::BindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+        buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+
+        level_upload_count++;
+        upload_size += level_size;
+        entry->next_level--;
+        if (entry->next_level < 0){
+            delete entry->cooked;
+            delete entry;
+            m_streaming_entries.erase(m_streaming_entries.begin()+index);
+            upload_count++;
+        }
+    }
+
+    if (level_upload_count != 0 || is_stalled){
+        double time = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+        m_statistics.upload_count += upload_count;
+        m_statistics.level_upload_count += level_upload_count;
+        m_statistics.upload_size += upload_size;
+        m_statistics.stall_count += is_stalled ? 1 : 0;
+        m_statistics.upload_time += time;
+        m_statistics.max_upload_time = std::max(m_statistics.max_upload_time,time);
+    }
+    return upload_count;
+}
+
+TextureLoader::StreamBuffer* TextureLoader::AcquireStreamBuffer(size_t size,bool is_blocking){
+    StreamBuffer& buffer = m_stream_buffers[m_stream_buffer_index];
+    if (buffer.fence != nullptr){
+        //the upload from the previous use has to be finished
+        GLenum result = glClientWaitSync(buffer.fence,GL_SYNC_FLUSH_COMMANDS_BIT,0);
+        while (is_blocking && result == GL_TIMEOUT_EXPIRED){
+            result = glClientWaitSync(buffer.fence,GL_SYNC_FLUSH_COMMANDS_BIT,1000000000);
+        }
+        if (result == GL_TIMEOUT_EXPIRED){
+            return nullptr;
+        }
+        glDeleteSync(buffer.fence);
+        buffer.fence = nullptr;
+    }
+    if (buffer.pbo == 0){
+        glGenBuffers(1,&buffer.pbo);
+    }
+    if (buffer.capacity < size){
+        buffer.capacity = std::max(size,TEXTURE_STREAM_BUFFER_SIZE);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER,buffer.pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER,buffer.capacity,NULL,GL_STREAM_DRAW);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+    }
+    m_stream_buffer_index = (m_stream_buffer_index+1)%m_stream_buffers.size();
+    return &buffer;
+}
+
+size_t TextureLoader::GetPendingCount(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size()+m_streaming_entries.size();
+}
+
+TextureLoader::Statistics TextureLoader::GetStatistics(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
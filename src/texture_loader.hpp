@@ -0,0 +1,92 @@
+#ifndef TEXTURE_LOADER_HPP
+#define TEXTURE_LOADER_HPP
+
+#include "library.hpp"
+#include "thread_pool.hpp"
+
+#include <OpenGL/gl3.h>
+
+class Texture;
+class CookedTexture;
+
+
+//textures are decoded on worker threads and uploaded on the gl thread
+//Load returns at once and the texture shows its placeholder until Upload reaches it
+//a path already in flight is decoded once for every texture requesting it
+//workers map the cooked mip chain of a texture,or decode and cook it once and keep the cooked file for later runs
+//the gl thread streams the levels through a ring of pixel unpack buffers under a byte budget per frame,
+//smallest levels of every texture first,so a blurry texture shows at once and sharpens over the next frames
+class TextureLoader{
+public:
+    struct Statistics{
+        size_t decode_count;      //decodes started
+        size_t joined_count;      //requests joined to a decode in flight
+        size_t cooked_count;      //decodes served by a cooked file
+        size_t upload_count;      //textures with every level uploaded
+        size_t level_upload_count;
+        size_t upload_size;       //bytes through the pixel unpack buffers
+        size_t stall_count;       //Upload calls stopped by a buffer the gpu still reads
+        double decode_time;       //sec,summed over workers
+        double saved_time;        //sec,cook time recorded in the cooked files minus their load time
+        size_t base_size;         //bytes of level 0 of loaded textures
+        size_t mip_size;          //bytes of the other levels
+        double upload_time;       //sec
+        double max_upload_time;   //sec,longest Upload call
+    };
+private:
+    struct Entry{
+        std::string path;
+        std::vector<Texture*> textures;
+        CookedTexture* cooked;//nullptr if the decode failed
+        int next_level;       //next level to upload,counts down from the smallest level
+    };
+    struct StreamBuffer{
+        GLuint pbo;
+        size_t capacity;
+        GLsync fence;//nullptr while the gpu does not read the buffer
+    };
+
+    static TextureLoader* m_instance;
+
+    ThreadPool m_pool;
+
+    //entries in flight by path and decoded entries waiting for upload,guarded by m_mutex
+    std::mutex m_mutex;
+    std::map<std::string,Entry*> m_entries;
+    std::deque<Entry*> m_decoded_entries;
+
+    //gl thread only
+    std::vector<Entry*> m_streaming_entries;
+    std::vector<StreamBuffer> m_stream_buffers;
+    size_t m_stream_buffer_index;
+
+    Statistics m_statistics;//upload counts and times are written by the gl thread only,the rest under m_mutex
+private:
+    TextureLoader(size_t worker_count);
+    ~TextureLoader();
+public:
+    //singleton
+    static void CreateInstance(size_t worker_count);
+    static void DeleteInstance();
+    static TextureLoader* GetInstance();//nullptr if not created
+
+    //decodes path on a worker,texture has to live until its upload
+    void Load(Texture* texture,const std::string& path);
+
+    //streams levels of decoded textures until byte_budget bytes are copied,at least one level per call
+    //returns the number of textures with every level uploaded by this call
+    size_t Upload(size_t byte_budget);
+    //waits for every decode in flight and uploads all of them
+    void Flush();
+
+    //requests not fully uploaded yet,gl thread only
+    size_t GetPendingCount();
+    TextureLoader::Statistics GetStatistics();
+private:
+    void Decode(Entry* entry);
+    size_t Stream(size_t byte_budget,bool is_blocking);
+    //next buffer of the ring with at least size bytes,nullptr if the gpu still reads it and is_blocking is false
+    StreamBuffer* AcquireStreamBuffer(size_t size,bool is_blocking);
+};
+
+#endif // TEXTURE_LOADER_HPP
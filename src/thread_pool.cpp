@@ -0,0 +1,152 @@
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <memory>
+
+
+ThreadPool* ThreadPool::m_instance = nullptr;
+
+ThreadPool::ThreadPool(size_t thread_count):m_busy_count(0),m_is_terminated(false){
+    if (thread_count == 0){
+        size_t hardware_count = std::thread::hardware_concurrency();
+        thread_count = (hardware_count > 1) ? hardware_count-1 : 1;
+    }
+    for (size_t i = 0;i < thread_count;i++){
+        m_threads.push_back(std::thread(&ThreadPool::Work,this));
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_is_terminated = true;
+    }
+    m_task_cv.notify_all();
+    for (size_t i = 0;i < m_threads.size();i++){
+        m_threads[i].join();
+    }
+}
+
+void ThreadPool::CreateInstance(size_t thread_count){
+    if (m_instance == nullptr){
+        m_instance = new ThreadPool(thread_count);
+    }
+}
+
+void ThreadPool::DeleteInstance(){
+    delete m_instance;
+    m_instance = nullptr;
+}
+
+ThreadPool* ThreadPool::GetInstance(){
+    return m_instance;
+}
+
+size_t ThreadPool::GetThreadCount() const{
+    return m_threads.size();
+}
+
+void ThreadPool::Enqueue(const std::function<void()>& task){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(task);
+    }
+    m_task_cv.notify_one();
+}
+
+void ThreadPool::Wait(){
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle_cv.wait(lock,[this]{return m_tasks.empty() && m_busy_count == 0;});
+}
+
+void ThreadPool::ParallelFor(size_t count,size_t grain,const std::function<void(size_t,size_t)>& func){
+    if (count == 0){
+        return;
+    }
+    if (grain == 0){
+        grain = 1;
+    }
+
+    //range count
+    size_t range_count = (count+grain-1)/grain;
+    if (range_count == 1 || m_threads.empty()){
+        func(0,count);
+        return;
+    }
+
+    //shared by the calling thread and helpers
+    //helpers may start after the calling thread has returned, so the state is reference counted
+    struct Range{
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+        size_t range_count;
+        size_t count;
+        size_t grain;
+        std::function<void(size_t,size_t)> func;
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+    std::shared_ptr<Range> range(new Range());
+    range->next = 0;
+    range->done = 0;
+    range->range_count = range_count;
+    range->count = count;
+    range->grain = grain;
+    range->func = func;
+
+    //take ranges until none is left
+    auto run = [](const std::shared_ptr<Range>& r){
+        while (1){
+            size_t i = r->next.fetch_add(1);
+            if (i >= r->range_count){
+                break;
+            }
+            size_t beg = i*r->grain;
+            size_t end = std::min(beg+r->grain,r->count);
+            r->func(beg,end);
+            if (r->done.fetch_add(1)+1 == r->range_count){
+                std::lock_guard<std::mutex> lock(r->mutex);
+                r->cv.notify_all();
+            }
+        }
+    };
+
+    //helpers
+    size_t helper_count = std::min(m_threads.size(),range_count-1);
+    for (size_t i = 0;i < helper_count;i++){
+        Enqueue([range,run]{run(range);});
+    }
+
+    //calling thread
+    run(range);
+
+    //wait for ranges taken by helpers
+    std::unique_lock<std::mutex> lock(range->mutex);
+    range->cv.wait(lock,[&range]{return range->done.load() == range->range_count;});
+}
+
+void ThreadPool::Work(){
+    while (1){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_task_cv.wait(lock,[this]{return m_is_terminated || !m_tasks.empty();});
+            if (m_is_terminated && m_tasks.empty()){
+                return;
+            }
+            task = m_tasks.front();
+            m_tasks.pop_front();
+            m_busy_count++;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy_count--;
+            if (m_tasks.empty() && m_busy_count == 0){
+                m_idle_cv.notify_all();
+            }
+        }
+    }
+}
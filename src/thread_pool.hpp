@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include "library.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+
+
+class ThreadPool{
+private:
+    static ThreadPool* m_instance;
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_task_cv;
+    std::condition_variable m_idle_cv;
+    size_t m_busy_count;
+    bool m_is_terminated;
+public:
+    //thread_count == 0 means hardware concurrency-1
+    ThreadPool(size_t thread_count);
+    ~ThreadPool();
+
+    //shared pool
+    static void CreateInstance(size_t thread_count);
+    static void DeleteInstance();
+    static ThreadPool* GetInstance();//nullptr if not created
+
+    size_t GetThreadCount() const;
+
+    void Enqueue(const std::function<void()>& task);
+
+    //wait until every enqueued task has finished
+    void Wait();
+
+    //split [0,count) into ranges of about grain elements and run func(beg,end) on them
+    //the calling thread takes part in the work and returns after all ranges have finished
+    void ParallelFor(size_t count,size_t grain,const std::function<void(size_t,size_t)>& func);
+private:
+    void Work();
+};
+
+#endif // THREAD_POOL_HPP
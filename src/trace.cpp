@@ -0,0 +1,140 @@
+#include "trace.hpp"
+
+
+//events kept per thread,later events are counted and dropped so that a long session does not grow without bound
+static const size_t TRACE_MAX_EVENT_COUNT = 1<<20;
+
+static std::atomic<uint64_t> g_trace_generation(0);
+
+//buffer of the calling thread and the trace it belongs to
+static thread_local void* t_trace_buffer = nullptr;
+static thread_local uint64_t t_trace_generation = 0;
+
+static void write_json_string(std::FILE* fp,const std::string& s){
+    std::fputc('"',fp);
+    for (size_t i = 0;i < s.size();i++){
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\'){
+            std::fputc('\\',fp);
+            std::fputc(c,fp);
+        }else if (c < 0x20){
+            std::fprintf(fp,"\\u%04x",c);
+        }else{
+            std::fputc(c,fp);
+        }
+    }
+    std::fputc('"',fp);
+}
+
+
+std::atomic<Trace*> Trace::m_instance(nullptr);
+
+Trace::Trace(const std::string& path):m_generation(++g_trace_generation),m_path(path),m_start(std::chrono::steady_clock::now()){
+}
+
+Trace::~Trace(){
+    for (size_t i = 0;i < m_buffers.size();i++){
+        delete m_buffers[i];
+    }
+}
+
+void Trace::CreateInstance(const std::string& path){
+    if (m_instance.load() == nullptr){
+        m_instance.store(new Trace(path),std::memory_order_release);
+    }
+}
+
+void Trace::DeleteInstance(){
+    //every thread recording zones has to be finished
+    Trace* trace = m_instance.exchange(nullptr);
+    if (trace != nullptr){
+        trace->Write();
+        delete trace;
+    }
+}
+
+void Trace::SetThreadName(const std::string& name){
+    ThreadBuffer* buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    buffer->thread_name = name;
+}
+
+void Trace::AddEvent(const char* name,const std::string& arg,std::chrono::steady_clock::time_point begin,std::chrono::steady_clock::time_point end){
+    ThreadBuffer* buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    if (buffer->events.size() == TRACE_MAX_EVENT_COUNT){
+        buffer->dropped_count++;
+        return;
+    }
+    Event event;
+    event.name = name;
+    event.arg = arg;
+    event.begin = std::chrono::duration_cast<std::chrono::nanoseconds>(begin-m_start).count();
+    event.end = std::chrono::duration_cast<std::chrono::nanoseconds>(end-m_start).count();
+    buffer->events.push_back(event);
+}
+
+bool Trace::Write(){
+    std::FILE* fp = std::fopen(m_path.c_str(),"w");
+    if (fp == NULL){
+        std::cout << "failed to write trace:" << m_path << "\n";
+        return false;
+    }
+
+    //complete events and thread names,times in us
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t event_count = 0;
+    size_t dropped_count = 0;
+    std::fprintf(fp,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool is_first = true;
+    for (size_t i = 0;i < m_buffers.size();i++){
+        ThreadBuffer* buffer = m_buffers[i];
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        std::fprintf(fp,"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",is_first ? "" : ",\n",buffer->thread_id);
+        write_json_string(fp,buffer->thread_name);
+        std::fprintf(fp,"}}");
+        is_first = false;
+        for (size_t j = 0;j < buffer->events.size();j++){
+            const Event& event = buffer->events[j];
+            std::fprintf(fp,",\n{\"name\":");
+            write_json_string(fp,event.name);
+            std::fprintf(fp,",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",buffer->thread_id,event.begin*1e-3,(event.end-event.begin)*1e-3);
+            if (!event.arg.empty()){
+                std::fprintf(fp,",\"args\":{\"arg\":");
+                write_json_string(fp,event.arg);
+                std::fprintf(fp,"}");
+            }
+            std::fprintf(fp,"}");
+        }
+        event_count += buffer->events.size();
+        dropped_count += buffer->dropped_count;
+    }
+    std::fprintf(fp,"\n]}\n");
+    bool is_written = (std::fclose(fp) == 0);
+
+    std::cout << "trace:" << event_count << " events," << m_buffers.size() << " threads";
+    if (dropped_count != 0){
+        std::cout << "," << dropped_count << " dropped";
+    }
+    std::cout << "," << m_path << "\n";
+    return is_written;
+}
+
+Trace::ThreadBuffer* Trace::GetThreadBuffer(){
+    if (t_trace_generation == m_generation){
+        return (ThreadBuffer*)t_trace_buffer;
+    }
+
+    //first zone of this thread
+    ThreadBuffer* buffer = new ThreadBuffer();
+    buffer->dropped_count = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        buffer->thread_id = (uint32_t)m_buffers.size()+1;
+        buffer->thread_name = "thread "+std::to_string(buffer->thread_id);
+        m_buffers.push_back(buffer);
+    }
+    t_trace_buffer = buffer;
+    t_trace_generation = m_generation;
+    return buffer;
+}
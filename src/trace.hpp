@@ -0,0 +1,118 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "library.hpp"
+
+#include <mutex>
+#include <atomic>
+
+
+//timeline of scoped zones on every thread,written in the chrome trace event format for perfetto or chrome://tracing
+//each thread appends complete events to its own buffer,so zones on different threads do not contend
+//while no Trace exists a zone costs a load and a branch,building with -DDISABLE_TRACE removes zones entirely
+//
+//  void Foo(){
+//      TRACE_ZONE("Foo");
+//      ...
+//  }
+
+class Trace{
+private:
+    struct Event{
+        const char* name;//string literal
+        std::string arg; //shown as args.arg,empty if none
+        uint64_t begin;  //ns since the trace started
+        uint64_t end;
+    };
+    struct ThreadBuffer{
+        uint32_t thread_id;
+        std::string thread_name;
+        std::mutex mutex;//taken by the owner thread per event,contended only while the trace is written
+        std::vector<Event> events;
+        size_t dropped_count;
+    };
+
+    static std::atomic<Trace*> m_instance;
+
+    uint64_t m_generation;//tells thread local buffers of a deleted trace apart
+    std::string m_path;
+    std::chrono::steady_clock::time_point m_start;
+
+    //buffers of every thread that has recorded a zone,guarded by m_mutex
+    std::mutex m_mutex;
+    std::vector<ThreadBuffer*> m_buffers;
+private:
+    Trace(const std::string& path);
+    ~Trace();
+public:
+    //singleton
+    static void CreateInstance(const std::string& path);
+    static void DeleteInstance();//writes the file
+    static Trace* GetInstance();//nullptr if not created
+
+    //names the calling thread in the timeline
+    void SetThreadName(const std::string& name);
+    void AddEvent(const char* name,const std::string& arg,std::chrono::steady_clock::time_point begin,std::chrono::steady_clock::time_point end);
+
+    //every event so far,recording goes on
+    bool Write();
+private:
+    ThreadBuffer* GetThreadBuffer();
+};
+
+
+class TraceZone{
+private:
+    Trace* m_trace;
+    const char* m_name;
+    std::string m_arg;
+    std::chrono::steady_clock::time_point m_begin;
+public:
+    TraceZone(const char* name);
+    TraceZone(const char* name,const std::string& arg);
+    ~TraceZone();
+private:
+    TraceZone(const TraceZone&);
+    TraceZone& operator=(const TraceZone&);
+};
+
+inline TraceZone::TraceZone(const char* name):m_trace(Trace::GetInstance()),m_name(name){
+    if (m_trace != nullptr){
+        m_begin = std::chrono::steady_clock::now();
+    }
+}
+
+inline TraceZone::TraceZone(const char* name,const std::string& arg):m_trace(Trace::GetInstance()),m_name(name){
+    if (m_trace != nullptr){
+        m_arg = arg;
+        m_begin = std::chrono::steady_clock::now();
+    }
+}
+
+inline TraceZone::~TraceZone(){
+    if (m_trace != nullptr){
+        m_trace->AddEvent(m_name,m_arg,m_begin,std::chrono::steady_clock::now());
+    }
+}
+
+inline Trace* Trace::GetInstance(){
+    return m_instance.load(std::memory_order_acquire);
+}
+
+
+#define TRACE_CONCAT_IMPL(a,b) a##b
+#define TRACE_CONCAT(a,b) TRACE_CONCAT_IMPL(a,b)
+
+#if defined(DISABLE_TRACE)
+#define TRACE_ZONE(name)
+#define TRACE_ZONE_ARG(name,arg)
+#define TRACE_THREAD_NAME(name)
+#else
+//zone from here to the end of the scope,name has to be a string literal
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(trace_zone_,__LINE__)(name)
+//zone with a string shown in its args,e.g. a file path
+#define TRACE_ZONE_ARG(name,arg) TraceZone TRACE_CONCAT(trace_zone_,__LINE__)(name,arg)
+#define TRACE_THREAD_NAME(name) do{ if (Trace::GetInstance() != nullptr){ Trace::GetInstance()->SetThreadName(name); } }while (0)
+#endif
+
+#endif // TRACE_HPP
@@ -0,0 +1,238 @@
+#include "vertex_animation.hpp"
+#include "resource.hpp"
+#include "skinning.hpp"
+#include "gl_counter.hpp"
+
+#include <cstring>
+
+
+//preferred texture width,clamped to GL_MAX_TEXTURE_SIZE
+static const GLint VAT_WIDTH = 4096;
+
+//cache file header
+static const char VAT_MAGIC[4] = {'V','A','T','1'};
+struct VATHeader{
+    char magic[4];
+    uint32_t vertex_count;
+    uint32_t frame_count;
+    double duration;
+    uint64_t source_hash;
+};
+
+//fnv-1a
+static uint64_t hash_bytes(uint64_t hash,const void* data,size_t size){
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0;i < size;i++){
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+VertexAnimationTexture::VertexAnimationTexture(const Mesh& mesh,const Animation& animation,double frame_rate,const std::string& cache_path){
+    //check mesh
+    if (mesh.GetSkeleton() == nullptr){
+        std::cout << "VertexAnimationTexture::VertexAnimationTexture" << "\n";
+        std::cout << "mesh is not skeletal" << "\n";
+        std::terminate();
+    }
+
+    //vertex layout
+    m_vertex_count = 0;
+    m_base_vertices.resize(mesh.GetSubMeshCount());
+    for (size_t i = 0;i < mesh.GetSubMeshCount();i++){
+        m_base_vertices[i] = m_vertex_count;
+        m_vertex_count += mesh.GetSubMesh(i)->GetVertexCount();
+    }
+
+    //frame layout
+    m_duration = animation.GetDuration();
+    m_frame_count = (size_t)std::ceil(m_duration*frame_rate)+1;
+    if (m_frame_count < 2){
+        m_frame_count = 2;
+    }
+
+    //texture layout
+    GLint max_texture_size;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE,&max_texture_size);
+    size_t texel_count = m_vertex_count*m_frame_count;
+    m_width = std::min(VAT_WIDTH,max_texture_size);
+    m_height = (GLsizei)((texel_count+m_width-1)/m_width);
+    if (m_height > max_texture_size){
+        std::cout << "VertexAnimationTexture::VertexAnimationTexture" << "\n";
+        std::cout << "too many texels,lower the bake frame rate:" << texel_count << "\n";
+        std::terminate();
+    }
+
+    //source hash,bind pose xyz of the mesh and a few poses of the animation
+    uint64_t source_hash = 14695981039346656037ULL;
+    for (size_t i = 0;i < mesh.GetSubMeshCount();i++){
+        const std::vector<vec3>& xyz = mesh.GetSubMesh(i)->GetSkinning()->GetXYZ();
+        source_hash = hash_bytes(source_hash,xyz.data(),sizeof(vec3)*xyz.size());
+    }
+    std::vector<mat4> bp,bp_it;
+    for (int i = 0;i <= 2;i++){
+        animation.Sample(bp,bp_it,*mesh.GetSkeleton(),m_duration*i/2);
+        source_hash = hash_bytes(source_hash,bp.data(),sizeof(mat4)*bp.size());
+    }
+
+    //load cache or bake
+    std::vector<vec3> xyz,normal;
+    m_bake_time = 0;
+    if (!Load(cache_path,source_hash,xyz,normal)){
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        Bake(mesh,animation,xyz,normal);
+        m_bake_time = std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+        Save(cache_path,source_hash,xyz,normal);
+    }
+
+    //upload
+    CreateTexture(m_tbo_xyz,GL_RGB32F,xyz);
+    CreateTexture(m_tbo_normal,GL_RGB16F,normal);
+}
+
+VertexAnimationTexture::~VertexAnimationTexture(){
+    glDeleteTextures(1,&m_tbo_xyz);
+    glDeleteTextures(1,&m_tbo_normal);
+}
+
+size_t VertexAnimationTexture::GetVertexCount() const{
+    return m_vertex_count;
+}
+
+size_t VertexAnimationTexture::GetFrameCount() const{
+    return m_frame_count;
+}
+
+double VertexAnimationTexture::GetDuration() const{
+    return m_duration;
+}
+
+size_t VertexAnimationTexture::GetBaseVertex(size_t sub_mesh_index) const{
+    return m_base_vertices[sub_mesh_index];
+}
+
+size_t VertexAnimationTexture::GetByteSize() const{
+    //RGB32F+RGB16F
+    return (size_t)m_width*m_height*(3*4+3*2);
+}
+
+double VertexAnimationTexture::GetBakeTime() const{
+    return m_bake_time;
+}
+
+void VertexAnimationTexture::Bind(const Shader* shader,GLint texture_unit_offset) const{
+    //xyz
+    glActiveTexture(GL_TEXTURE0+texture_unit_offset+0);
+    GLCounter::BindTexture(GL_TEXTURE_2D,m_tbo_xyz);
+    GLCounter::Uniform1i(shader->GetUniformLocation("vat_xyz"),texture_unit_offset+0);
+
+    //normal
+    glActiveTexture(GL_TEXTURE0+texture_unit_offset+1);
+    GLCounter::BindTexture(GL_TEXTURE_2D,m_tbo_normal);
+    GLCounter::Uniform1i(shader->GetUniformLocation("vat_normal"),texture_unit_offset+1);
+
+    //layout
+    GLCounter::Uniform1i(shader->GetUniformLocation("vat_width"),m_width);
+    GLCounter::Uniform1i(shader->GetUniformLocation("vat_vertex_count"),(GLint)m_vertex_count);
+    GLCounter::Uniform1i(shader->GetUniformLocation("vat_frame_count"),(GLint)m_frame_count);
+    GLCounter::Uniform1f(shader->GetUniformLocation("vat_duration"),(GLfloat)m_duration);
+}
+
+void VertexAnimationTexture::Bake(const Mesh& mesh,const Animation& animation,std::vector<vec3>& xyz,std::vector<vec3>& normal){
+    const Skeleton* skeleton = mesh.GetSkeleton();
+    const std::vector<mat4>& bbp_i = skeleton->GetBBPI();
+    const std::vector<mat4>& bbp_iti = skeleton->GetBBPITI();
+    size_t bone_count = skeleton->GetBoneCount();
+
+    std::vector<mat4> bp(bone_count),bp_it(bone_count);
+    std::vector<mat4> palette_xyz(bone_count),palette_normal(bone_count);
+    std::vector<vec3> skinned_xyz,skinned_normal;
+
+    xyz.resize(m_vertex_count*m_frame_count);
+    normal.resize(m_vertex_count*m_frame_count);
+    for (size_t f = 0;f < m_frame_count;f++){
+        //palette,same as Skeleton::Update with cpu skinning
+        animation.Sample(bp,bp_it,*skeleton,m_duration*f/(m_frame_count-1));
+        for (size_t i = 0;i < bone_count;i++){
+            palette_xyz[i] = bp[i]*bbp_i[i];
+            palette_normal[i] = bp_it[i]*bbp_iti[i];
+        }
+
+        //skin every sub mesh into its rows
+        for (size_t i = 0;i < mesh.GetSubMeshCount();i++){
+            mesh.GetSubMesh(i)->GetSkinning()->Skin(palette_xyz,palette_normal,skinned_xyz,skinned_normal);
+            size_t offset = f*m_vertex_count+m_base_vertices[i];
+            std::copy(skinned_xyz.begin(),skinned_xyz.end(),xyz.begin()+offset);
+            std::copy(skinned_normal.begin(),skinned_normal.end(),normal.begin()+offset);
+        }
+    }
+}
+
+bool VertexAnimationTexture::Load(const std::string& path,uint64_t source_hash,std::vector<vec3>& xyz,std::vector<vec3>& normal){
+    //open file
+    std::FILE* fp = std::fopen(path.c_str(),"rb");
+    if (fp == NULL){
+        return false;
+    }
+
+    //check header
+    VATHeader header;
+    if (std::fread(&header,sizeof(header),1,fp) != 1
+        || std::memcmp(header.magic,VAT_MAGIC,4) != 0
+        || header.vertex_count != m_vertex_count
+        || header.frame_count != m_frame_count
+        || header.duration != m_duration
+        || header.source_hash != source_hash)
+    {
+        std::fclose(fp);
+        return false;
+    }
+
+    //read streams
+    xyz.resize(m_vertex_count*m_frame_count);
+    normal.resize(m_vertex_count*m_frame_count);
+    bool is_read = std::fread(xyz.data(),sizeof(vec3),xyz.size(),fp) == xyz.size()
+                && std::fread(normal.data(),sizeof(vec3),normal.size(),fp) == normal.size();
+    std::fclose(fp);
+    return is_read;
+}
+
+void VertexAnimationTexture::Save(const std::string& path,uint64_t source_hash,const std::vector<vec3>& xyz,const std::vector<vec3>& normal) const{
+    //open file
+    std::FILE* fp = std::fopen(path.c_str(),"wb");
+    if (fp == NULL){
+        std::cout << "failed to write vertex animation cache:" << path << "\n";
+        return;
+    }
+
+    //header
+    VATHeader header;
+    std::memcpy(header.magic,VAT_MAGIC,4);
+    header.vertex_count = (uint32_t)m_vertex_count;
+    header.frame_count = (uint32_t)m_frame_count;
+    header.duration = m_duration;
+    header.source_hash = source_hash;
+    std::fwrite(&header,sizeof(header),1,fp);
+
+    //streams
+    std::fwrite(xyz.data(),sizeof(vec3),xyz.size(),fp);
+    std::fwrite(normal.data(),sizeof(vec3),normal.size(),fp);
+    std::fclose(fp);
+}
+
+void VertexAnimationTexture::CreateTexture(GLuint& tbo,GLenum internal_format,const std::vector<vec3>& data){
+    //pad the last row
+    std::vector<vec3> texels(data);
+    texels.resize((size_t)m_width*m_height,vec3({0,0,0}));
+
+    glGenTextures(1,&tbo);
+    glBindTexture(GL_TEXTURE_2D,tbo);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+    glTexImage2D(GL_TEXTURE_2D,0,internal_format,m_width,m_height,0,GL_RGB,GL_FLOAT,texels.data());
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,0);
+    glBindTexture(GL_TEXTURE_2D,0);
+}
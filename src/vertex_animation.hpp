@@ -0,0 +1,58 @@
+#ifndef VERTEX_ANIMATION_HPP
+#define VERTEX_ANIMATION_HPP
+
+#include "library.hpp"
+#include "define.hpp"
+#include "matrix.hpp"
+
+#include <OpenGL/gl3.h>
+
+class Mesh;
+class Animation;
+class Shader;
+
+
+//vertex animation texture
+//skinned xyz and normal of every vertex at every frame,baked with cpu skinning
+//texel of vertex v at frame f is i%width,i/width where i = f*vertex_count+v
+//vertices of the sub meshes are concatenated,v = base vertex of the sub mesh+gl_VertexID
+//frames are evenly spaced over [0,duration],the first and the last frame are both baked
+
+class VertexAnimationTexture{
+private:
+    size_t m_vertex_count;              //total of all sub meshes
+    size_t m_frame_count;
+    double m_duration;
+    std::vector<size_t> m_base_vertices;//size = sub_mesh_count
+
+    GLsizei m_width;
+    GLsizei m_height;
+    GLuint m_tbo_xyz;   //RGB32F
+    GLuint m_tbo_normal;//RGB16F
+
+    double m_bake_time;//seconds,0 if loaded from cache
+public:
+    //frame_rate is the bake rate
+    //the bake is cached in cache_path and baked again when the cache does not match the mesh
+    VertexAnimationTexture(const Mesh& mesh,const Animation& animation,double frame_rate,const std::string& cache_path);
+    ~VertexAnimationTexture();
+
+    size_t GetVertexCount() const;
+    size_t GetFrameCount() const;
+    double GetDuration() const;
+    size_t GetBaseVertex(size_t sub_mesh_index) const;
+
+    //texture memory in bytes
+    size_t GetByteSize() const;
+    double GetBakeTime() const;
+
+    //binds both textures and the layout uniforms of vat.vert
+    void Bind(const Shader* shader,GLint texture_unit_offset) const;
+private:
+    void Bake(const Mesh& mesh,const Animation& animation,std::vector<vec3>& xyz,std::vector<vec3>& normal);
+    bool Load(const std::string& path,uint64_t source_hash,std::vector<vec3>& xyz,std::vector<vec3>& normal);
+    void Save(const std::string& path,uint64_t source_hash,const std::vector<vec3>& xyz,const std::vector<vec3>& normal) const;
+    void CreateTexture(GLuint& tbo,GLenum internal_format,const std::vector<vec3>& data);
+};
+
+#endif // VERTEX_ANIMATION_HPP
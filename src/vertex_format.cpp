@@ -0,0 +1,257 @@
+#include "vertex_format.hpp"
+
+#include <cstring>
+
+
+uint16_t EncodeHalf(float f){
+    uint32_t x;
+    std::memcpy(&x,&f,sizeof(x));
+    uint32_t sign = (x>>16)&0x8000;
+    uint32_t float_exponent = (x>>23)&0xFF;
+    int32_t exponent = (int32_t)float_exponent-127+15;
+    uint32_t mantissa = x&0x7FFFFF;
+
+    //inf,nan
+    if (float_exponent == 0xFF){
+        return (uint16_t)(sign|0x7C00|(mantissa != 0 ? 0x200 : 0));
+    }
+
+    //overflow
+    if (exponent >= 31){
+        return (uint16_t)(sign|0x7C00);
+    }
+
+    //subnormal,round to nearest even
+    if (exponent <= 0){
+        if (exponent < -10){
+            return (uint16_t)sign;
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t)(14-exponent);
+        uint32_t h = mantissa>>shift;
+        uint32_t rest = mantissa&((1u<<shift)-1);
+        uint32_t half = 1u<<(shift-1);
+        if (rest > half || (rest == half && (h&1) != 0)){
+            h++;
+        }
+        return (uint16_t)(sign|h);
+    }
+
+    //normal,round to nearest even,a carry moves into the exponent
+    uint32_t h = ((uint32_t)exponent<<10)|(mantissa>>13);
+    uint32_t rest = mantissa&0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (h&1) != 0)){
+        h++;
+    }
+    return (uint16_t)(sign|h);
+}
+
+float DecodeHalf(uint16_t h){
+    uint32_t sign = (uint32_t)(h&0x8000)<<16;
+    uint32_t exponent = (h>>10)&0x1F;
+    uint32_t mantissa = h&0x3FF;
+
+    //zero,subnormal
+    if (exponent == 0){
+        float f = std::ldexp((float)mantissa,-24);
+        return (sign != 0) ? -f : f;
+    }
+
+    uint32_t x;
+    if (exponent == 31){
+        x = sign|0x7F800000|(mantissa<<13);
+    }else{
+        x = sign|((exponent+112)<<23)|(mantissa<<13);
+    }
+    float f;
+    std::memcpy(&f,&x,sizeof(f));
+    return f;
+}
+
+
+static FLOAT sign_not_zero(FLOAT s){
+    return (s >= 0) ? 1 : -1;
+}
+
+vec3 DecodeOctahedral(const int16_t* e){
+    //same as decode_octahedral in the quantized shaders
+    FLOAT x = std::max((FLOAT)e[0]/32767,(FLOAT)-1);
+    FLOAT y = std::max((FLOAT)e[1]/32767,(FLOAT)-1);
+    FLOAT z = 1-std::abs(x)-std::abs(y);
+    if (z < 0){
+        FLOAT tx = (1-std::abs(y))*sign_not_zero(x);
+        FLOAT ty = (1-std::abs(x))*sign_not_zero(y);
+        x = tx;
+        y = ty;
+    }
+    return normalize(vec3({x,y,z}));
+}
+
+void EncodeOctahedral(const vec3& n,int16_t* e){
+    //project onto the octahedron and fold the lower half
+    FLOAT l1 = std::abs(n[0])+std::abs(n[1])+std::abs(n[2]);
+    if (l1 == 0){
+        e[0] = 0;
+        e[1] = 0;
+        return;
+    }
+    FLOAT px = n[0]/l1;
+    FLOAT py = n[1]/l1;
+    if (n[2] < 0){
+        FLOAT tx = (1-std::abs(py))*sign_not_zero(px);
+        FLOAT ty = (1-std::abs(px))*sign_not_zero(py);
+        px = tx;
+        py = ty;
+    }
+
+    //rounding to nearest is not always the closest direction,so try the four neighbors
+    FLOAT fx = std::floor(px*32767);
+    FLOAT fy = std::floor(py*32767);
+    FLOAT best_dot = -2;
+    vec3 un = normalize(n);
+    for (int i = 0;i < 4;i++){
+        int16_t c[2];
+        c[0] = (int16_t)std::min(std::max(fx+(i&1),(FLOAT)-32767),(FLOAT)32767);
+        c[1] = (int16_t)std::min(std::max(fy+(i>>1),(FLOAT)-32767),(FLOAT)32767);
+        FLOAT d = dot(DecodeOctahedral(c),un);
+        if (d > best_dot){
+            best_dot = d;
+            e[0] = c[0];
+            e[1] = c[1];
+        }
+    }
+}
+
+
+QuantizationError::QuantizationError():xyz(0),normal(0),uv(0),bone_weight(0){}
+
+void QuantizationError::Merge(const QuantizationError& error){
+    xyz = std::max(xyz,error.xyz);
+    normal = std::max(normal,error.normal);
+    uv = std::max(uv,error.uv);
+    bone_weight = std::max(bone_weight,error.bone_weight);
+}
+
+
+VertexQuantizer::VertexQuantizer(const vec3& xyz_min,const vec3& xyz_max,size_t bone_count){
+    m_xyz_min = xyz_min;
+    for (size_t i = 0;i < 3;i++){
+        m_xyz_extent[i] = xyz_max[i]-xyz_min[i];
+        if (m_xyz_extent[i] <= 0){
+            m_xyz_extent[i] = 1;
+        }
+    }
+    m_is_wide_bone_index = (bone_count > 256);
+}
+
+const vec3& VertexQuantizer::GetXYZMin() const{
+    return m_xyz_min;
+}
+
+const vec3& VertexQuantizer::GetXYZExtent() const{
+    return m_xyz_extent;
+}
+
+bool VertexQuantizer::IsWideBoneIndex() const{
+    return m_is_wide_bone_index;
+}
+
+void VertexQuantizer::Quantize(const std::vector<vec3>& xyz,
+                               const std::vector<vec2>& uv,
+                               const std::vector<vec3>& normal,
+                               const std::vector<int>& bone_index,
+                               const std::vector<FLOAT>& bone_weight,
+                               QuantizedStreams& streams,
+                               QuantizationError& error) const
+{
+    size_t vertex_count = xyz.size();
+
+    //xyz
+    streams.xyz.resize(4*vertex_count);
+    for (size_t i = 0;i < vertex_count;i++){
+        vec3 decoded;
+        for (size_t j = 0;j < 3;j++){
+            FLOAT t = (xyz[i][j]-m_xyz_min[j])/m_xyz_extent[j];
+            t = std::min(std::max(t,(FLOAT)0),(FLOAT)1);
+            streams.xyz[4*i+j] = (uint16_t)std::floor(t*65535+0.5f);
+            decoded[j] = m_xyz_min[j]+(FLOAT)streams.xyz[4*i+j]/65535*m_xyz_extent[j];
+        }
+        streams.xyz[4*i+3] = 0;
+        error.xyz = std::max(error.xyz,length(decoded-xyz[i]));
+    }
+
+    //normal
+    streams.normal.resize(2*vertex_count);
+    for (size_t i = 0;i < vertex_count;i++){
+        EncodeOctahedral(normal[i],&streams.normal[2*i]);
+        //atan2 keeps precision for small angles where acos of float does not
+        vec3 decoded = DecodeOctahedral(&streams.normal[2*i]);
+        vec3 un = normalize(normal[i]);
+        FLOAT angle = std::atan2(length(cross(decoded,un)),dot(decoded,un));
+        error.normal = std::max(error.normal,angle*180/PI);
+    }
+
+    //uv
+    streams.uv.resize(2*vertex_count);
+    for (size_t i = 0;i < vertex_count;i++){
+        for (size_t j = 0;j < 2;j++){
+            streams.uv[2*i+j] = EncodeHalf(uv[i][j]);
+            error.uv = std::max(error.uv,std::abs(DecodeHalf(streams.uv[2*i+j])-uv[i][j]));
+        }
+    }
+
+    //non skeletal
+    streams.bone_index8.clear();
+    streams.bone_index16.clear();
+    streams.bone_weight.clear();
+    if (bone_index.empty()){
+        return;
+    }
+
+    //bone index,unused slot(-1) becomes bone 0 with weight 0
+    if (m_is_wide_bone_index){
+        streams.bone_index16.resize(4*vertex_count);
+        for (size_t i = 0;i < 4*vertex_count;i++){
+            streams.bone_index16[i] = (uint16_t)std::max(bone_index[i],0);
+        }
+    }else{
+        streams.bone_index8.resize(4*vertex_count);
+        for (size_t i = 0;i < 4*vertex_count;i++){
+            streams.bone_index8[i] = (uint8_t)std::max(bone_index[i],0);
+        }
+    }
+
+    //bone weight,largest remainder rounding so that the four weights sum to exactly 255
+    streams.bone_weight.resize(4*vertex_count);
+    for (size_t i = 0;i < vertex_count;i++){
+        FLOAT w[4];
+        FLOAT sum = 0;
+        for (size_t j = 0;j < 4;j++){
+            w[j] = (bone_index[4*i+j] < 0) ? 0 : std::max(bone_weight[4*i+j],(FLOAT)0);
+            sum += w[j];
+        }
+
+        int q[4] = {0,0,0,0};
+        if (sum > 0){
+            FLOAT rest[4];
+            int total = 0;
+            for (size_t j = 0;j < 4;j++){
+                FLOAT s = w[j]/sum*255;
+                q[j] = (int)std::floor(s);
+                rest[j] = s-q[j];
+                total += q[j];
+            }
+            for (;total < 255;total++){
+                size_t k = std::max_element(rest,rest+4)-rest;
+                q[k]++;
+                rest[k] = -1;
+            }
+        }
+
+        for (size_t j = 0;j < 4;j++){
+            streams.bone_weight[4*i+j] = (uint8_t)q[j];
+            FLOAT original = (bone_index[4*i+j] < 0) ? 0 : bone_weight[4*i+j];
+            error.bone_weight = std::max(error.bone_weight,std::abs((FLOAT)q[j]/255-original));
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef VERTEX_FORMAT_HPP
+#define VERTEX_FORMAT_HPP
+
+#include "library.hpp"
+#include "define.hpp"
+#include "matrix.hpp"
+
+
+enum VertexFormat{
+    FLOAT_VERTEX,    //xyz,uv,normal as float,bone index as int,bone weight as float
+    QUANTIZED_VERTEX,//see QuantizedStreams
+};
+
+
+//float <-> half float
+uint16_t EncodeHalf(float f);
+float DecodeHalf(uint16_t h);
+
+//unit vector <-> octahedral map in snorm16x2
+void EncodeOctahedral(const vec3& n,int16_t* e);
+vec3 DecodeOctahedral(const int16_t* e);
+
+
+//compact streams of one sub mesh
+struct QuantizedStreams{
+    std::vector<uint16_t> xyz;         //size = 4*vertex_count,unorm16 relative to the mesh aabb,w is 0
+    std::vector<int16_t> normal;       //size = 2*vertex_count,octahedral snorm16
+    std::vector<uint16_t> uv;          //size = 2*vertex_count,half float
+    std::vector<uint8_t> bone_index8;  //size = 4*vertex_count,if bone count <= 256
+    std::vector<uint16_t> bone_index16;//size = 4*vertex_count,otherwise
+    std::vector<uint8_t> bone_weight;  //size = 4*vertex_count,unorm8 summing to 255
+};
+
+//max absolute difference between decoded and float data
+struct QuantizationError{
+    FLOAT xyz;        //model space distance
+    FLOAT normal;     //degree
+    FLOAT uv;
+    FLOAT bone_weight;
+
+    QuantizationError();
+    void Merge(const QuantizationError& error);
+};
+
+
+//quantizes the streams of every sub mesh of one mesh against the same aabb
+class VertexQuantizer{
+private:
+    vec3 m_xyz_min;
+    vec3 m_xyz_extent;//aabb size,0 axes are replaced by 1
+    bool m_is_wide_bone_index;
+public:
+    VertexQuantizer(const vec3& xyz_min,const vec3& xyz_max,size_t bone_count);
+
+    //decode in shader as xyz_min+xyz*xyz_extent
+    const vec3& GetXYZMin() const;
+    const vec3& GetXYZExtent() const;
+    bool IsWideBoneIndex() const;
+
+    //bone_index and bone_weight may be empty for non skeletal meshes
+    void Quantize(const std::vector<vec3>& xyz,
+                  const std::vector<vec2>& uv,
+                  const std::vector<vec3>& normal,
+                  const std::vector<int>& bone_index,
+                  const std::vector<FLOAT>& bone_weight,
+                  QuantizedStreams& streams,
+                  QuantizationError& error) const;
+};
+
+#endif // VERTEX_FORMAT_HPP
@@ -0,0 +1,106 @@
+#include "vertex_layout.hpp"
+
+#include <cstring>
+
+
+//attribute offsets in an interleaved vertex
+static const size_t ATTRIBUTE_ALIGNMENT = 4;
+
+
+VertexLayoutBuilder::VertexLayoutBuilder(size_t vertex_count):m_vertex_count(vertex_count){}
+
+void VertexLayoutBuilder::AddAttribute(GLuint location,
+                                       GLint component_count,
+                                       GLenum type,
+                                       GLboolean is_normalized,
+                                       bool is_integer,
+                                       bool is_dynamic,
+                                       size_t size,
+                                       const void* data)
+{
+    Attribute attribute;
+    attribute.location = location;
+    attribute.component_count = component_count;
+    attribute.type = type;
+    attribute.is_normalized = is_normalized;
+    attribute.is_integer = is_integer;
+    attribute.is_dynamic = is_dynamic;
+    attribute.size = size;
+    attribute.data = data;
+    m_attributes.push_back(attribute);
+}
+
+void VertexLayoutBuilder::Build(VertexLayout layout,std::vector<Stream>& streams) const{
+    //group attributes into streams
+    std::vector<std::vector<size_t>> groups;
+    std::vector<size_t> interleaved;
+    for (size_t i = 0;i < m_attributes.size();i++){
+        const Attribute& attribute = m_attributes[i];
+        if (layout == SPLIT_LAYOUT || attribute.is_dynamic){
+            groups.push_back(std::vector<size_t>(1,i));
+        }else if (layout == POSITION_SPLIT_LAYOUT && attribute.location == 0){
+            groups.push_back(std::vector<size_t>(1,i));
+        }else{
+            interleaved.push_back(i);
+        }
+    }
+    if (!interleaved.empty()){
+        groups.push_back(interleaved);
+    }
+
+    //create vbos
+    streams.resize(groups.size());
+    for (size_t i = 0;i < groups.size();i++){
+        BuildStream(groups[i],streams[i]);
+    }
+}
+
+void VertexLayoutBuilder::BuildStream(const std::vector<size_t>& attributes,Stream& stream) const{
+    //offsets and stride
+    std::vector<size_t> offsets(attributes.size());
+    size_t stride = 0;
+    bool is_dynamic = false;
+    for (size_t i = 0;i < attributes.size();i++){
+        const Attribute& attribute = m_attributes[attributes[i]];
+        offsets[i] = stride;
+        stride += (attribute.size+ATTRIBUTE_ALIGNMENT-1)/ATTRIBUTE_ALIGNMENT*ATTRIBUTE_ALIGNMENT;
+        is_dynamic = is_dynamic || attribute.is_dynamic;
+    }
+
+    //pack,a single attribute is uploaded as is
+    std::vector<unsigned char> packed;
+    const void* data;
+    if (attributes.size() == 1 && stride == m_attributes[attributes[0]].size){
+        data = m_attributes[attributes[0]].data;
+    }else{
+        packed.resize(stride*m_vertex_count,0);
+        for (size_t v = 0;v < m_vertex_count;v++){
+            for (size_t i = 0;i < attributes.size();i++){
+                const Attribute& attribute = m_attributes[attributes[i]];
+                const unsigned char* src = (const unsigned char*)attribute.data+attribute.size*v;
+                std::memcpy(&packed[stride*v+offsets[i]],src,attribute.size);
+            }
+        }
+        data = packed.data();
+    }
+
+    //vbo
+    glGenBuffers(1,&stream.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER,stream.vbo);
+    glBufferData(GL_ARRAY_BUFFER,stride*m_vertex_count,data,is_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+    stream.stride = (GLsizei)stride;
+
+    //attribute pointers
+    stream.locations.clear();
+    for (size_t i = 0;i < attributes.size();i++){
+        const Attribute& attribute = m_attributes[attributes[i]];
+        const GLvoid* offset = (const GLvoid*)offsets[i];
+        glEnableVertexAttribArray(attribute.location);
+        if (attribute.is_integer){
+            glVertexAttribIPointer(attribute.location,attribute.component_count,attribute.type,stream.stride,offset);
+        }else{
+            glVertexAttribPointer(attribute.location,attribute.component_count,attribute.type,attribute.is_normalized,stream.stride,offset);
+        }
+        stream.locations.push_back(attribute.location);
+    }
+}
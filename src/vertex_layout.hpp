@@ -0,0 +1,56 @@
+#ifndef VERTEX_LAYOUT_HPP
+#define VERTEX_LAYOUT_HPP
+
+#include "library.hpp"
+
+#include <OpenGL/gl3.h>
+
+
+enum VertexLayout{
+    SPLIT_LAYOUT,         //one vbo per attribute
+    INTERLEAVED_LAYOUT,   //one vbo,attributes interleaved with a computed stride
+    POSITION_SPLIT_LAYOUT,//xyz only vbo for depth only passes + interleaved vbo of the rest
+};
+
+
+//packs vertex attributes into vbos by layout and sets the attribute pointers of the bound vao
+//dynamic attributes always get their own vbo,so that they can be rewritten without touching the rest
+class VertexLayoutBuilder{
+public:
+    struct Attribute{
+        GLuint location;
+        GLint component_count;
+        GLenum type;
+        GLboolean is_normalized;
+        bool is_integer;  //glVertexAttribIPointer
+        bool is_dynamic;  //rewritten every frame
+        size_t size;      //bytes per vertex
+        const void* data; //size*vertex_count bytes
+    };
+    struct Stream{
+        GLuint vbo;
+        GLsizei stride;
+        std::vector<GLuint> locations;
+    };
+private:
+    size_t m_vertex_count;
+    std::vector<Attribute> m_attributes;
+public:
+    VertexLayoutBuilder(size_t vertex_count);
+
+    void AddAttribute(GLuint location,
+                      GLint component_count,
+                      GLenum type,
+                      GLboolean is_normalized,
+                      bool is_integer,
+                      bool is_dynamic,
+                      size_t size,
+                      const void* data);
+
+    //creates vbos,the vao must be bound
+    void Build(VertexLayout layout,std::vector<Stream>& streams) const;
+private:
+    void BuildStream(const std::vector<size_t>& attributes,Stream& stream) const;
+};
+
+#endif // VERTEX_LAYOUT_HPP